@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace dedupe {
+namespace bench {
+
+class Timer {
+public:
+    Timer() : start_(std::chrono::steady_clock::now()) {}
+
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+inline double megabytesPerSecond(std::uintmax_t bytes, double seconds) {
+    return seconds > 0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+// Ask the kernel to drop a file's clean pages so the next read comes from disk.
+// Returns false where that isn't possible, in which case "cold" runs are really warm.
+inline bool dropFileCache(const std::filesystem::path& path) {
+#if defined(__linux__)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    ::fdatasync(fd);
+    bool ok = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    ::close(fd);
+    return ok;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+// Individual benchmarks, each takes the arguments following its name
+int hashBench(int argc, char* argv[]);
+int uringBench(int argc, char* argv[]);
+int layoutBench(int argc, char* argv[]);
+int scanBench(int argc, char* argv[]);
+int treeBench(int argc, char* argv[]);
+int chunkBench(int argc, char* argv[]);
+int prefilterBench(int argc, char* argv[]);
+
+} // namespace bench
+} // namespace dedupe
@@ -0,0 +1,61 @@
+#include "bench.hpp"
+#include "filesystem_tree.hpp"
+#include <iostream>
+#include <string>
+
+std::atomic<int> dedupe::FileSystemTree::errors{ 0 };
+std::atomic<int> dedupe::FileSystemTree::directoryCount{ 0 };
+std::atomic<int> dedupe::FileSystemTree::fileCount{ 0 };
+
+void print_help() {
+    std::cout << "Usage: dedupe_bench <benchmark> [options]\n\n"
+              << "Benchmarks:\n"
+              << "  hash [--file <path>] [--size <MB>] [--iterations <n>]\n"
+              << "        Compare stream and mmap read modes on warm and cold caches\n"
+              << "  uring [--dir <path>] [--files <n>] [--size <KB>] [--iterations <n>]\n"
+              << "        Hash a batch of files through io_uring at queue depths 1, 8, 32 and 128\n"
+              << "  layout [--dir <path>] [--files <n>] [--size <KB>]\n"
+              << "        Compare seeks reading files in tree order and in on-disk order\n"
+              << "  scan [--dir <path>] [--dirs <n>] [--files <n>] [--iterations <n>]\n"
+              << "        List a directory tree with 1, 2, 4, 8 and 16 threads\n"
+              << "  tree [--dirs <n>] [--files <n>]\n"
+              << "        Compare memory and walk time of a heap node each and arena tree storage, and lookups with and without indexes\n"
+              << "  chunk [--size <MB>] [--average <bytes>] [--iterations <n>]\n"
+              << "        Compare content-defined chunking with hashing whole files, in memory\n"
+              << "  prefilter [--files <n>] [--copies <percent>] [--bits <n>]\n"
+              << "        Drop keys without a partner from a synthetic corpus through Bloom filters, report false\n"
+              << "        positives and memory against exact grouping (default: 50 million files, 1% copies)\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_help();
+        return 1;
+    }
+
+    std::string name = argv[1];
+    if (name == "hash") {
+        return dedupe::bench::hashBench(argc - 2, argv + 2);
+    }
+    if (name == "uring") {
+        return dedupe::bench::uringBench(argc - 2, argv + 2);
+    }
+    if (name == "layout") {
+        return dedupe::bench::layoutBench(argc - 2, argv + 2);
+    }
+    if (name == "scan") {
+        return dedupe::bench::scanBench(argc - 2, argv + 2);
+    }
+    if (name == "tree") {
+        return dedupe::bench::treeBench(argc - 2, argv + 2);
+    }
+    if (name == "chunk") {
+        return dedupe::bench::chunkBench(argc - 2, argv + 2);
+    }
+    if (name == "prefilter") {
+        return dedupe::bench::prefilterBench(argc - 2, argv + 2);
+    }
+
+    print_help();
+    return name == "--help" ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include "bench.hpp"
+#include "chunker.hpp"
+#include "hasher.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace dedupe {
+namespace bench {
+
+int chunkBench(int argc, char* argv[]) {
+    std::uintmax_t megabytes = 128;
+    std::size_t average = 64 * 1024;
+    int iterations = 3;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc) {
+            megabytes = std::stoull(argv[++i]);
+        }
+        else if (arg == "--average" && i + 1 < argc) {
+            average = std::stoull(argv[++i]);
+        }
+        else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::stoi(argv[++i]);
+        }
+    }
+
+    // In memory, so only the digest and the chunker are measured
+    std::string data(megabytes * 1024 * 1024, '\0');
+    std::mt19937_64 rng(42);
+    for (std::size_t i = 0; i + 8 <= data.size(); i += 8) {
+        std::uint64_t v = rng();
+        std::memcpy(&data[i], &v, 8);
+    }
+    auto params = ChunkParams::around(average);
+    Chunker chunker(params);
+    Progress progress;
+
+    std::cout << megabytes << " MB, chunks of " << params.minSize << " to " << params.maxSize
+              << " bytes, " << params.averageSize << " on average\n\n"
+              << std::left << std::setw(16) << "pass" << std::setw(10) << "hash"
+              << std::right << std::setw(12) << "MB/s" << std::setw(10) << "chunks" << "\n";
+    auto row = [&](const char* pass, const char* hash, double best, std::size_t chunks) {
+        std::cout << std::left << std::setw(16) << pass << std::setw(10) << hash << std::right << std::setw(12)
+                  << std::fixed << std::setprecision(1) << best << std::setw(10)
+                  << (chunks ? std::to_string(chunks) : "") << "\n";
+    };
+
+    // Cut points alone, the cost chunking adds to reading
+    double best = 0;
+    std::size_t count = 0;
+    for (int i = 0; i < iterations; ++i) {
+        Timer timer;
+        count = 0;
+        auto bytes = reinterpret_cast<const std::uint8_t*>(data.data());
+        for (std::size_t offset = 0; offset < data.size(); ++count) {
+            offset += chunker.cut(bytes + offset, data.size() - offset);
+        }
+        best = std::max(best, megabytesPerSecond(data.size(), timer.seconds()));
+    }
+    row("gear cut", "-", best, count);
+
+    for (auto algorithm : { HashAlgorithm::Xxh3_128, HashAlgorithm::Sha256 }) {
+        best = 0;
+        for (int i = 0; i < iterations; ++i) {
+            std::istringstream stream(data);
+            Timer timer;
+            Hasher::hash_stream(stream, progress, false, algorithm);
+            best = std::max(best, megabytesPerSecond(data.size(), timer.seconds()));
+        }
+        row("whole file", algorithm_name(algorithm), best, 0);
+
+        best = 0;
+        for (int i = 0; i < iterations; ++i) {
+            std::istringstream stream(data);
+            Timer timer;
+            count = Hasher::chunk_stream(stream, progress, params, algorithm).size();
+            best = std::max(best, megabytesPerSecond(data.size(), timer.seconds()));
+        }
+        row("chunked", algorithm_name(algorithm), best, count);
+    }
+    return 0;
+}
+
+} // namespace bench
+} // namespace dedupe
@@ -0,0 +1,87 @@
+#include "bench.hpp"
+#include "hasher.hpp"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace dedupe {
+namespace bench {
+
+namespace {
+
+void writeRandomFile(const std::filesystem::path& path, std::uintmax_t megabytes) {
+    std::ofstream out(path, std::ios::binary);
+    std::mt19937_64 rng(42);
+    std::vector<std::uint64_t> block(128 * 1024);
+    for (std::uintmax_t mb = 0; mb < megabytes; ++mb) {
+        for (auto& v : block) v = rng();
+        out.write(reinterpret_cast<const char*>(block.data()), 1024 * 1024);
+    }
+}
+
+} // namespace
+
+int hashBench(int argc, char* argv[]) {
+    std::filesystem::path file;
+    std::uintmax_t megabytes = 512;
+    int iterations = 3;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--file" && i + 1 < argc) {
+            file = argv[++i];
+        }
+        else if (arg == "--size" && i + 1 < argc) {
+            megabytes = std::stoull(argv[++i]);
+        }
+        else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::stoi(argv[++i]);
+        }
+    }
+
+    bool temporary = file.empty();
+    if (temporary) {
+        file = std::filesystem::temp_directory_path() / "dedupe_hash_bench.bin";
+        std::cout << "Writing " << megabytes << " MB test file " << file << "\n";
+        writeRandomFile(file, megabytes);
+    }
+    auto bytes = std::filesystem::file_size(file);
+
+    struct Mode { const char* name; ReadMode mode; };
+    std::vector<Mode> modes = { { "stream", ReadMode::Stream } };
+    if (Hasher::mapping_supported()) {
+        modes.push_back({ "mmap", ReadMode::Mapped });
+    }
+
+    Progress progress;
+    std::cout << std::left << std::setw(8) << "mode" << std::setw(8) << "cache"
+              << std::right << std::setw(12) << "MB/s" << "\n";
+    for (const auto& m : modes) {
+        for (bool cold : { true, false }) {
+            double best = 0;
+            // Warm runs need one read first to pull the file into the page cache
+            if (!cold) Hasher::hash_file(file, progress, false, m.mode);
+            for (int i = 0; i < iterations; ++i) {
+                if (cold && !dropFileCache(file) && i == 0) {
+                    std::cout << "(cannot drop page cache here, cold numbers are warm)\n";
+                }
+                Timer timer;
+                Hasher::hash_file(file, progress, false, m.mode);
+                best = std::max(best, megabytesPerSecond(bytes, timer.seconds()));
+            }
+            std::cout << std::left << std::setw(8) << m.name << std::setw(8) << (cold ? "cold" : "warm")
+                      << std::right << std::setw(12) << std::fixed << std::setprecision(1) << best << "\n";
+        }
+    }
+
+    if (temporary) {
+        std::filesystem::remove(file);
+    }
+    return 0;
+}
+
+} // namespace bench
+} // namespace dedupe
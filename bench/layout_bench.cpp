@@ -0,0 +1,176 @@
+#include "bench.hpp"
+#include "hasher.hpp"
+#include "layout.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
+
+namespace dedupe {
+namespace bench {
+
+namespace {
+
+struct File {
+    std::filesystem::path path;
+    std::uintmax_t size;
+    LayoutKey key;
+};
+
+// A simple disk model: contiguous reads cost only transfer time, any other
+// jump costs a settle time plus a part of a full stroke proportional to distance.
+struct SeekModel {
+    double settleMs = 2.0;
+    double strokeMs = 12.0;
+    double megabytesPerSecond = 150.0;
+};
+
+struct OrderStats {
+    std::size_t seeks = 0;
+    std::uint64_t distance = 0;
+    double modelSeconds = 0;
+};
+
+OrderStats walk(const std::vector<File>& files, std::uint64_t span, const SeekModel& model) {
+    OrderStats stats;
+    std::uint64_t head = 0;
+    bool first = true;
+    for (const auto& f : files) {
+        std::uint64_t start = f.key.position;
+        if (first || start != head) {
+            std::uint64_t jump = first ? 0 : (start > head ? start - head : head - start);
+            ++stats.seeks;
+            stats.distance += jump;
+            stats.modelSeconds += (model.settleMs + model.strokeMs * static_cast<double>(jump) / static_cast<double>(span)) / 1000.0;
+        }
+        stats.modelSeconds += static_cast<double>(f.size) / (model.megabytesPerSecond * 1024 * 1024);
+        head = start + f.size;
+        first = false;
+    }
+    return stats;
+}
+
+double hashAll(const std::vector<File>& files) {
+    Progress progress;
+    for (const auto& f : files) {
+        dropFileCache(f.path);
+    }
+    Timer timer;
+    for (const auto& f : files) {
+        Hasher::hash_file(f.path, progress, false, ReadMode::Stream, HashAlgorithm::Xxh3_128);
+    }
+    return timer.seconds();
+}
+
+} // namespace
+
+int layoutBench(int argc, char* argv[]) {
+    std::filesystem::path dir;
+    std::size_t count = 500;
+    std::uintmax_t kilobytes = 256;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dir" && i + 1 < argc) {
+            dir = argv[++i];
+        }
+        else if (arg == "--files" && i + 1 < argc) {
+            count = std::stoul(argv[++i]);
+        }
+        else if (arg == "--size" && i + 1 < argc) {
+            kilobytes = std::stoull(argv[++i]);
+        }
+    }
+
+    // Write files in shuffled order so allocation order and name order disagree,
+    // as they do in a tree that has grown over years
+    bool temporary = dir.empty();
+    if (temporary) {
+        dir = std::filesystem::temp_directory_path() / "dedupe_layout_bench";
+        std::filesystem::create_directories(dir);
+        std::cout << "Writing " << count << " files of " << kilobytes << " KB to " << dir << "\n";
+        std::vector<std::size_t> order(count);
+        for (std::size_t i = 0; i < count; ++i) order[i] = i;
+        std::shuffle(order.begin(), order.end(), std::mt19937(42));
+        std::vector<char> block(kilobytes * 1024, 'x');
+        for (auto i : order) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "file%06zu.bin", i);
+            auto path = dir / name;
+#if defined(__unix__) || defined(__APPLE__)
+            // Sync each file so its extents are allocated before the next is written
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) continue;
+            block[0] = static_cast<char>(i);
+            if (::write(fd, block.data(), block.size()) < 0) {}
+            ::fsync(fd);
+            ::close(fd);
+#endif
+        }
+    }
+
+    std::vector<File> files;
+    std::size_t physical = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (!entry.is_regular_file()) continue;
+        File f{ entry.path(), entry.file_size(), {} };
+        std::uint64_t device = 0, inode = 0;
+#if defined(__unix__) || defined(__APPLE__)
+        struct stat st;
+        if (::stat(f.path.c_str(), &st) == 0) {
+            device = st.st_dev;
+            inode = st.st_ino;
+        }
+#endif
+        f.key = layout_key(f.path, device, inode);
+        if (!f.key.estimated) ++physical;
+        files.push_back(f);
+    }
+    if (files.empty()) {
+        std::cout << "No files to read\n";
+        return 1;
+    }
+    if (physical < files.size()) {
+        std::cout << "(" << files.size() - physical << " of " << files.size()
+                  << " files have no extent information, seek figures use inode numbers)\n";
+    }
+
+    std::uint64_t low = files.front().key.position, high = low;
+    for (const auto& f : files) {
+        low = std::min(low, f.key.position);
+        high = std::max(high, f.key.position + f.size);
+    }
+    std::uint64_t span = std::max<std::uint64_t>(high - low, 1);
+
+    auto tree = files;
+    std::sort(tree.begin(), tree.end(), [](const File& a, const File& b) { return a.path < b.path; });
+    auto layout = files;
+    std::sort(layout.begin(), layout.end(), [](const File& a, const File& b) { return a.key < b.key; });
+
+    SeekModel model;
+    std::cout << std::left << std::setw(8) << "order" << std::right << std::setw(10) << "seeks"
+              << std::setw(14) << "distance MB" << std::setw(12) << "model s" << std::setw(12) << "cold s" << "\n";
+    for (const auto& [name, order] : { std::make_pair("tree", &tree), std::make_pair("layout", &layout) }) {
+        auto stats = walk(*order, span, model);
+        double measured = hashAll(*order);
+        std::cout << std::left << std::setw(8) << name << std::right << std::setw(10) << stats.seeks
+                  << std::setw(14) << std::fixed << std::setprecision(1) << stats.distance / (1024.0 * 1024.0)
+                  << std::setw(12) << std::setprecision(3) << stats.modelSeconds
+                  << std::setw(12) << measured << "\n";
+    }
+
+    if (temporary) {
+        std::filesystem::remove_all(dir);
+    }
+    return 0;
+}
+
+} // namespace bench
+} // namespace dedupe
@@ -0,0 +1,139 @@
+#include "bench.hpp"
+#include "bloom_filter.hpp"
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+namespace dedupe {
+namespace bench {
+
+namespace {
+
+std::size_t allocated = 0;
+
+// Counts what the exact grouping map takes, nodes and buckets
+template<typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator() = default;
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        allocated += n * sizeof(T);
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* p, std::size_t n) {
+        allocated -= n * sizeof(T);
+        ::operator delete(p);
+    }
+
+    template<typename U>
+    bool operator==(const CountingAllocator<U>&) const { return true; }
+    template<typename U>
+    bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+std::uint64_t mix(std::uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Synthetic corpus: file i copies an earlier file with the given chance in ten
+// thousand, and otherwise has content of its own. Sizes come from a thousand
+// values, so every size group is large.
+struct Corpus {
+    std::uint64_t copyChance;
+
+    std::uint64_t origin(std::uint64_t i) const {
+        while (i > 0 && mix(i ^ 0x636f7079) % 10000 < copyChance) {
+            i = mix(i) % i;
+        }
+        return i;
+    }
+
+    std::uint64_t key(std::uint64_t i) const {
+        auto o = origin(i);
+        Digest digest;
+        for (std::size_t w = 0; w < Digest::SIZE / 8; ++w) {
+            std::uint64_t v = mix(o * 4 + w);
+            std::memcpy(digest.bytes.data() + w * 8, &v, 8);
+        }
+        return PartnerFilter::key(4096 * (1 + mix(o ^ 0x73697a65) % 1000), digest);
+    }
+};
+
+} // namespace
+
+int prefilterBench(int argc, char* argv[]) {
+    std::uint64_t files = 50000000;
+    double copies = 1.0;
+    double bitsPerKey = BloomFilter::DEFAULT_BITS_PER_KEY;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--files" && i + 1 < argc) {
+            files = std::stoull(argv[++i]);
+        }
+        else if (arg == "--copies" && i + 1 < argc) {
+            copies = std::stod(argv[++i]);
+        }
+        else if (arg == "--bits" && i + 1 < argc) {
+            bitsPerKey = std::stod(argv[++i]);
+        }
+    }
+
+    Corpus corpus{ static_cast<std::uint64_t>(copies * 100) };
+    std::cout << files << " files, " << copies << "% copies of another, " << bitsPerKey << " bits a key per filter\n";
+
+    Timer timer;
+    PartnerFilter filter(files, bitsPerKey);
+    for (std::uint64_t i = 0; i < files; ++i) {
+        filter.add(corpus.key(i));
+    }
+    double filterSeconds = timer.seconds();
+
+    // Exact grouping of what passed. Every occurrence of a repeated key passes,
+    // so a key seen once here is a false positive.
+    timer = Timer();
+    std::unordered_map<std::uint64_t, std::uint32_t, std::hash<std::uint64_t>, std::equal_to<std::uint64_t>,
+                       CountingAllocator<std::pair<const std::uint64_t, std::uint32_t>>> exact;
+    std::uint64_t passed = 0;
+    for (std::uint64_t i = 0; i < files; ++i) {
+        auto key = corpus.key(i);
+        if (filter.mayRepeat(key)) {
+            ++passed;
+            ++exact[key];
+        }
+    }
+    double exactSeconds = timer.seconds();
+    std::uint64_t falsePositives = 0;
+    std::uint64_t partnered = 0;
+    for (const auto& [key, count] : exact) {
+        if (count == 1) ++falsePositives;
+        else partnered += count;
+    }
+    auto alone = files - partnered;
+    double perEntry = exact.empty() ? 0 : static_cast<double>(allocated) / exact.size();
+    auto distinct = alone + (exact.size() - falsePositives);
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "Filter pass:        " << filterSeconds << " s, " << filter.bytes() / (1024.0 * 1024.0) << " MB\n"
+              << "Files with partner: " << partnered << ", without: " << alone << "\n"
+              << "Passed the filter:  " << passed << " (" << 100.0 * passed / files << "%)\n"
+              << "False positives:    " << falsePositives << " (" << std::setprecision(3)
+              << (alone ? 100.0 * falsePositives / alone : 0.0) << "% of files without a partner)\n" << std::setprecision(2)
+              << "Exact grouping:     " << exactSeconds << " s, " << allocated / (1024.0 * 1024.0) << " MB for "
+              << exact.size() << " keys (" << perEntry << " bytes each)\n"
+              << "Without the filter: about " << perEntry * distinct / (1024.0 * 1024.0) << " MB for all "
+              << distinct << " distinct keys at the same cost each\n";
+    return 0;
+}
+
+} // namespace bench
+} // namespace dedupe
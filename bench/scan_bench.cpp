@@ -0,0 +1,81 @@
+#include "bench.hpp"
+#include "filesystem_tree.hpp"
+#include "progress.hpp"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace dedupe {
+namespace bench {
+
+int scanBench(int argc, char* argv[]) {
+    std::filesystem::path dir;
+    std::size_t directories = 2000;
+    std::size_t files = 10;
+    int iterations = 3;
+    std::vector<unsigned> threads{ 1, 2, 4, 8, 16 };
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dir" && i + 1 < argc) {
+            dir = argv[++i];
+        }
+        else if (arg == "--dirs" && i + 1 < argc) {
+            directories = std::stoul(argv[++i]);
+        }
+        else if (arg == "--files" && i + 1 < argc) {
+            files = std::stoul(argv[++i]);
+        }
+        else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::stoi(argv[++i]);
+        }
+    }
+
+    // Two levels of directories, so there is parallelism below the root to find
+    bool temporary = dir.empty();
+    if (temporary) {
+        dir = std::filesystem::temp_directory_path() / "dedupe_scan_bench";
+        std::cout << "Writing " << directories << " directories of " << files << " files to " << dir << "\n";
+        std::size_t fanout = 1;
+        while (fanout * fanout < directories) ++fanout;
+        for (std::size_t d = 0; d < directories; ++d) {
+            auto sub = dir / ("d" + std::to_string(d / fanout)) / ("d" + std::to_string(d));
+            std::filesystem::create_directories(sub);
+            for (std::size_t f = 0; f < files; ++f) {
+                std::ofstream(sub / ("f" + std::to_string(f))) << d << ' ' << f;
+            }
+        }
+    }
+
+    // Listings come from the dentry cache after the first pass, on a network
+    // filesystem each one is a round trip and threads gain much more
+    Progress progress;
+    FileSystemTree::buildFromPath(dir, progress);
+    std::cout << FileSystemTree::fileCount << " files, " << FileSystemTree::directoryCount << " directories (warm cache)\n";
+    std::cout << std::left << std::setw(10) << "threads" << std::right << std::setw(12) << "seconds"
+              << std::setw(12) << "speedup" << "\n";
+    double serial = 0;
+    for (auto n : threads) {
+        double best = 0;
+        for (int i = 0; i < iterations; ++i) {
+            Timer timer;
+            FileSystemTree::buildFromPath(dir, progress, true, n);
+            double seconds = timer.seconds();
+            best = (i == 0 || seconds < best) ? seconds : best;
+        }
+        if (n == 1) serial = best;
+        std::cout << std::left << std::setw(10) << n << std::right << std::setw(12) << std::fixed
+                  << std::setprecision(4) << best << std::setw(12) << std::setprecision(2)
+                  << (best > 0 ? serial / best : 0.0) << "\n";
+    }
+
+    if (temporary) {
+        std::filesystem::remove_all(dir);
+    }
+    return 0;
+}
+
+} // namespace bench
+} // namespace dedupe
@@ -0,0 +1,176 @@
+#include "bench.hpp"
+#include "filesystem_tree.hpp"
+#include "nested_tree.hpp"
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace dedupe {
+namespace bench {
+
+namespace {
+
+// Bytes in use on the heap, 0 where that can't be asked
+std::size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    auto info = mallinfo2();
+    return info.uordblks + info.hblkhd;     // Large blocks are mapped separately
+#else
+    return 0;
+#endif
+}
+
+FileSystemNode syntheticFile(std::size_t directory, std::size_t file, std::size_t files) {
+    FileSystemNode data(std::to_string(file), false, file * 4096);
+    auto id = directory * files + file + 1;
+    data.hash = Digest::fromBytes(&id, sizeof(id));
+    return data;
+}
+
+// directories of files each, a heap node each as FileSystemTree used to have
+NestedTree<FileSystemNode>::NodePtr nestedSynthetic(std::size_t directories, std::size_t files) {
+    auto root = std::make_shared<NestedNode<FileSystemNode>>(FileSystemNode("r", true));
+    for (std::size_t d = 0; d < directories; ++d) {
+        auto dir = std::make_shared<NestedNode<FileSystemNode>>(FileSystemNode(std::to_string(d), true));
+        for (std::size_t f = 0; f < files; ++f) {
+            dir->addChild(std::make_shared<NestedNode<FileSystemNode>>(syntheticFile(d, f, files)));
+        }
+        root->addChild(dir);
+    }
+    return root;
+}
+
+// The same tree in tree's arena, built a directory at a time as scans do
+FileSystemTree::NodePtr synthetic(FileSystemTree& tree, std::size_t directories, std::size_t files) {
+    auto root = tree.createNode(FileSystemNode("r", true));
+    std::vector<FileSystemNode> dirs;
+    for (std::size_t d = 0; d < directories; ++d) {
+        dirs.emplace_back(std::to_string(d), true);
+    }
+    root->addChildren(std::move(dirs));
+    for (std::size_t d = 0; d < directories; ++d) {
+        std::vector<FileSystemNode> children;
+        children.reserve(files);
+        for (std::size_t f = 0; f < files; ++f) {
+            children.push_back(syntheticFile(d, f, files));
+        }
+        root->children()[d]->addChildren(std::move(children));
+    }
+    return root;
+}
+
+template<typename Tree>
+double sumSizes(const Tree& tree) {
+    Timer timer;
+    std::uintmax_t total = 0;
+    tree.depthFirstTraverse([&](const auto& node) { total += node->data().size; });
+    volatile std::uintmax_t sink = total;
+    (void)sink;
+    return timer.seconds();
+}
+
+} // namespace
+
+int treeBench(int argc, char* argv[]) {
+    std::size_t directories = 10000;
+    std::size_t files = 100;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dirs" && i + 1 < argc) {
+            directories = std::stoul(argv[++i]);
+        }
+        else if (arg == "--files" && i + 1 < argc) {
+            files = std::stoul(argv[++i]);
+        }
+    }
+
+    std::size_t nodes = 1 + directories * (files + 1);
+    std::cout << "Building " << nodes << " nodes, FileSystemNode is " << sizeof(FileSystemNode) << " bytes\n";
+
+    std::size_t nestedBytes, arenaBytes;
+    double nestedSeconds;
+    {
+        auto before = heapInUse();
+        NestedTree<FileSystemNode> nested;
+        nested.setRoot(nestedSynthetic(directories, files));
+        nestedBytes = heapInUse() - before;
+        nestedSeconds = sumSizes(nested);
+    }
+    auto before = heapInUse();
+    FileSystemTree tree;
+    tree.setRoot(synthetic(tree, directories, files));
+    arenaBytes = heapInUse() - before;
+
+    std::cout << std::left << std::setw(10) << "storage" << std::right << std::setw(14) << "heap MB"
+              << std::setw(14) << "bytes/node" << std::setw(14) << "walk s" << "\n";
+    auto row = [&](const char* name, std::size_t bytes, double seconds) {
+        std::cout << std::left << std::setw(10) << name << std::right << std::setw(14) << std::fixed
+                  << std::setprecision(1) << bytes / (1024.0 * 1024.0) << std::setw(14)
+                  << static_cast<double>(bytes) / static_cast<double>(nodes) << std::setw(14)
+                  << std::setprecision(4) << seconds << "\n";
+    };
+    row("nested", nestedBytes, nestedSeconds);
+    row("arena", arenaBytes, sumSizes(tree));
+    if (nestedBytes == 0) {
+        std::cout << "(heap usage isn't available on this platform)\n";
+    }
+
+    // Lookups spread over the tree, timed without then with the indexes
+    std::vector<std::filesystem::path> paths;
+    std::vector<Digest> hashes;
+    for (std::size_t i = 0; i < 1000; ++i) {
+        std::size_t d = i * 7919 % directories, f = i * 104729 % files;
+        paths.push_back(std::filesystem::path("r") / std::to_string(d) / std::to_string(f));
+        if (i < 20) {
+            auto id = d * files + f + 1;
+            hashes.push_back(Digest::fromBytes(&id, sizeof(id)));
+        }
+    }
+    auto lookups = [&](const FileSystemTree& tree, double& pathSeconds, double& hashSeconds) {
+        std::size_t found = 0;
+        Timer timer;
+        for (const auto& path : paths) {
+            found += tree.findByPath(path) != nullptr;
+        }
+        pathSeconds = timer.seconds() / paths.size();
+        timer = Timer();
+        for (const auto& hash : hashes) {
+            found += tree.findFilesByHash(hash).size();
+        }
+        hashSeconds = timer.seconds() / hashes.size();
+        return found;
+    };
+
+    double scanPath, scanHash, indexPath, indexHash;
+    auto scanFound = lookups(tree, scanPath, scanHash);
+    before = heapInUse();
+    Timer timer;
+    tree.buildIndexes();
+    double buildSeconds = timer.seconds();
+    auto indexBytes = heapInUse() - before;
+    auto indexFound = lookups(tree, indexPath, indexHash);
+
+    std::cout << "\nindexes: built in " << std::setprecision(3) << buildSeconds << " s, heap "
+              << std::setprecision(1) << indexBytes / (1024.0 * 1024.0) << " MB ("
+              << static_cast<double>(indexBytes) / static_cast<double>(nodes) << " bytes/node), estimated "
+              << tree.indexMemoryUsage() / (1024.0 * 1024.0) << " MB\n";
+    std::cout << std::left << std::setw(10) << "lookup" << std::right << std::setw(14) << "scan us"
+              << std::setw(14) << "indexed us" << "\n" << std::setprecision(2);
+    std::cout << std::left << std::setw(10) << "path" << std::right << std::setw(14) << scanPath * 1e6
+              << std::setw(14) << indexPath * 1e6 << "\n";
+    std::cout << std::left << std::setw(10) << "hash" << std::right << std::setw(14) << scanHash * 1e6
+              << std::setw(14) << indexHash * 1e6 << "\n";
+    if (scanFound != indexFound) {
+        std::cerr << "Indexed lookups found " << indexFound << " nodes, scans " << scanFound << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace bench
+} // namespace dedupe
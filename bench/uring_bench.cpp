@@ -0,0 +1,103 @@
+#include "bench.hpp"
+#include "hasher.hpp"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace dedupe {
+namespace bench {
+
+int uringBench(int argc, char* argv[]) {
+    std::filesystem::path dir;
+    std::size_t count = 256;
+    std::uintmax_t kilobytes = 1024;
+    int iterations = 3;
+
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dir" && i + 1 < argc) {
+            dir = argv[++i];
+        }
+        else if (arg == "--files" && i + 1 < argc) {
+            count = std::stoul(argv[++i]);
+        }
+        else if (arg == "--size" && i + 1 < argc) {
+            kilobytes = std::stoull(argv[++i]);
+        }
+        else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::stoi(argv[++i]);
+        }
+    }
+
+    if (!Hasher::uring_supported()) {
+        std::cout << "io_uring is not available here, every depth would measure the stream fallback\n";
+        return 1;
+    }
+
+    // Hash the regular files of --dir, or write a set of random files
+    std::vector<std::filesystem::path> files;
+    bool temporary = dir.empty();
+    if (temporary) {
+        dir = std::filesystem::temp_directory_path() / "dedupe_uring_bench";
+        std::filesystem::create_directories(dir);
+        std::cout << "Writing " << count << " files of " << kilobytes << " KB to " << dir << "\n";
+        std::mt19937_64 rng(42);
+        std::vector<std::uint64_t> block(kilobytes * 1024 / sizeof(std::uint64_t));
+        for (std::size_t i = 0; i < count; ++i) {
+            for (auto& v : block) v = rng();
+            files.push_back(dir / ("file" + std::to_string(i) + ".bin"));
+            std::ofstream(files.back(), std::ios::binary)
+                .write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(std::uint64_t));
+        }
+    }
+    else {
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.is_regular_file()) files.push_back(entry.path());
+        }
+    }
+    std::uintmax_t bytes = 0;
+    for (const auto& f : files) {
+        bytes += std::filesystem::file_size(f);
+    }
+
+    struct Run { std::string name; ReadMode mode; unsigned depth; };
+    std::vector<Run> runs = { { "stream", ReadMode::Stream, 1 } };
+    for (unsigned depth : { 1u, 8u, 32u, 128u }) {
+        runs.push_back({ "uring qd" + std::to_string(depth), ReadMode::Uring, depth });
+    }
+
+    Progress progress;
+    std::cout << std::left << std::setw(12) << "mode" << std::setw(8) << "cache"
+              << std::right << std::setw(12) << "MB/s" << "\n";
+    for (const auto& r : runs) {
+        for (bool cold : { true, false }) {
+            double best = 0;
+            if (!cold) Hasher::hash_files(files, progress, r.mode, HashAlgorithm::Xxh3_128, r.depth);
+            for (int i = 0; i < iterations; ++i) {
+                if (cold) {
+                    bool dropped = true;
+                    for (const auto& f : files) dropped = dropFileCache(f) && dropped;
+                    if (!dropped && i == 0) {
+                        std::cout << "(cannot drop page cache here, cold numbers are warm)\n";
+                    }
+                }
+                Timer timer;
+                Hasher::hash_files(files, progress, r.mode, HashAlgorithm::Xxh3_128, r.depth);
+                best = std::max(best, megabytesPerSecond(bytes, timer.seconds()));
+            }
+            std::cout << std::left << std::setw(12) << r.name << std::setw(8) << (cold ? "cold" : "warm")
+                      << std::right << std::setw(12) << std::fixed << std::setprecision(1) << best << "\n";
+        }
+    }
+
+    if (temporary) {
+        std::filesystem::remove_all(dir);
+    }
+    return 0;
+}
+
+} // namespace bench
+} // namespace dedupe
@@ -0,0 +1,504 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace dedupe {
+
+template<typename T> class ArenaNode;
+template<typename T> class ArenaTree;
+template<typename T> class NodeArena;
+
+// Elements in fixed-size blocks allocated as they're needed. Elements never move,
+// so a thread can go on using the ones handed to it while another appends more.
+template<typename E>
+class BlockArray {
+public:
+    using Index = std::uint32_t;
+    static constexpr unsigned BLOCK_BITS = 14;
+    static constexpr Index BLOCK_SIZE = Index(1) << BLOCK_BITS;
+    static constexpr Index MAX_BLOCKS = Index(1) << 14;
+
+    E* at(Index i) const {
+        return reinterpret_cast<E*>(blocks_[i >> BLOCK_BITS].get() + (i & (BLOCK_SIZE - 1)));
+    }
+
+    // Room for elements [0, end). Callers serialize this, not at.
+    void grow(std::size_t end) {
+        if (end > std::size_t(MAX_BLOCKS) * BLOCK_SIZE) {
+            throw std::length_error("Tree too large");
+        }
+        if (!blocks_) {
+            blocks_.reset(new std::unique_ptr<Slot[]>[MAX_BLOCKS]());
+        }
+        for (; std::size_t(allocated_) * BLOCK_SIZE < end; ++allocated_) {
+            blocks_[allocated_].reset(new Slot[BLOCK_SIZE]);
+        }
+    }
+
+    std::size_t memoryUsage() const {
+        return (blocks_ ? MAX_BLOCKS * sizeof(void*) : 0) + std::size_t(allocated_) * BLOCK_SIZE * sizeof(Slot);
+    }
+
+private:
+    struct alignas(E) Slot {
+        unsigned char bytes[sizeof(E)];
+    };
+
+    std::unique_ptr<std::unique_ptr<Slot[]>[]> blocks_;
+    Index allocated_ = 0;
+};
+
+// A node of an ArenaTree, in the API of NestedNode. Nodes live in their tree's
+// arena and refer to each other by 32-bit index: the parent by its own, the
+// children by a range of the arena's link array. NodePtr is a plain pointer,
+// valid until the node is removed from the tree or the last copy of the tree
+// is destroyed.
+template<typename T>
+class ArenaNode {
+public:
+    using Index = std::uint32_t;
+    using NodePtr = ArenaNode*;
+    static constexpr Index NONE = ~Index(0);
+
+    // Children in order, as NodePtrs. Stale once children are added or removed.
+    class ChildRange {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = NodePtr;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const NodePtr*;
+            using reference = NodePtr;
+
+            iterator(const NodeArena<T>* arena, Index link) : arena_(arena), link_(link) {}
+            NodePtr operator*() const { return arena_->node(arena_->link(link_)); }
+            iterator& operator++() { ++link_; return *this; }
+            bool operator==(const iterator& other) const { return link_ == other.link_; }
+            bool operator!=(const iterator& other) const { return link_ != other.link_; }
+
+        private:
+            const NodeArena<T>* arena_;
+            Index link_;
+        };
+
+        ChildRange(const NodeArena<T>* arena, Index first, Index count) : arena_(arena), first_(first), count_(count) {}
+
+        iterator begin() const { return iterator(arena_, first_); }
+        iterator end() const { return iterator(arena_, first_ + count_); }
+        std::size_t size() const { return count_; }
+        bool empty() const { return count_ == 0; }
+        NodePtr operator[](std::size_t i) const { return arena_->node(arena_->link(first_ + static_cast<Index>(i))); }
+
+    private:
+        const NodeArena<T>* arena_;
+        Index first_;
+        Index count_;
+    };
+
+    ArenaNode(const ArenaNode&) = delete;
+    ArenaNode& operator=(const ArenaNode&) = delete;
+
+    // Getters
+    const T& data() const { return data_; }
+    T& data() { return data_; }
+    int left() const { return left_; }
+    int right() const { return right_; }
+    NodePtr parent() const { return parent_ == NONE ? nullptr : arena_->node(parent_); }
+    ChildRange children() const { return ChildRange(arena_, first_, count_); }
+    size_t childCount() const { return count_; }
+
+    // Setters
+    void setLeft(int left) { left_ = left; }
+    void setRight(int right) { right_ = right; }
+
+    // Tree operations. Added children come from ArenaTree::createNode of the same
+    // tree and have no parent yet. Adding to a node that has children already may
+    // move its link range, so unlike building fresh directories from several
+    // threads at once, it is for one thread at a time.
+    void addChild(NodePtr child) { arena_->link(this, &child, 1); }
+    void addChildren(const std::vector<NodePtr>& children) { arena_->link(this, children.data(), children.size()); }
+
+    // New children made from data, next to each other in the arena
+    void addChildren(std::vector<T>&& data) { arena_->emplace(this, data); }
+
+    // Drop child and free it with everything below it
+    void removeChild(NodePtr child) { arena_->remove(this, child, nullptr); }
+
+    // Put with, a node without a parent, in child's place and free child as above
+    void replaceChild(NodePtr child, NodePtr with) { arena_->remove(this, child, with); }
+
+    bool isLeaf() const { return count_ == 0; }
+    bool isRoot() const { return parent_ == NONE; }
+
+    // Nested set operations
+    bool contains(const ArenaNode& other) const {
+        return left_ <= other.left_ && right_ >= other.right_;
+    }
+
+    bool isAncestorOf(const ArenaNode& other) const {
+        return left_ < other.left_ && right_ > other.right_;
+    }
+
+    bool isDescendantOf(const ArenaNode& other) const {
+        return other.isAncestorOf(*this);
+    }
+
+private:
+    friend class NodeArena<T>;
+
+    ArenaNode(T&& data, NodeArena<T>* arena, Index index)
+        : data_(std::move(data))
+        , arena_(arena)
+        , index_(index)
+        , parent_(NONE)
+        , first_(0)
+        , count_(0)
+        , left_(0)
+        , right_(0)
+    {}
+
+    T data_;
+    NodeArena<T>* arena_;
+    Index index_;
+    Index parent_;
+    Index first_;   // Into the arena's links
+    Index count_;
+    int left_;      // Nested set left value
+    int right_;     // Nested set right value
+};
+
+// Storage shared by an ArenaTree and its copies. Nodes and child links are each
+// appended to a BlockArray, so a fresh directory's children sit together.
+// Removed nodes are destroyed at once and their slots reused; link ranges left
+// behind by removals and moves are compacted once they outgrow the live ones.
+template<typename T>
+class NodeArena {
+public:
+    using Node = ArenaNode<T>;
+    using Index = typename Node::Index;
+
+    NodeArena() = default;
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    ~NodeArena() {
+        for (Index i = 0; i < end_; ++i) {
+            if (live_[i]) {
+                node(i)->~Node();
+            }
+        }
+    }
+
+    Node* node(Index i) const { return nodes_.at(i); }
+    Index link(Index i) const { return *links_.at(i); }
+
+    Node* create(T&& data) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Index i;
+        if (!free_.empty()) {
+            i = free_.back();
+            free_.pop_back();
+        } else {
+            i = reserve(1);
+        }
+        live_[i] = true;
+        return new (nodes_.at(i)) Node(std::move(data), this, i);
+    }
+
+    void link(Node* parent, Node* const* children, std::size_t count) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Index at = extend(parent, count);
+        for (std::size_t i = 0; i < count; ++i) {
+            *links_.at(at + static_cast<Index>(i)) = children[i]->index_;
+            children[i]->parent_ = parent->index_;
+        }
+        parent->count_ += static_cast<Index>(count);
+    }
+
+    void emplace(Node* parent, std::vector<T>& data) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Index first = reserve(data.size());
+        Index at = extend(parent, data.size());
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            Index index = first + static_cast<Index>(i);
+            live_[index] = true;
+            auto child = new (nodes_.at(index)) Node(std::move(data[i]), this, index);
+            child->parent_ = parent->index_;
+            *links_.at(at + static_cast<Index>(i)) = index;
+        }
+        parent->count_ += static_cast<Index>(data.size());
+        data.clear();
+    }
+
+    // Take child out of parent's range, or put with in its place, then free child
+    void remove(Node* parent, Node* child, Node* with) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Index end = parent->first_ + parent->count_;
+        Index at = parent->first_;
+        while (at < end && link(at) != child->index_) {
+            ++at;
+        }
+        if (at == end) {
+            throw std::invalid_argument("Not a child of this node");
+        }
+        if (with) {
+            *links_.at(at) = with->index_;
+            with->parent_ = parent->index_;
+        } else {
+            for (; at + 1 < end; ++at) {
+                *links_.at(at) = link(at + 1);
+            }
+            --parent->count_;
+            release(end - 1, 1);
+        }
+        destroy(child);
+    }
+
+    // A node that isn't in any range, and everything below it
+    void destroyDetached(Node* node) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        destroy(node);
+    }
+
+    std::size_t memoryUsage() const {
+        return nodes_.memoryUsage() + links_.memoryUsage() + live_.capacity() / 8 + free_.capacity() * sizeof(Index);
+    }
+
+private:
+    // The rest run under mutex_
+
+    Index reserve(std::size_t count) {
+        nodes_.grow(std::size_t(end_) + count);
+        Index first = end_;
+        end_ += static_cast<Index>(count);
+        live_.resize(end_);
+        return first;
+    }
+
+    // Room for count links after parent's, which stay together: a range that
+    // isn't last is moved to the end first. Returns where the new links go.
+    Index extend(Node* parent, std::size_t count) {
+        auto last = [&]() { return parent->count_ != 0 && parent->first_ + parent->count_ == linkEnd_; };
+        if (!last() && parent->count_ != 0 && garbage_ + parent->count_ > BlockArray<Index>::BLOCK_SIZE
+                && garbage_ + parent->count_ > linkEnd_ - garbage_) {
+            compact();
+        }
+        if (!last()) {
+            links_.grow(std::size_t(linkEnd_) + parent->count_ + count);
+            for (Index i = 0; i < parent->count_; ++i) {
+                *links_.at(linkEnd_ + i) = link(parent->first_ + i);
+            }
+            release(parent->first_, parent->count_);
+            parent->first_ = linkEnd_;
+            linkEnd_ += parent->count_;
+        }
+        links_.grow(std::size_t(linkEnd_) + count);
+        Index at = linkEnd_;
+        linkEnd_ += static_cast<Index>(count);
+        return at;
+    }
+
+    void release(Index first, Index count) {
+        if (count == 0) return;
+        if (first + count == linkEnd_) {
+            linkEnd_ = first;
+        } else {
+            garbage_ += count;
+        }
+    }
+
+    void destroy(Node* node) {
+        for (Index i = 0; i < node->count_; ++i) {
+            destroy(this->node(link(node->first_ + i)));
+        }
+        release(node->first_, node->count_);
+        Index index = node->index_;
+        node->~Node();
+        live_[index] = false;
+        free_.push_back(index);
+    }
+
+    // Copy every live range to new links, in node order
+    void compact() {
+        BlockArray<Index> links;
+        links.grow(linkEnd_ - garbage_);
+        Index end = 0;
+        for (Index i = 0; i < end_; ++i) {
+            if (!live_[i]) continue;
+            Node* n = node(i);
+            for (Index c = 0; c < n->count_; ++c) {
+                *links.at(end + c) = link(n->first_ + c);
+            }
+            n->first_ = end;
+            end += n->count_;
+        }
+        links_ = std::move(links);
+        linkEnd_ = end;
+        garbage_ = 0;
+    }
+
+    std::mutex mutex_;
+    BlockArray<Node> nodes_;
+    BlockArray<Index> links_;
+    Index end_ = 0;         // Node slots handed out, live or freed
+    Index linkEnd_ = 0;
+    Index garbage_ = 0;     // Links below linkEnd_ no range uses
+    std::vector<bool> live_;
+    std::vector<Index> free_;
+};
+
+// NestedTree's traversals and queries over nodes kept in an arena instead of a
+// heap allocation each. Copies share the arena, as NestedTree copies share nodes.
+template<typename T>
+class ArenaTree {
+public:
+    using Node = ArenaNode<T>;
+    using NodePtr = typename Node::NodePtr;
+    using Visitor = std::function<void(const NodePtr&)>;
+
+    ArenaTree() : arena_(std::make_shared<NodeArena<T>>()), root_(nullptr) {}
+
+    // A node without a parent, for setRoot or a node's addChild
+    NodePtr createNode(T data) { return arena_->create(std::move(data)); }
+
+    // Free a node from createNode that didn't go into the tree, with its children
+    void destroyNode(NodePtr node) { arena_->destroyDetached(node); }
+
+    // Tree operations
+    void setRoot(NodePtr root) {
+        root_ = root;
+        updateNestedSets();
+    }
+
+    const NodePtr& root() const { return root_; }
+
+    // Bytes held by the arena, not counting anything T allocates itself
+    std::size_t memoryUsage() const { return arena_->memoryUsage(); }
+
+    // Tree traversal
+    void breadthFirstTraverse(Visitor visitor) const {
+        if (!root_) return;
+        breadthFirstTraverseImpl(root_, visitor);
+    }
+
+    void depthFirstTraverse(Visitor visitor) const {
+        if (!root_) return;
+        depthFirstTraverseImpl(root_, visitor);
+    }
+
+    void levelOrderTraverse(Visitor visitor) const {
+        if (!root_) return;
+        std::queue<NodePtr> queue;
+        queue.push(root_);
+
+        while (!queue.empty()) {
+            NodePtr current = queue.front();
+            queue.pop();
+
+            visitor(current);
+
+            for (auto child : current->children()) {
+                queue.push(child);
+            }
+        }
+    }
+
+    // Nested set operations
+    void updateNestedSets() {
+        if (!root_) return;
+        int counter = 1;
+        updateNestedSetsImpl(root_, counter);
+    }
+
+    // Tree queries
+    NodePtr findNode(const std::function<bool(const NodePtr&)>& predicate) const {
+        NodePtr result = nullptr;
+        breadthFirstTraverse([&](const NodePtr& node) {
+            if (!result && predicate(node)) {
+                result = node;
+            }
+        });
+        return result;
+    }
+
+    std::vector<NodePtr> findAllNodes(const std::function<bool(const NodePtr&)>& predicate) const {
+        std::vector<NodePtr> results;
+        breadthFirstTraverse([&](const NodePtr& node) {
+            if (predicate(node)) {
+                results.push_back(node);
+            }
+        });
+        return results;
+    }
+
+    // Tree transformations
+    template<typename U>
+    ArenaTree<U> transform(const std::function<U(const T&)>& transformer) const {
+        ArenaTree<U> result;
+        if (!root_) return result;
+
+        auto newRoot = result.createNode(transformer(root_->data()));
+        transformImpl<U>(root_, newRoot, transformer);
+        result.setRoot(newRoot);
+        return result;
+    }
+
+private:
+    void breadthFirstTraverseImpl(NodePtr node, Visitor& visitor) const {
+        if (!node->parent()) {
+            visitor(node);
+        }
+        auto children = node->children();
+        for (auto child : children) {
+            visitor(child);
+        }
+        for (auto child : children) {
+            breadthFirstTraverseImpl(child, visitor);
+        }
+    }
+
+    void depthFirstTraverseImpl(NodePtr node, Visitor& visitor) const {
+        for (auto child : node->children()) {
+            depthFirstTraverseImpl(child, visitor);
+        }
+        visitor(node);
+    }
+
+    void updateNestedSetsImpl(NodePtr node, int& counter) {
+        node->setLeft(counter++);
+        for (auto child : node->children()) {
+            updateNestedSetsImpl(child, counter);
+        }
+        node->setRight(counter++);
+    }
+
+    template<typename U>
+    static void transformImpl(NodePtr source, typename ArenaTree<U>::NodePtr target,
+                              const std::function<U(const T&)>& transformer) {
+        std::vector<U> data;
+        data.reserve(source->childCount());
+        for (auto child : source->children()) {
+            data.push_back(transformer(child->data()));
+        }
+        target->addChildren(std::move(data));
+        for (size_t i = 0; i < source->childCount(); ++i) {
+            transformImpl<U>(source->children()[i], target->children()[i], transformer);
+        }
+    }
+
+    std::shared_ptr<NodeArena<T>> arena_;
+    NodePtr root_;
+};
+
+} // namespace dedupe
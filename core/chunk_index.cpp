@@ -0,0 +1,153 @@
+#include "chunk_index.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <sstream>
+#include <unordered_set>
+
+namespace dedupe {
+
+bool ChunkIndex::build(const std::vector<std::filesystem::path>& files, Progress& progress) {
+    std::size_t first;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        first = paths_.size();
+        paths_.insert(paths_.end(), files.begin(), files.end());
+        fileBytes_.resize(paths_.size(), 0);
+        fileChunks_.resize(paths_.size(), 0);
+    }
+
+    std::atomic<bool> cancelled{ false };
+    std::atomic<std::size_t> done{ 0 };
+    Progress workerProgress(nullptr, [&]() { return cancelled.load(); });
+    ThreadPool pool(options_.threads);
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        pool.submit([&, i]() {
+            if (cancelled) return;
+            try {
+                auto chunks = Hasher::chunk_file(files[i], workerProgress, options_.params, options_.algorithm);
+                if (!cancelled) {
+                    insert(first + i, chunks);
+                }
+            }
+            catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                failed_.emplace_back(files[i], e.what());
+            }
+            ++done;
+        });
+    }
+    pool.wait([&]() {
+        if (progress.is_cancelled()) {
+            cancelled = true;
+        }
+        std::stringstream ss;
+        ss << done << "/" << files.size() << " Chunking files";
+        progress.report(ss.str(), files.empty() ? 1.0 : static_cast<double>(done) / files.size());
+    });
+    return !cancelled;
+}
+
+std::size_t ChunkIndex::add(const std::filesystem::path& path, const std::vector<Chunk>& chunks) {
+    std::size_t file;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        file = paths_.size();
+        paths_.push_back(path);
+        fileBytes_.push_back(0);
+        fileChunks_.push_back(0);
+    }
+    insert(file, chunks);
+    return file;
+}
+
+void ChunkIndex::insert(std::size_t file, const std::vector<Chunk>& chunks) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto id = static_cast<std::uint32_t>(file);
+    for (const auto& chunk : chunks) {
+        auto& entry = chunks_[chunk.digest];
+        if (entry.files.empty()) {
+            entry.size = chunk.length;
+            uniqueBytes_ += chunk.length;
+        }
+        // All of a file's chunks come in one call, so it can only be the last holder
+        if (!entry.files.empty() && entry.files.back().file == id) {
+            ++entry.files.back().count;
+        }
+        else {
+            entry.files.push_back(Holder{ id, 1 });
+        }
+        fileBytes_[file] += chunk.length;
+        totalBytes_ += chunk.length;
+    }
+    fileChunks_[file] += chunks.size();
+    chunkCount_ += chunks.size();
+}
+
+std::vector<ChunkIndex::FileReport> ChunkIndex::files() const {
+    std::vector<FileReport> reports(paths_.size());
+    for (std::size_t i = 0; i < paths_.size(); ++i) {
+        reports[i].path = paths_[i];
+        reports[i].bytes = fileBytes_[i];
+        reports[i].chunks = fileChunks_[i];
+    }
+    for (const auto& [digest, entry] : chunks_) {
+        if (entry.files.size() < 2) continue;
+        for (const auto& holder : entry.files) {
+            reports[holder.file].sharedBytes += std::uintmax_t(entry.size) * holder.count;
+        }
+    }
+    return reports;
+}
+
+std::vector<ChunkIndex::SharedPair> ChunkIndex::topPairs(std::size_t count) const {
+    std::unordered_map<std::uint64_t, std::uintmax_t> shared;
+    for (const auto& [digest, entry] : chunks_) {
+        if (entry.files.size() < 2 || entry.files.size() > options_.maxPairFiles) continue;
+        for (std::size_t a = 0; a < entry.files.size(); ++a) {
+            for (std::size_t b = a + 1; b < entry.files.size(); ++b) {
+                auto first = std::min(entry.files[a].file, entry.files[b].file);
+                auto second = std::max(entry.files[a].file, entry.files[b].file);
+                auto times = std::min(entry.files[a].count, entry.files[b].count);
+                shared[(std::uint64_t(first) << 32) | second] += std::uintmax_t(entry.size) * times;
+            }
+        }
+    }
+
+    std::vector<SharedPair> pairs;
+    pairs.reserve(shared.size());
+    for (const auto& [key, bytes] : shared) {
+        pairs.push_back(SharedPair{ static_cast<std::size_t>(key >> 32), static_cast<std::size_t>(key & 0xffffffffu), bytes });
+    }
+    auto order = [](const SharedPair& a, const SharedPair& b) {
+        if (a.sharedBytes != b.sharedBytes) return a.sharedBytes > b.sharedBytes;
+        return std::make_pair(a.first, a.second) < std::make_pair(b.first, b.second);
+    };
+    count = std::min(count, pairs.size());
+    std::partial_sort(pairs.begin(), pairs.begin() + count, pairs.end(), order);
+    pairs.resize(count);
+    return pairs;
+}
+
+std::vector<std::filesystem::path> ChunkIndex::distinctFiles(const FileSystemTree& tree, const DuplicateFinder& finder,
+                                                             std::uintmax_t minSize) {
+    std::unordered_set<const ArenaNode<FileSystemNode>*> copies;
+    for (const auto& [hash, group] : finder.hashToDuplicate()) {
+        if (group.isIdentical() && !group.isDirectory) {
+            copies.insert(group.nodes.begin() + 1, group.nodes.end());
+        }
+    }
+
+    std::vector<std::filesystem::path> files;
+    std::set<std::pair<std::uint64_t, std::uint64_t>> inodes;
+    tree.depthFirstTraverse([&](const auto& node) {
+        const auto& data = node->data();
+        if (data.isDirectory || data.size < minSize || data.size == 0 || copies.count(node)) return;
+        if (data.links > 1 && data.inode != 0 && !inodes.insert({ data.device, data.inode }).second) return;
+        files.push_back(FileSystemTree::pathOf(node));
+    });
+    return files;
+}
+
+} // namespace dedupe
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "chunker.hpp"
+#include "duplicate_finder.hpp"
+#include "hasher.hpp"
+#include "progress.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dedupe {
+
+struct ChunkOptions {
+    ChunkParams params;
+    HashAlgorithm algorithm = HashAlgorithm::Sha256;
+    unsigned threads = 0;           // Files chunked at once, 0 = hardware concurrency
+    // Chunks held by more files than this, runs of zeros and the like, still count
+    // as shared but are left out of pairs, which grow with the square of the files
+    std::size_t maxPairFiles = 64;
+};
+
+// Index of the content-defined chunks of a set of files, for finding content
+// shared between files that aren't duplicates as a whole: VM images, database
+// dumps and archives differing in a few places.
+class ChunkIndex {
+public:
+    struct FileReport {
+        std::filesystem::path path;
+        std::uintmax_t bytes = 0;
+        std::uintmax_t sharedBytes = 0;     // In chunks also found in another file
+        std::size_t chunks = 0;
+    };
+
+    struct SharedPair {
+        std::size_t first;                  // Indices into files()
+        std::size_t second;
+        std::uintmax_t sharedBytes;         // Chunks both hold, counted as often as the one holding fewer
+    };
+
+    explicit ChunkIndex(ChunkOptions options = ChunkOptions()) : options_(std::move(options)) {}
+
+    // Chunk the files on a thread pool and add them. Files that can't be read are
+    // listed in failed(). Returns false if cancelled.
+    bool build(const std::vector<std::filesystem::path>& files, Progress& progress);
+
+    // Add one file's chunks, as returned by Hasher::chunk_file. Returns its index.
+    std::size_t add(const std::filesystem::path& path, const std::vector<Chunk>& chunks);
+
+    // Every file added, with the bytes it shares
+    std::vector<FileReport> files() const;
+    // The count pairs of files sharing the most bytes, most first
+    std::vector<SharedPair> topPairs(std::size_t count) const;
+
+    std::uintmax_t totalBytes() const { return totalBytes_; }
+    // Bytes left if every distinct chunk were stored once
+    std::uintmax_t uniqueBytes() const { return uniqueBytes_; }
+    std::size_t chunkCount() const { return chunkCount_; }
+    std::size_t distinctChunks() const { return chunks_.size(); }
+    const std::vector<std::pair<std::filesystem::path, std::string>>& failed() const { return failed_; }
+
+    // Files of at least minSize below the tree, one path per distinct content:
+    // of each group of identical files only the first is taken, and of hard
+    // links only one path, since their sharing is already known.
+    static std::vector<std::filesystem::path> distinctFiles(const FileSystemTree& tree, const DuplicateFinder& finder,
+                                                            std::uintmax_t minSize);
+
+private:
+    struct Holder {
+        std::uint32_t file;
+        std::uint32_t count;                // Times the chunk occurs in the file
+    };
+
+    struct Entry {
+        std::uint32_t size = 0;
+        std::vector<Holder> files;          // In the order files were added, each once
+    };
+
+    // Adds under mutex_, file is already in paths_
+    void insert(std::size_t file, const std::vector<Chunk>& chunks);
+
+    ChunkOptions options_;
+    std::vector<std::filesystem::path> paths_;
+    std::vector<std::uintmax_t> fileBytes_;
+    std::vector<std::size_t> fileChunks_;
+    std::unordered_map<Digest, Entry> chunks_;
+    std::uintmax_t totalBytes_ = 0;
+    std::uintmax_t uniqueBytes_ = 0;
+    std::size_t chunkCount_ = 0;
+    std::vector<std::pair<std::filesystem::path, std::string>> failed_;
+    std::mutex mutex_;
+};
+
+} // namespace dedupe
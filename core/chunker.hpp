@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace dedupe {
+
+// Chunk sizes for content-defined chunking. The average must be a power of two;
+// cut points are only looked for between minSize and maxSize.
+struct ChunkParams {
+    std::size_t minSize = 16 * 1024;
+    std::size_t averageSize = 64 * 1024;
+    std::size_t maxSize = 256 * 1024;
+
+    // The usual spread, a quarter to four times the average
+    static ChunkParams around(std::size_t averageSize) {
+        return ChunkParams{ averageSize / 4, averageSize, averageSize * 4 };
+    }
+};
+
+// FastCDC content-defined chunking. A gear hash rolls over the bytes, one shift,
+// one add and one table load per byte, and a cut is made where its top bits are
+// all zero. Cut points depend only on the last 64 bytes, so an insertion or
+// deletion moves the boundaries next to it and the chunks after it come out the
+// same as before. Bytes before minSize are skipped without hashing, and
+// normalized chunking uses a harder mask before averageSize and an easier one
+// after it, which keeps chunk sizes close to the average.
+class Chunker {
+public:
+    explicit Chunker(const ChunkParams& params = ChunkParams()) : params_(params) {
+        unsigned bits = 0;
+        while ((std::size_t(1) << bits) < params.averageSize) {
+            ++bits;
+        }
+        if (params.averageSize < 256 || (std::size_t(1) << bits) != params.averageSize
+            || params.minSize > params.averageSize || params.maxSize < params.averageSize) {
+            throw std::invalid_argument("Chunk sizes need min <= average <= max, average a power of two of at least 256");
+        }
+        maskSmall_ = topBits(bits + 2);
+        maskLarge_ = topBits(bits - 2);
+    }
+
+    const ChunkParams& params() const { return params_; }
+
+    // Length of the chunk starting at data: up to and including the first cut
+    // point, at most maxSize, or length if the data ends first. Pass at least
+    // maxSize bytes unless the stream ends sooner, or the last chunk is cut short.
+    std::size_t cut(const std::uint8_t* data, std::size_t length) const {
+        if (length <= params_.minSize) {
+            return length;
+        }
+        std::size_t end = length < params_.maxSize ? length : params_.maxSize;
+        std::size_t normal = end < params_.averageSize ? end : params_.averageSize;
+        std::uint64_t hash = 0;
+        std::size_t i = params_.minSize;
+        if (roll(data, i, normal, maskSmall_, hash) || roll(data, i, end, maskLarge_, hash)) {
+            return i;
+        }
+        return end;
+    }
+
+    // Random values for each byte, fixed so cut points match between runs and
+    // hosts. The second half holds the same values shifted left by one.
+    static const std::array<std::uint64_t, 512>& table() {
+        static const std::array<std::uint64_t, 512> gear = []() {
+            std::array<std::uint64_t, 512> values{};
+            std::uint64_t state = 0x6765617268617368ULL;
+            for (std::size_t i = 0; i < 256; ++i) {
+                // splitmix64
+                std::uint64_t x = (state += 0x9e3779b97f4a7c15ULL);
+                x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+                values[i] = x ^ (x >> 31);
+                values[256 + i] = values[i] << 1;
+            }
+            return values;
+        }();
+        return gear;
+    }
+
+private:
+    // Roll the hash from data[i] up to end, stopping after the first byte where
+    // none of the mask bits are set. Returns true with i past that byte, or false
+    // with i at end. Bytes go two at a time, FastCDC's rolling two bytes: the hash
+    // is shifted once per pair and both bytes' values are summed off to the side,
+    // so the chain from one pair to the next is a shift and an add. The first
+    // byte's hash is then only seen shifted, and is tested with the mask shifted too.
+    static bool roll(const std::uint8_t* data, std::size_t& i, std::size_t end, std::uint64_t mask, std::uint64_t& hash) {
+        const auto* gear = table().data();
+        const auto* shifted = gear + 256;
+        for (; i + 2 <= end; i += 2) {
+            std::uint64_t first = shifted[data[i]];
+            std::uint64_t base = hash << 2;
+            if (((base + first) & (mask << 1)) == 0) {
+                i += 1;
+                return true;
+            }
+            hash = base + (first + gear[data[i + 1]]);
+            if ((hash & mask) == 0) {
+                i += 2;
+                return true;
+            }
+        }
+        if (i < end) {
+            hash = (hash << 1) + gear[data[i]];
+            if ((hash & mask) == 0) {
+                i += 1;
+                return true;
+            }
+            i += 1;
+        }
+        return false;
+    }
+
+    // High bits of the hash, which all of the last 63 bytes reach. The top bit is
+    // left out so a mask shifted by one still tests the same bits, see roll.
+    static std::uint64_t topBits(unsigned count) {
+        return (~std::uint64_t(0) << (64 - count)) >> 1;
+    }
+
+    ChunkParams params_;
+    std::uint64_t maskSmall_;
+    std::uint64_t maskLarge_;
+};
+
+} // namespace dedupe
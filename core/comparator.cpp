@@ -0,0 +1,125 @@
+#include "comparator.hpp"
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+
+namespace dedupe {
+
+namespace {
+
+struct AlignedDelete {
+    std::size_t align;
+    void operator()(char* p) const { ::operator delete[](p, std::align_val_t(align)); }
+};
+
+using AlignedBuffer = std::unique_ptr<char[], AlignedDelete>;
+
+AlignedBuffer make_buffer(std::size_t size, std::size_t align) {
+    return AlignedBuffer(static_cast<char*>(::operator new[](size, std::align_val_t(align))),
+                         AlignedDelete{ align });
+}
+
+struct Candidate {
+    std::size_t index;
+    std::ifstream file;
+    AlignedBuffer buffer;
+    std::streamsize filled = 0;
+};
+
+} // namespace
+
+Comparator::Result Comparator::compare(const std::vector<std::filesystem::path>& files, Progress& progress) {
+    Result result;
+
+    std::vector<Candidate> candidates;
+    candidates.reserve(files.size());
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        std::ifstream file(files[i], std::ios::binary);
+        if (!file) {
+            result.failed.emplace_back(i, "Cannot open file: " + files[i].string());
+            continue;
+        }
+        candidates.push_back(Candidate{ i, std::move(file), make_buffer(BUFFER_SIZE, BUFFER_ALIGN) });
+    }
+
+    // Sets still being compared, as positions in candidates
+    std::vector<std::vector<std::size_t>> open;
+    if (!candidates.empty()) {
+        open.emplace_back();
+        for (std::size_t c = 0; c < candidates.size(); ++c) {
+            open.back().push_back(c);
+        }
+    }
+
+    auto finish = [&](const std::vector<std::size_t>& set) {
+        result.sets.emplace_back();
+        for (auto c : set) {
+            result.sets.back().push_back(candidates[c].index);
+        }
+    };
+
+    while (!open.empty()) {
+        if (progress.is_cancelled()) {
+            result.sets.clear();
+            return result;
+        }
+
+        std::vector<std::vector<std::size_t>> next;
+        for (auto& set : open) {
+            if (set.size() < 2) {
+                finish(set);
+                continue;
+            }
+
+            // Read the next block of every member, dropping any that fail
+            std::vector<std::size_t> readable;
+            for (auto c : set) {
+                auto& cand = candidates[c];
+                cand.file.read(cand.buffer.get(), BUFFER_SIZE);
+                cand.filled = cand.file.gcount();
+                result.bytesRead += static_cast<std::uintmax_t>(cand.filled);
+                if (cand.file.bad()) {
+                    result.failed.emplace_back(cand.index, "Read failed: " + files[cand.index].string());
+                    continue;
+                }
+                readable.push_back(c);
+            }
+
+            // Split by block content, comparing against the first member of each split
+            std::vector<std::vector<std::size_t>> splits;
+            for (auto c : readable) {
+                const auto& cand = candidates[c];
+                bool placed = false;
+                for (auto& split : splits) {
+                    const auto& rep = candidates[split.front()];
+                    if (rep.filled == cand.filled &&
+                        std::memcmp(rep.buffer.get(), cand.buffer.get(), static_cast<std::size_t>(cand.filled)) == 0) {
+                        split.push_back(c);
+                        placed = true;
+                        break;
+                    }
+                }
+                if (!placed) {
+                    splits.push_back({ c });
+                }
+            }
+
+            for (auto& split : splits) {
+                // A short block means end of file, members that got here match throughout
+                bool atEnd = candidates[split.front()].filled < static_cast<std::streamsize>(BUFFER_SIZE);
+                if (split.size() < 2 || atEnd) {
+                    finish(split);
+                }
+                else {
+                    next.push_back(std::move(split));
+                }
+            }
+        }
+        open = std::move(next);
+    }
+
+    return result;
+}
+
+} // namespace dedupe
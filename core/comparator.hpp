@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "progress.hpp"
+
+namespace dedupe {
+
+class Comparator {
+public:
+    struct Result {
+        std::vector<std::vector<std::size_t>> sets;    // Indices into files with identical content
+        std::vector<std::pair<std::size_t, std::string>> failed;   // Files that couldn't be read, with why
+        std::uintmax_t bytesRead = 0;
+    };
+
+    // Read same-sized files in lockstep and split them into sets of identical
+    // content, stopping on each file as soon as it is alone in its set. Every
+    // readable file ends up in exactly one set, unique files in sets of one.
+    // Returns no sets if cancelled.
+    static Result compare(const std::vector<std::filesystem::path>& files, Progress& progress);
+
+private:
+    static constexpr std::size_t BUFFER_SIZE = 1024 * 1024;   // Per file, per read
+    static constexpr std::size_t BUFFER_ALIGN = 4096;         // Page aligned buffers
+};
+
+} // namespace dedupe
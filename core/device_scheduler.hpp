@@ -0,0 +1,141 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <sys/sysmacros.h>
+#endif
+
+namespace dedupe {
+
+enum class DeviceKind {
+    Unknown,        // Not a block device we can see, e.g. network or tmpfs
+    Rotational,
+    SolidState
+};
+
+// Caps how many tasks run at once per device on top of a shared ThreadPool, so
+// spinning disks get a couple of mostly sequential readers while SSDs and NVMe
+// get many. Tasks over a device's limit wait in its queue and are handed to the
+// pool as that device's running tasks finish, so no pool thread ever blocks.
+class DeviceScheduler {
+public:
+    using Task = ThreadPool::Task;
+
+    // Limit for devices of each kind, 0 for no limit beyond the pool size
+    struct Limits {
+        unsigned rotational = 2;
+        unsigned solidState = 16;
+        unsigned unknown = 0;
+    };
+
+    DeviceScheduler(ThreadPool& pool, const Limits& limits)
+        : pool_(pool), limits_(limits) {}
+
+    DeviceScheduler(const DeviceScheduler&) = delete;
+    DeviceScheduler& operator=(const DeviceScheduler&) = delete;
+
+    // Queue a task reading from device, a st_dev value. Wait on the pool as usual.
+    void submit(std::uint64_t device, Task task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& d = state(device);
+            if (d.limit != 0 && d.running >= d.limit) {
+                d.waiting.push_back(std::move(task));
+                return;
+            }
+            ++d.running;
+        }
+        start(device, std::move(task));
+    }
+
+    // Concurrency the scheduler allows for device
+    unsigned limit(std::uint64_t device) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto l = state(device).limit;
+        return l == 0 ? pool_.size() : l;
+    }
+
+    // Looks the device up in sysfs. Partitions have no queue of their own so fall
+    // back to their parent disk's.
+    static DeviceKind detectKind(std::uint64_t device) {
+#if defined(__linux__)
+        if (device == 0) return DeviceKind::Unknown;
+        std::string base = "/sys/dev/block/" + std::to_string(major(device)) + ":" + std::to_string(minor(device));
+        for (const char* queue : { "/queue/rotational", "/../queue/rotational" }) {
+            std::ifstream file(base + queue);
+            int rotational;
+            if (file >> rotational) {
+                return rotational ? DeviceKind::Rotational : DeviceKind::SolidState;
+            }
+        }
+#else
+        (void)device;
+#endif
+        return DeviceKind::Unknown;
+    }
+
+private:
+    struct Device {
+        unsigned limit = 0;
+        unsigned running = 0;
+        std::deque<Task> waiting;
+    };
+
+    // Caller holds mutex_
+    Device& state(std::uint64_t device) {
+        auto it = devices_.find(device);
+        if (it == devices_.end()) {
+            Device d;
+            switch (detectKind(device)) {
+                case DeviceKind::Rotational: d.limit = limits_.rotational; break;
+                case DeviceKind::SolidState: d.limit = limits_.solidState; break;
+                case DeviceKind::Unknown: d.limit = limits_.unknown; break;
+            }
+            it = devices_.emplace(device, std::move(d)).first;
+        }
+        return it->second;
+    }
+
+    // Run task on the pool, then start the device's next waiting task. The follow
+    // up is submitted before this task counts as done, so wait() can't slip past it.
+    void start(std::uint64_t device, Task task) {
+        pool_.submit([this, device, task = std::move(task)]() {
+            struct Next {
+                DeviceScheduler* self;
+                std::uint64_t device;
+                ~Next() { self->finished(device); }
+            } next{ this, device };
+            task();
+        });
+    }
+
+    void finished(std::uint64_t device) {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& d = devices_[device];
+            if (d.waiting.empty()) {
+                --d.running;
+                return;
+            }
+            task = std::move(d.waiting.front());
+            d.waiting.pop_front();
+        }
+        start(device, std::move(task));
+    }
+
+    ThreadPool& pool_;
+    Limits limits_;
+    std::mutex mutex_;
+    std::unordered_map<std::uint64_t, Device> devices_;
+};
+
+} // namespace dedupe
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+
+namespace dedupe {
+
+// Binary digest stored inline. Shorter algorithms fill the leading bytes and
+// leave the rest zero; all zero means "no digest yet".
+struct Digest {
+    static constexpr std::size_t SIZE = 32;
+
+    std::array<std::uint8_t, SIZE> bytes{};
+
+    bool empty() const {
+        for (auto b : bytes) {
+            if (b != 0) return false;
+        }
+        return true;
+    }
+
+    void clear() { bytes.fill(0); }
+
+    // Hex of the first length bytes, callers pass the algorithm's digest size
+    std::string toHex(std::size_t length = SIZE) const {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(length * 2);
+        for (std::size_t i = 0; i < length && i < SIZE; ++i) {
+            hex += digits[bytes[i] >> 4];
+            hex += digits[bytes[i] & 0x0f];
+        }
+        return hex;
+    }
+
+    static Digest fromBytes(const void* data, std::size_t length) {
+        Digest d;
+        std::memcpy(d.bytes.data(), data, length < SIZE ? length : SIZE);
+        return d;
+    }
+
+    bool operator==(const Digest& other) const { return bytes == other.bytes; }
+    bool operator!=(const Digest& other) const { return bytes != other.bytes; }
+    bool operator<(const Digest& other) const { return bytes < other.bytes; }
+};
+
+} // namespace dedupe
+
+namespace std {
+
+// Digests are already uniformly distributed, fold the leading words together
+template<>
+struct hash<dedupe::Digest> {
+    size_t operator()(const dedupe::Digest& d) const noexcept {
+        std::uint64_t a, b;
+        std::memcpy(&a, d.bytes.data(), sizeof(a));
+        std::memcpy(&b, d.bytes.data() + sizeof(a), sizeof(b));
+        return static_cast<size_t>(a ^ (b * 0x9e3779b97f4a7c15ULL));
+    }
+};
+
+} // namespace std
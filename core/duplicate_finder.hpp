@@ -2,60 +2,215 @@
 
 #include "filesystem_tree.hpp"
 #include "hasher.hpp"
+#include "comparator.hpp"
 #include "progress.hpp"
+#include "thread_pool.hpp"
+#include "device_scheduler.hpp"
+#include "layout.hpp"
+#include "hash_cache.hpp"
+#include "similarity.hpp"
+#include "bloom_filter.hpp"
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <map>
+#include <atomic>
+#include <cstring>
+#include <mutex>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <filesystem>
+#include <functional>
 #include <iostream>
 #include <sstream>
 
 namespace dedupe {
-    // RJL TODO
-    using Hash = std::string;
+    using Hash = Digest;
     using Path = std::filesystem::path;
 
 struct DuplicateSignature {
     uintmax_t size;
     Hash hash;
+    HashAlgorithm algorithm;        // Produced hash
+    bool confirmed;                 // Members also compared equal under SHA-256, or byte by byte
+    bool compared;                  // Members compared byte by byte, hash is only a key for this run
     
-    DuplicateSignature(uintmax_t s = 0, const Hash & h = "")
-        : size(s), hash(h) {}
+    DuplicateSignature(uintmax_t s = 0, const Hash & h = Hash(), HashAlgorithm a = HashAlgorithm::Sha256)
+        : size(s), hash(h), algorithm(a), confirmed(false), compared(false) {}
 };
 
+// Members are nodes of the tree that was searched, valid as long as it is
 struct DuplicateFiles {
-    std::vector<std::filesystem::path> paths;
+    std::vector<const ArenaNode<FileSystemNode>*> nodes;
     DuplicateSignature signature;
+    bool isDirectory;
+    // Separate copies of the data among nodes: hard links to one inode are one
+    // copy, as are reflinked files with FinderOptions::reflinks
+    size_t copies = 0;
 
-    bool isIdentical() { return paths.size() > 1; }
+    // More than one copy; hard links alone waste nothing, see DuplicateFinder::hardLinks
+    bool isIdentical() const { return copies > 1; }
 
-    DuplicateFiles(uintmax_t s = 0, const std::string& h = "") : signature(s, h) {}
+    // Bytes freed by keeping one copy, 0 for directories
+    std::uintmax_t reclaimableBytes() const {
+        return isDirectory || copies < 2 ? 0 : (copies - 1) * signature.size;
+    }
+
+    std::vector<std::filesystem::path> paths() const {
+        std::vector<std::filesystem::path> result;
+        result.reserve(nodes.size());
+        for (auto node : nodes) {
+            result.push_back(FileSystemTree::pathOf(node));
+        }
+        return result;
+    }
+
+    DuplicateFiles(uintmax_t s = 0, const Hash& h = Hash(), bool isDir = false,
+                   HashAlgorithm a = HashAlgorithm::Sha256)
+        : signature(s, h, a), isDirectory(isDir) {}
 };
 
 using HashToDuplicate = std::unordered_map<Hash, DuplicateFiles>;               // Owns DuplicateFiles
 
+// Two directories holding mostly the same files, see FinderOptions::similarity
+struct SimilarDirectories {
+    const ArenaNode<FileSystemNode>* first;
+    const ArenaNode<FileSystemNode>* second;
+    double similarity;              // Jaccard similarity of the sets of file digests below each
+    std::size_t sharedFiles;        // Distinct contents found below both
+    std::uintmax_t sharedBytes;     // Their sizes, each counted once
+};
+
+// Partition refinement stages, cheapest first. Each stage only sees files still
+// sharing a partition with another file after the stages before it.
+enum class HashStage {
+    Head = 0,       // First block
+    Tail,           // Last block
+    Middle,         // Blocks sampled evenly between head and tail
+    Full            // Whole content, always run last
+};
+
+const char* stage_name(HashStage stage);
+bool parse_stage(const std::string& name, HashStage& stage);
+
+struct StageStats {
+    std::uintmax_t files = 0;       // Files read by the stage
+    std::uintmax_t bytes = 0;       // Bytes read by the stage
+    std::uintmax_t prefiltered = 0; // Files the prefilter found without a partner, kept out of grouping
+};
+
+struct FinderOptions {
+    unsigned threads = 0;           // Hashing workers, 0 = hardware concurrency
+    ReadMode readMode = ReadMode::Stream;
+    HashAlgorithm algorithm = HashAlgorithm::Xxh3_128;
+    bool confirm = false;           // Re-check colliding groups with SHA-256
+    std::vector<HashStage> stages = { HashStage::Head, HashStage::Tail, HashStage::Middle, HashStage::Full };
+    std::uintmax_t headSize = 8192;
+    std::uintmax_t tailSize = 8192;
+    std::uintmax_t sampleSize = 8192;
+    unsigned middleSamples = 4;
+    // Partitions reaching the full stage with at most this many files, each at least
+    // compareMinSize bytes, are compared in lockstep instead of hashed. 0 disables.
+    unsigned compareMaxFiles = 3;
+    std::uintmax_t compareMinSize = 1024 * 1024;
+    // Reads kept in flight per hashing thread by the full stage with ReadMode::Uring
+    unsigned queueDepth = 32;
+    // Concurrent reads per device, by kind of storage (see DeviceScheduler).
+    // Off, every device shares the pool freely.
+    bool deviceLimits = true;
+    unsigned rotationalThreads = 2;
+    unsigned solidStateThreads = 16;
+    // Issue reads in on-disk order: by physical extent on spinning disks, by inode elsewhere
+    bool layoutOrder = true;
+    // Check the extents of files in duplicate groups with FIEMAP, so copies sharing
+    // all their data (cp --reflink, filesystem dedupe) count as one, see shared_extents_key
+    bool reflinks = false;
+    // Report pairs of directories whose file contents overlap at least this much
+    // (Jaccard similarity, 0 to 1), see similarDirectories. 0 disables.
+    double similarity = 0;
+    // Stages hashing at least this many files first pass (size, digest) through a
+    // PartnerFilter, so only files that may have a partner enter the grouping
+    // maps. Results are the same either way. 0 disables.
+    std::size_t prefilterMinFiles = 100000;
+};
+
 
 class DuplicateFinder {
+    using Node = ArenaNode<FileSystemNode>;
+    using Group = std::vector<Node *>;
+
     HashToDuplicate _hashToDuplicate;
     const FileSystemTree& _tree;
+    FinderOptions _options;
+    std::array<StageStats, static_cast<size_t>(HashStage::Full) + 1> _stageStats;
+    StageStats _compareStats;
+    std::uintmax_t _reusedFiles = 0;
+    HashCache* _cache = nullptr;
+    std::vector<SimilarDirectories> _similar;
+    std::vector<std::vector<const Node *>> _hardLinks;
+    std::uintmax_t _linkedFiles = 0;
 
 public:
     using DuplicateMap = std::unordered_map<std::filesystem::path, DuplicateSignature>;
 
-    DuplicateFinder(const FileSystemTree& t) : _tree(t) { }
+    DuplicateFinder(const FileSystemTree& t, const FinderOptions& options = FinderOptions())
+        : _tree(t), _options(options) { }
+
+    const HashToDuplicate& hashToDuplicate() const { return _hashToDuplicate; }
+
+    // Work done by each refinement stage in the last findDuplicates, indexed by HashStage
+    const StageStats& stageStats(HashStage stage) const { return _stageStats[static_cast<size_t>(stage)]; }
+    // Files compared in lockstep in place of the full stage, and the bytes that actually took
+    const StageStats& compareStats() const { return _compareStats; }
 
-    HashToDuplicate hashToDuplicate() { return _hashToDuplicate; }
+    // Directories at least options.similarity alike but not identical, most bytes
+    // shared first. Empty unless the option is set.
+    const std::vector<SimilarDirectories>& similarDirectories() const { return _similar; }
+
+    // Paths in the tree hard linked to one inode, one set per inode. Only the first
+    // of each set is read, the others take its digest.
+    const std::vector<std::vector<const Node *>>& hardLinks() const { return _hardLinks; }
+    // Paths not read because another link to their inode was
+    std::uintmax_t linkedFiles() const { return _linkedFiles; }
+
+    // Files whose hash came from the previous scan of an incremental tree
+    std::uintmax_t reusedFiles() const { return _reusedFiles; }
+
+    // Everything in the options that changes the hashes findDuplicates produces.
+    // Hashes from a scan with a different fingerprint can't be reused.
+    static std::uint64_t fingerprint(const FinderOptions& options) {
+        std::vector<std::uint64_t> values = {
+            HASH_SCHEME, static_cast<std::uint64_t>(options.algorithm), options.confirm,
+            options.headSize, options.tailSize, options.sampleSize, options.middleSamples,
+            options.compareMaxFiles, options.compareMinSize
+        };
+        for (auto stage : options.stages) {
+            values.push_back(0x100 + static_cast<std::uint64_t>(stage));
+        }
+        auto context = HashContext::create(HashAlgorithm::Xxh3_128);
+        context->update(values.data(), values.size() * sizeof(std::uint64_t));
+        std::uint64_t result;
+        std::memcpy(&result, context->final().bytes.data(), sizeof(result));
+        return result;
+    }
+
+    // Changed whenever the hashes left on files mean something else, so older
+    // snapshots are rehashed. 2: files settled by a partial stage take a partition key.
+    static constexpr std::uint64_t HASH_SCHEME = 2;
+
+    // Consult cache before reading any file and record new digests in it. The
+    // caller owns the cache and saves it; nullptr stops caching.
+    void setCache(HashCache* cache) { _cache = cache; }
 
     bool findDuplicates(
         Progress& progress
     ) {
-        size_t totalFiles = _tree.directoryCount + _tree.fileCount;
-        
         progress.report("Collecting file information...", 0.0);
 
-        std::unordered_map<uintmax_t, std::vector<NestedNode<FileSystemNode> *>> sizeGroups;
+        std::unordered_map<uintmax_t, Group> sizeGroups;
+        std::map<std::pair<std::uint64_t, std::uint64_t>, Group> inodes;
         _tree.depthFirstTraverse([&](const auto& node) {
             const auto& data = node->data();
             if (progress.is_cancelled()) {
@@ -63,74 +218,93 @@ public:
                 return;
             }
             if (!data.isDirectory) {
-                if (sizeGroups.find(data.size) == sizeGroups.end())
-                    sizeGroups[data.size] = std::vector<NestedNode<FileSystemNode> *>();
-                sizeGroups[data.size].push_back(node.get());
+                sizeGroups[data.size].push_back(node);
+                if (data.links > 1 && data.inode != 0) {
+                    inodes[{ data.device, data.inode }].push_back(node);
+                }
             }
         });
 
-        int possible = 0;
-        for (auto& [size, fileGroup] : sizeGroups) {
-            int count = fileGroup.size();
-            possible += count > 1 ? count : 0;
+        // Hard links to one inode are read once, through the first
+        std::vector<Group> linkSets;
+        std::unordered_set<Node *> linked;
+        for (auto& [inode, links] : inodes) {
+            if (links.size() > 1) {
+                linked.insert(links.begin() + 1, links.end());
+                linkSets.push_back(std::move(links));
+            }
+        }
+        _hardLinks.clear();
+        for (const auto& links : linkSets) {
+            _hardLinks.emplace_back(links.begin(), links.end());
         }
+        _linkedFiles = linked.size();
 
-        // For each size group with more than one file, compute hashes and group by hash
-        Hasher hasher;
-        int quickHashed = 0;
-        std::set<std::filesystem::path> hashFiles;
-        size_t filesToHash = 0;
+        // After an incremental rescan, groups nothing happened to keep their hashes
+        std::vector<Group> partitions;
+        _reusedFiles = 0;
         for (auto& [size, fileGroup] : sizeGroups) {
-            if (progress.is_cancelled()) {
-                progress.report("Operation cancelled", 0.0);
-                return false;
+            if (settled(size, fileGroup)) {
+                _reusedFiles += fileGroup.size();
+                continue;
+            }
+            for (auto n : fileGroup) {
+                n->data().hash.clear();
+                n->data().hashFlags = 0;
+            }
+            if (!linked.empty()) {
+                fileGroup.erase(std::remove_if(fileGroup.begin(), fileGroup.end(),
+                                               [&](Node *n) { return linked.count(n) != 0; }), fileGroup.end());
             }
             if (fileGroup.size() > 1) {
-                filesToHash += fileGroup.size();
-                std::set<Hash> unique{};
-                bool bFullHash = false;
-                for (auto f : fileGroup) {
-                    try {
-                        std::stringstream ss;
-                        ss << quickHashed << "/" << possible << "/" << (_tree.directoryCount + _tree.fileCount) << " Quick hash: " << f->data().path.filename().string();
-                        progress.report(ss.str(), 0.0);
-                        f->data().hash = hasher.hash_file(f->data().path, progress, true);
-                        if (unique.find(f->data().hash) != unique.end()) {
-                            // At least one quick hash is equal to another: bail & compute long hashes
-                            bFullHash = true;
-                            break;
-                        }
-                        else {
-                            // Not found: add to set
-                            unique.insert(f->data().hash);
-                        }
-                    }
-                    catch (const std::exception& e) {
-                        std::stringstream ss;
-                        ss << "Failed quick hashing " << size << " " << f->data().path.string() << " with " << e.what();
-                        progress.report(ss.str(), 0.0);
-                    }
+                partitions.push_back(std::move(fileGroup));
+            }
+        }
 
+        HashRun run(progress, _options);
+        auto identical = refine(run, std::move(partitions));
+        if (run.cancelled || progress.is_cancelled()) {
+            progress.report("Operation cancelled", 0.0);
+            return false;
+        }
+
+        if (_options.algorithm == HashAlgorithm::Sha256) {
+            // Groups out of refine() passed a complete stage, so they agree on a
+            // SHA-256 of the whole file
+            for (const auto& g : identical) {
+                for (auto n : g) {
+                    n->data().hashFlags |= HashConfirmed;
                 }
-                if (bFullHash) {
-                    for (auto f : fileGroup) {
-                        // reset any hash set above
-                        f->data().hash = "";
-                        // and add these files to the list of those to get a full file hash
-                        hashFiles.emplace(f->data().path);
-                    }
-                }
-                else {
-                    quickHashed += fileGroup.size();
-                    possible -= fileGroup.size();
+            }
+        }
+        else if (_options.confirm) {
+            confirmCollisions(run, identical);
+            if (run.cancelled) {
+                progress.report("Operation cancelled", 0.0);
+                return false;
+            }
+        }
+
+        for (const auto& links : linkSets) {
+            const auto& first = links.front()->data();
+            auto failed = run.errors.find(links.front());
+            auto error = failed != run.errors.end() ? failed->second : std::string();
+            for (size_t i = 1; i < links.size(); ++i) {
+                links[i]->data().hash = first.hash;
+                links[i]->data().hashFlags = first.hashFlags;
+                if (!error.empty()) {
+                    run.errors[links[i]] = error;
                 }
             }
+        }
 
+        std::vector<Node *> directories;
+        std::vector<MinHash> sketches;
+        if (!hashDirectories(run, directories, sketches)) {
+            progress.report("Operation cancelled", 0.0);
+            return false;
         }
 
-        progress.report("Computing file hashes...", 0.0);
-        int soFar = 0;
-        int hashed = 0;
         _tree.depthFirstTraverse([&](const auto& node) {
             try {
                 if (progress.is_cancelled()) {
@@ -138,47 +312,29 @@ public:
                     return;
                 }
                 auto& data = node->data();
-                if (data.isDirectory) {
-                    std::vector<std::string> hashes;
-                    for (auto child : node->children()) {
-                        hashes.push_back(child->data().hash);
-                    }
-                    std::sort(hashes.begin(), hashes.end());
-                    std::string signature = "";
-                    for (auto h : hashes) {
-                        signature += (signature != "" ? ", " : "") + h;
-                    }
-                    data.size = node->children().size();
-                    data.hash = Hasher::hash_string(signature, progress);
-                }
-                else {
-                    if (hashFiles.find(data.path) != hashFiles.end()) {
-                        // Hash whole file
-                        std::stringstream ss;
-                        ss << hashed << "/" << soFar << "/" << (_tree.directoryCount + _tree.fileCount) << " Hashing: " << data.path.filename().string() << " ";
-                        progress.report(ss.str(), 50.0);
-                        data.hash = hasher.hash_file(data.path, progress);
-                        ++hashed;
-                    }
-                    else {
-                        // If an existing hash doesn't exist fake a hash from the file size
-                        if(data.hash == "")
-                            data.hash = Hasher::fake_size_hash(data.size);
+                if (!data.isDirectory) {
+                    auto failed = run.errors.find(node);
+                    if (failed != run.errors.end()) {
+                        throw std::runtime_error(failed->second);
                     }
                 }
                 if (_hashToDuplicate.find(data.hash) == _hashToDuplicate.end()) {
-                    _hashToDuplicate[data.hash] = DuplicateFiles(data.size, data.hash);
+                    auto algorithm = (data.hashFlags & HashSha256) ? HashAlgorithm::Sha256 : _options.algorithm;
+                    _hashToDuplicate[data.hash] = DuplicateFiles(data.size, data.hash, data.isDirectory, algorithm);
+                    _hashToDuplicate[data.hash].signature.confirmed = (data.hashFlags & HashConfirmed) != 0;
+                    _hashToDuplicate[data.hash].signature.compared = (data.hashFlags & HashCompared) != 0;
                 }
-                _hashToDuplicate[data.hash].paths.push_back(data.path);
-                ++soFar;
+                _hashToDuplicate[data.hash].nodes.push_back(node);
             }
             catch (const std::exception& e) {
                 std::stringstream ss;
-                ss << "Failed when hashing " << node->data().path << " with " << e.what();
-                progress.report(ss.str(), 50.0);
+                ss << "Failed when hashing " << FileSystemTree::pathOf(node) << " with " << e.what();
+                progress.report(ss.str(), 0.0);
             }
         });
-
+        for (auto& [hash, group] : _hashToDuplicate) {
+            group.copies = countCopies(group);
+        }
 
         _tree.depthFirstTraverse([&](const auto& node) {
             if (progress.is_cancelled()) {
@@ -186,11 +342,11 @@ public:
                 return;
             }
             auto& data = node->data();
-            auto& dupe = _hashToDuplicate[data.hash];
-            data.isIdentical = dupe.isIdentical();
+            auto dupe = _hashToDuplicate.find(data.hash);
+            data.isIdentical = dupe != _hashToDuplicate.end() && dupe->second.isIdentical();
             if (data.isDirectory && !data.isIdentical) {
                 data.isDuplicate = false;
-                for (auto& c : node->children()) {
+                for (const auto& c : node->children()) {
                     if (c->data().isDuplicate) {
                         data.isDuplicate = true;
                         break;
@@ -201,8 +357,790 @@ public:
                 data.isDuplicate = data.isIdentical;
             }
         });
+        _tree.reindexHashes();
+
+        _similar.clear();
+        if (_options.similarity > 0) {
+            progress.report("Finding similar directories", 0.0);
+            findSimilar(progress, directories, sketches);
+        }
+        return true;
+    }
+
+private:
+    // State shared by the hashing passes of one findDuplicates call. Workers never
+    // call back into progress (the GUI pumps its event loop from there); they see
+    // cancellation through the flag, which the waiting thread sets from its tick.
+    struct HashRun {
+        Progress& progress;
+        ThreadPool pool;
+        DeviceScheduler scheduler;
+        std::atomic<bool> cancelled{ false };
+        Progress workerProgress;
+        std::mutex errorMutex;
+        std::unordered_map<Node *, std::string> errors;
+        std::unordered_map<Node *, LayoutKey> layout;
+
+        HashRun(Progress& p, const FinderOptions& options)
+            : progress(p)
+            , pool(options.threads)
+            , scheduler(pool, limits(options))
+            , workerProgress(nullptr, [this]() { return cancelled.load(); })
+        {}
+
+        static DeviceScheduler::Limits limits(const FinderOptions& options) {
+            DeviceScheduler::Limits l;
+            if (options.deviceLimits) {
+                l.rotational = options.rotationalThreads;
+                l.solidState = options.solidStateThreads;
+            }
+            else {
+                l.rotational = l.solidState = 0;
+            }
+            return l;
+        }
+    };
+
+    // Hash every node on the pool, digests[i] belongs to nodes[i]. Nodes that throw
+    // are recorded in run.errors and left with an empty digest.
+    void hashAll(HashRun& run, const std::vector<Node *>& nodes, std::vector<Digest>& digests,
+                 const std::function<Digest(Node *, Progress&)>& hash, const std::string& label) {
+        std::atomic<size_t> done{ 0 };
+        digests.assign(nodes.size(), Digest());
+        for (size_t i : submissionOrder(run, nodes)) {
+            run.scheduler.submit(nodes[i]->data().device, [&, i]() {
+                if (run.cancelled) return;
+                try {
+                    digests[i] = hash(nodes[i], run.workerProgress);
+                }
+                catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(run.errorMutex);
+                    run.errors[nodes[i]] = e.what();
+                }
+                ++done;
+            });
+        }
+        waitAll(run, done, nodes.size(), label);
+    }
+
+    // Full stage through io_uring: each device's nodes are dealt out to as many
+    // batches as it may run at once, each keeping queueDepth reads in flight on its own ring
+    void hashBatched(HashRun& run, const std::vector<Node *>& nodes, std::vector<Digest>& digests,
+                     const std::string& label) {
+        std::atomic<size_t> done{ 0 };
+        digests.assign(nodes.size(), Digest());
+        std::map<std::uint64_t, std::vector<size_t>> byDevice;
+        for (size_t i : submissionOrder(run, nodes)) {
+            byDevice[nodes[i]->data().device].push_back(i);
+        }
+
+        size_t depth = std::max(1u, _options.queueDepth);
+        // Named variables, not structured bindings: C++17 doesn't let lambdas capture those
+        for (const auto& entry : byDevice) {
+            auto device = entry.first;
+            const auto& members = entry.second;
+            size_t batches = std::min<size_t>(run.scheduler.limit(device), (members.size() + depth - 1) / depth);
+            for (size_t b = 0; b < batches; ++b) {
+                run.scheduler.submit(device, [&, b, batches]() {
+                    if (run.cancelled) return;
+                    std::vector<size_t> indices;
+                    std::vector<std::filesystem::path> files;
+                    for (size_t k = b; k < members.size(); k += batches) {
+                        indices.push_back(members[k]);
+                        files.push_back(FileSystemTree::pathOf(nodes[members[k]]));
+                    }
+                    auto results = Hasher::hash_files(files, run.workerProgress, ReadMode::Uring,
+                                                      _options.algorithm, _options.queueDepth);
+                    for (size_t k = 0; k < indices.size(); ++k) {
+                        if (!results[k].error.empty()) {
+                            std::lock_guard<std::mutex> lock(run.errorMutex);
+                            run.errors[nodes[indices[k]]] = results[k].error;
+                        }
+                        digests[indices[k]] = results[k].digest;
+                    }
+                    done += indices.size();
+                });
+            }
+        }
+        waitAll(run, done, nodes.size(), label);
+    }
+
+    // Look up where every candidate lives on disk. FIEMAP costs an open and an
+    // ioctl per file, so it's only worth it on spinning disks; inode order is free.
+    void computeLayout(HashRun& run, const std::vector<Group>& partitions) {
+        std::unordered_map<std::uint64_t, bool> rotational;
+        for (const auto& p : partitions) {
+            for (auto n : p) {
+                const auto& data = n->data();
+                auto it = rotational.find(data.device);
+                if (it == rotational.end()) {
+                    it = rotational.emplace(data.device,
+                        DeviceScheduler::detectKind(data.device) == DeviceKind::Rotational).first;
+                }
+                // Only extents need the path
+                auto path = it->second ? FileSystemTree::pathOf(n) : std::filesystem::path();
+                run.layout[n] = layout_key(path, data.device, data.inode, it->second);
+            }
+        }
+    }
+
+    // Indices into nodes in the order their reads should be issued. The device
+    // scheduler starts queued tasks first in, first out, so on limited devices
+    // this is the order the disk sees.
+    std::vector<size_t> submissionOrder(const HashRun& run, const std::vector<Node *>& nodes) const {
+        std::vector<size_t> order(nodes.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        if (!run.layout.empty()) {
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+                return run.layout.at(nodes[a]) < run.layout.at(nodes[b]);
+            });
+        }
+        return order;
+    }
+
+    // Directory digests, Merkle style: the hash of the children's digests in sorted
+    // order, so the same contents give the same digest whatever order they were
+    // listed in, run after run. Levels go deepest first, each level's directories
+    // in batches on the pool, every child being done by then. Files alone in their
+    // size group never got hashed and get a hash faked from the size first. With
+    // options.similarity, each directory also gets the MinHash sketch of the files
+    // below it, merged from its children's in the same pass: sketches[i] belongs to
+    // directories[i]. False if cancelled.
+    bool hashDirectories(HashRun& run, std::vector<Node *>& directories, std::vector<MinHash>& sketches) {
+        std::vector<std::vector<Node *>> levels;
+        std::vector<Node *> level;
+        if (_tree.root()) {
+            level.push_back(_tree.root());
+        }
+        size_t total = 0;
+        bool sketching = _options.similarity > 0;
+        std::unordered_map<const Node *, size_t> sketchOf;
+        while (!level.empty()) {
+            std::vector<Node *> next, levelDirectories;
+            for (auto n : level) {
+                auto& data = n->data();
+                if (!data.isDirectory) {
+                    if (data.hash.empty() && !run.errors.count(n))
+                        data.hash = Hasher::fake_size_hash(data.size);
+                    continue;
+                }
+                levelDirectories.push_back(n);
+                if (sketching) {
+                    sketchOf.emplace(n, directories.size());
+                    directories.push_back(n);
+                }
+                for (const auto& child : n->children()) {
+                    next.push_back(child);
+                }
+            }
+            total += levelDirectories.size();
+            levels.push_back(std::move(levelDirectories));
+            level = std::move(next);
+        }
+        sketches.assign(directories.size(), MinHash());
+
+        // Batches of a few thousand children, so a level of small directories isn't
+        // one task each and one huge directory doesn't hold up the rest
+        const size_t batchChildren = 4096;
+        std::atomic<size_t> done{ 0 };
+        for (auto it = levels.rbegin(); it != levels.rend(); ++it) {
+            const auto& directories = *it;
+            for (size_t begin = 0, end = 0; begin < directories.size(); begin = end) {
+                for (size_t children = 0; end < directories.size() && children < batchChildren; ++end) {
+                    children += directories[end]->childCount() + 1;
+                }
+                run.pool.submit([&, begin, end]() {
+                    std::vector<Hash> hashes;
+                    for (size_t i = begin; i < end && !run.cancelled; ++i) {
+                        auto n = directories[i];
+                        hashes.clear();
+                        for (const auto& child : n->children()) {
+                            hashes.push_back(child->data().hash);
+                        }
+                        std::sort(hashes.begin(), hashes.end());
+                        n->data().size = hashes.size();
+                        n->data().hash = Hasher::hash_digests(hashes, _options.algorithm);
+                        if (sketching) {
+                            auto& sketch = sketches[sketchOf.at(n)];
+                            for (const auto& child : n->children()) {
+                                if (child->data().isDirectory) {
+                                    sketch.merge(sketches[sketchOf.at(child)]);
+                                }
+                                else if (!child->data().hash.empty()) {
+                                    sketch.merge(MinHash::of(child->data().hash));
+                                }
+                            }
+                        }
+                        ++done;
+                    }
+                });
+            }
+            waitAll(run, done, total, "Hashing directories");
+            if (run.cancelled) return false;
+        }
+        return true;
+    }
+
+    // Directories are copies each. Files are copies unless hard linked to an inode
+    // already counted, or with options.reflinks, sharing every extent with a file
+    // already counted.
+    size_t countCopies(const DuplicateFiles& group) const {
+        if (group.isDirectory || group.nodes.size() < 2) {
+            return group.nodes.size();
+        }
+        std::set<std::pair<std::uint64_t, std::uint64_t>> inodes, extents;
+        size_t copies = 0;
+        for (auto n : group.nodes) {
+            const auto& data = n->data();
+            if (data.inode != 0 && !inodes.emplace(data.device, data.inode).second) continue;
+            if (_options.reflinks) {
+                auto key = shared_extents_key(FileSystemTree::pathOf(n));
+                if (key != 0 && !extents.emplace(data.device, key).second) continue;
+            }
+            ++copies;
+        }
+        return copies;
+    }
+
+    // Fill _similar from the sketches of hashDirectories. LSH banding picks the
+    // candidate pairs, their contents are then compared exactly. Copies of one
+    // directory are sketched once, as they'd only pair up with each other. Pairs
+    // where one directory holds the other aren't reported.
+    void findSimilar(Progress& progress, const std::vector<Node *>& directories, const std::vector<MinHash>& sketches) {
+        std::vector<const Node *> distinct;
+        std::vector<MinHash> distinctSketches;
+        std::unordered_set<Hash> seen;
+        for (size_t i = 0; i < directories.size(); ++i) {
+            if (!sketches[i].empty() && seen.insert(directories[i]->data().hash).second) {
+                distinct.push_back(directories[i]);
+                distinctSketches.push_back(sketches[i]);
+            }
+        }
+
+        // Looser bands for low thresholds, see similar_candidates. The estimate is
+        // within a few percent, so only clear misses are dropped before comparing.
+        auto candidates = similar_candidates(distinctSketches, _options.similarity < 0.7 ? 4 : 8);
+        for (const auto& [a, b] : candidates) {
+            if (progress.is_cancelled()) return;
+            if (distinctSketches[a].similarity(distinctSketches[b]) < _options.similarity - 0.1) continue;
+            if (encloses(distinct[a], distinct[b]) || encloses(distinct[b], distinct[a])) continue;
+            auto pair = compareContents(distinct[a], distinct[b]);
+            if (pair.similarity >= _options.similarity) {
+                _similar.push_back(pair);
+            }
+        }
+
+        // Of two pairs where one lies within the other, keep the outer one if it
+        // shares more, as with the subdirectories of a backup, and the inner one if
+        // not, as when the outer only wraps it
+        std::map<std::pair<const Node *, const Node *>, size_t> pairs;
+        for (size_t i = 0; i < _similar.size(); ++i) {
+            pairs.emplace(std::make_pair(_similar[i].first, _similar[i].second), i);
+            pairs.emplace(std::make_pair(_similar[i].second, _similar[i].first), i);
+        }
+        std::vector<bool> dropped(_similar.size(), false);
+        for (size_t i = 0; i < _similar.size(); ++i) {
+            for (auto a = _similar[i].first; a; a = a->parent()) {
+                for (auto b = _similar[i].second; b; b = b->parent()) {
+                    auto outer = pairs.find({ a, b });
+                    if (outer == pairs.end() || outer->second == i) continue;
+                    if (_similar[outer->second].sharedFiles > _similar[i].sharedFiles) {
+                        dropped[i] = true;
+                    } else {
+                        dropped[outer->second] = true;
+                    }
+                }
+            }
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < _similar.size(); ++i) {
+            if (!dropped[i]) {
+                _similar[kept++] = _similar[i];
+            }
+        }
+        _similar.resize(kept);
+        std::sort(_similar.begin(), _similar.end(), [](const SimilarDirectories& a, const SimilarDirectories& b) {
+            return a.sharedBytes != b.sharedBytes ? a.sharedBytes > b.sharedBytes : a.similarity > b.similarity;
+        });
+    }
+
+    static bool encloses(const Node *outer, const Node *inner) {
+        for (auto n = inner->parent(); n; n = n->parent()) {
+            if (n == outer) return true;
+        }
+        return false;
+    }
+
+    static SimilarDirectories compareContents(const Node *first, const Node *second) {
+        auto contents = [](const Node *directory) {
+            std::unordered_map<Hash, std::uintmax_t> files;
+            std::vector<const Node *> stack{ directory };
+            while (!stack.empty()) {
+                auto n = stack.back();
+                stack.pop_back();
+                for (const auto& child : n->children()) {
+                    if (child->data().isDirectory) {
+                        stack.push_back(child);
+                    }
+                    else if (!child->data().hash.empty()) {
+                        files.emplace(child->data().hash, child->data().size);
+                    }
+                }
+            }
+            return files;
+        };
+
+        auto a = contents(first), b = contents(second);
+        SimilarDirectories pair{ first, second, 0.0, 0, 0 };
+        for (const auto& [hash, size] : a) {
+            if (b.count(hash)) {
+                ++pair.sharedFiles;
+                pair.sharedBytes += size;
+            }
+        }
+        auto all = a.size() + b.size() - pair.sharedFiles;
+        pair.similarity = all ? static_cast<double>(pair.sharedFiles) / all : 0.0;
+        return pair;
+    }
+
+    // Wait for the pool while reporting done/total, as a fraction too, and polling for cancellation
+    void waitAll(HashRun& run, const std::atomic<size_t>& done, size_t total, const std::string& label) {
+        size_t totalFiles = _tree.directoryCount + _tree.fileCount;
+        run.pool.wait([&]() {
+            if (run.progress.is_cancelled()) {
+                run.cancelled = true;
+            }
+            std::stringstream ss;
+            ss << done << "/" << total << "/" << totalFiles << " " << label;
+            run.progress.report(ss.str(), total ? static_cast<double>(done) / total : 1.0);
+        });
+    }
+
+    // A size group is settled when it has exactly the members it had last scan, all
+    // unchanged and hashed; a file added, removed or changed puts its size in changedSizes
+    bool settled(std::uintmax_t size, const Group& group) const {
+        if (!_tree.isIncremental() || _tree.changedSizes().count(size)) {
+            return false;
+        }
+        for (auto n : group) {
+            if (!n->data().reused || n->data().hash.empty()) return false;
+        }
+        return true;
+    }
+
+    // Comparing reads the files, so not when the cache already knows all their digests
+    bool compareInstead(const Group& partition) const {
+        if (partition.size() > _options.compareMaxFiles || partition.front()->data().size < _options.compareMinSize) {
+            return false;
+        }
+        if (_cache) {
+            for (auto n : partition) {
+                if (!_cache->contains(cacheKey(n, HashStage::Full, _options.algorithm), cacheVersion(n))) {
+                    return true;
+                }
+            }
+            return false;
+        }
         return true;
     }
+
+    // A stage that covers the whole file is a full hash and shares its entry. Partial
+    // stages carry a fingerprint of the settings that decide which bytes they read.
+    HashCache::Key cacheKey(const Node *node, HashStage stage, HashAlgorithm algorithm) const {
+        const auto& data = node->data();
+        HashCache::Key key;
+        key.device = data.device;
+        key.inode = data.inode;
+        key.algorithm = algorithm;
+        if (stageIsComplete(stage, data.size)) {
+            key.stage = static_cast<std::uint8_t>(HashStage::Full);
+            return key;
+        }
+        key.stage = static_cast<std::uint8_t>(stage);
+        std::uint64_t settings[] = { _options.headSize, _options.tailSize, _options.sampleSize, _options.middleSamples };
+        auto context = HashContext::create(HashAlgorithm::Xxh3_128);
+        context->update(settings, sizeof(settings));
+        std::memcpy(&key.params, context->final().bytes.data(), sizeof(key.params));
+        return key;
+    }
+
+    static HashCache::Version cacheVersion(const Node *node) {
+        const auto& data = node->data();
+        return HashCache::Version{ data.size, data.mtime, data.ctime };
+    }
+
+    // Take what digests the cache has and hash the rest with hashMisses, storing
+    // what it produced. read gets the nodes that actually had to be read.
+    void hashCached(HashRun& run, HashStage stage, HashAlgorithm algorithm, const std::vector<Node *>& nodes,
+                    std::vector<Digest>& digests, std::vector<Node *>& read,
+                    const std::function<void(const std::vector<Node *>&, std::vector<Digest>&)>& hashMisses) {
+        digests.assign(nodes.size(), Digest());
+        read.clear();
+        std::vector<size_t> missAt;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (_cache && _cache->lookup(cacheKey(nodes[i], stage, algorithm), cacheVersion(nodes[i]), digests[i])) {
+                continue;
+            }
+            missAt.push_back(i);
+            read.push_back(nodes[i]);
+        }
+
+        std::vector<Digest> fresh;
+        hashMisses(read, fresh);
+        if (run.cancelled) return;
+        for (size_t k = 0; k < read.size(); ++k) {
+            digests[missAt[k]] = fresh[k];
+            if (_cache && !run.errors.count(read[k])) {
+                _cache->store(cacheKey(read[k], stage, algorithm), cacheVersion(read[k]), fresh[k]);
+            }
+        }
+    }
+
+    // Stand-in digest for files whose content was compared rather than hashed: the
+    // set's first member names it, so it is unique to the set but only within this run
+    Digest compareKey(const Group& set) const {
+        const auto& data = set.front()->data();
+        auto context = HashContext::create(_options.algorithm);
+        const char marker[] = "compared";
+        context->update(marker, sizeof(marker));
+        std::uint64_t size = data.size;
+        context->update(&size, sizeof(size));
+        auto path = FileSystemTree::pathOf(set.front()).u8string();
+        context->update(path.data(), path.size());
+        return context->final();
+    }
+
+    // Lockstep comparison of small partitions, one task per partition
+    void compareAll(HashRun& run, const std::vector<Group>& partitions, std::vector<Group>& identical) {
+        std::vector<Comparator::Result> results(partitions.size());
+        std::atomic<size_t> done{ 0 };
+        std::vector<Node *> fronts;
+        for (const auto& p : partitions) {
+            fronts.push_back(p.front());
+        }
+        for (size_t i : submissionOrder(run, fronts)) {
+            run.scheduler.submit(partitions[i].front()->data().device, [&, i]() {
+                if (run.cancelled) return;
+                std::vector<std::filesystem::path> files;
+                for (auto n : partitions[i]) {
+                    files.push_back(FileSystemTree::pathOf(n));
+                }
+                results[i] = Comparator::compare(files, run.workerProgress);
+                ++done;
+            });
+        }
+        waitAll(run, done, partitions.size(), "Comparing");
+        if (run.cancelled) return;
+
+        for (size_t i = 0; i < partitions.size(); ++i) {
+            const auto& p = partitions[i];
+            _compareStats.files += p.size();
+            _compareStats.bytes += results[i].bytesRead;
+            for (const auto& [index, error] : results[i].failed) {
+                run.errors[p[index]] = error;
+            }
+            for (const auto& indices : results[i].sets) {
+                Group set;
+                for (auto index : indices) {
+                    set.push_back(p[index]);
+                }
+                auto key = compareKey(set);
+                for (auto n : set) {
+                    n->data().hash = key;
+                    n->data().hashFlags |= HashCompared;
+                }
+                if (set.size() > 1) {
+                    identical.push_back(std::move(set));
+                }
+            }
+        }
+    }
+
+    bool stageApplies(HashStage stage, std::uintmax_t size) const {
+        switch (stage) {
+            case HashStage::Head:
+            case HashStage::Full:
+                return true;
+            case HashStage::Tail:
+                return size > _options.headSize;
+            case HashStage::Middle:
+                return _options.middleSamples > 0 && size > _options.headSize + _options.tailSize;
+        }
+        return false;
+    }
+
+    // A head covering the whole file is already a full content hash
+    bool stageIsComplete(HashStage stage, std::uintmax_t size) const {
+        return stage == HashStage::Full || (stage == HashStage::Head && size <= _options.headSize);
+    }
+
+    std::vector<ByteRange> stageRanges(HashStage stage, std::uintmax_t size) const {
+        switch (stage) {
+            case HashStage::Head:
+                return { { 0, std::min(size, _options.headSize) } };
+            case HashStage::Tail: {
+                auto length = std::min(size, _options.tailSize);
+                return { { size - length, length } };
+            }
+            case HashStage::Middle: {
+                std::uintmax_t begin = _options.headSize;
+                std::uintmax_t end = size - _options.tailSize;
+                std::uintmax_t span = end - begin;
+                if (span <= _options.middleSamples * _options.sampleSize) {
+                    return { { begin, span } };
+                }
+                std::vector<ByteRange> ranges;
+                std::uintmax_t step = (span - _options.sampleSize) / (_options.middleSamples + 1);
+                for (unsigned i = 1; i <= _options.middleSamples; ++i) {
+                    ranges.push_back({ begin + step * i, _options.sampleSize });
+                }
+                return ranges;
+            }
+            case HashStage::Full:
+                return { { 0, size } };
+        }
+        return {};
+    }
+
+    Digest stageDigest(HashStage stage, Node *node, Progress& progress) const {
+        const auto& data = node->data();
+        if (stageIsComplete(stage, data.size)) {
+            return Hasher::hash_file(FileSystemTree::pathOf(node), progress, false, _options.readMode, _options.algorithm);
+        }
+        // Salt with stage and size so partial digests can't match across either
+        std::uint64_t salt = (static_cast<std::uint64_t>(stage) << 56) | static_cast<std::uint64_t>(data.size);
+        return Hasher::hash_ranges(FileSystemTree::pathOf(node), progress, stageRanges(stage, data.size),
+                                   _options.algorithm, salt);
+    }
+
+    // Digest of a partition split off another by digest. Keys chain every stage's
+    // digest since the size group, so they tell apart partitions that only agree
+    // in the last stage.
+    Digest chainKey(const Digest& key, const Digest& digest) const {
+        auto context = HashContext::create(_options.algorithm);
+        context->update(key.bytes.data(), key.bytes.size());
+        context->update(digest.bytes.data(), digest.bytes.size());
+        return context->final();
+    }
+
+    // Split partitions stage by stage. A file left alone by a partial stage gets the
+    // key of the partition it would have formed: its partial digest alone would
+    // equal that of a file from another partition sharing just the block read.
+    // Partitions that make it through a complete stage hold identical files and
+    // keep the content digest.
+    std::vector<Group> refine(HashRun& run, std::vector<Group> partitions) {
+        std::vector<HashStage> stages;
+        for (auto stage : _options.stages) {
+            if (stage != HashStage::Full) stages.push_back(stage);
+        }
+        stages.push_back(HashStage::Full);
+        std::fill(_stageStats.begin(), _stageStats.end(), StageStats());
+        _compareStats = StageStats();
+        if (_options.layoutOrder) {
+            computeLayout(run, partitions);
+        }
+
+        // Size groups start from an empty key, partial digests are salted with the size
+        std::vector<Digest> keys(partitions.size());
+        std::vector<Group> identical;
+        for (auto stage : stages) {
+            if (partitions.empty()) break;
+
+            std::vector<Group> active;
+            std::vector<Digest> activeKeys;
+            std::vector<Group> next;
+            std::vector<Digest> nextKeys;
+            std::vector<Group> compare;
+            std::vector<Node *> work;
+            auto& stats = _stageStats[static_cast<size_t>(stage)];
+            for (size_t k = 0; k < partitions.size(); ++k) {
+                auto& p = partitions[k];
+                auto size = p.front()->data().size;
+                if (!stageApplies(stage, size)) {
+                    next.push_back(std::move(p));
+                    nextKeys.push_back(keys[k]);
+                    continue;
+                }
+                if (stage == HashStage::Full && compareInstead(p)) {
+                    compare.push_back(std::move(p));
+                    continue;
+                }
+                work.insert(work.end(), p.begin(), p.end());
+                active.push_back(std::move(p));
+                activeKeys.push_back(keys[k]);
+            }
+
+            std::vector<Digest> digests;
+            std::vector<Node *> read;
+            std::string label = std::string(stage_name(stage)) + " hash";
+            hashCached(run, stage, _options.algorithm, work, digests, read,
+                       [&](const std::vector<Node *>& misses, std::vector<Digest>& fresh) {
+                if (stage == HashStage::Full && _options.readMode == ReadMode::Uring && Hasher::uring_supported()) {
+                    hashBatched(run, misses, fresh, label);
+                }
+                else {
+                    hashAll(run, misses, fresh, [this, stage](Node *n, Progress& p) {
+                        return stageDigest(stage, n, p);
+                    }, label);
+                }
+            });
+            for (auto n : read) {
+                std::uintmax_t bytes = 0;
+                for (const auto& r : stageRanges(stage, n->data().size)) {
+                    bytes += r.length;
+                }
+                ++stats.files;
+                stats.bytes += bytes;
+            }
+            if (!compare.empty()) {
+                compareAll(run, compare, identical);
+            }
+            if (run.cancelled) {
+                return {};
+            }
+
+            // Most files of a large stage usually have no partner; one pass through a
+            // filter finds them, and they are settled without a map entry or group each.
+            // Keys take in the partition, so files of different partitions don't pair.
+            std::unique_ptr<PartnerFilter> filter;
+            auto filterKey = [](const Digest& partition, const Digest& digest) {
+                return PartnerFilter::key(PartnerFilter::key(0, partition), digest);
+            };
+            if (_options.prefilterMinFiles && work.size() >= _options.prefilterMinFiles) {
+                filter = std::make_unique<PartnerFilter>(work.size());
+                size_t j = 0;
+                for (size_t k = 0; k < active.size(); ++k) {
+                    for (auto n : active[k]) {
+                        if (!run.errors.count(n)) {
+                            filter->add(filterKey(activeKeys[k], digests[j]));
+                        }
+                        ++j;
+                    }
+                }
+            }
+
+            size_t i = 0;
+            for (size_t k = 0; k < active.size(); ++k) {
+                auto& p = active[k];
+                bool complete = stageIsComplete(stage, p.front()->data().size);
+                std::unordered_map<Digest, size_t> index;
+                std::vector<std::pair<Digest, Group>> parts;
+                for (auto n : p) {
+                    const auto& d = digests[i++];
+                    if (run.errors.count(n)) continue;
+                    if (filter && !filter->mayRepeat(filterKey(activeKeys[k], d))) {
+                        n->data().hash = complete ? d : chainKey(activeKeys[k], d);
+                        ++stats.prefiltered;
+                        continue;
+                    }
+                    auto it = index.emplace(d, parts.size());
+                    if (it.second) {
+                        parts.emplace_back(d, Group());
+                    }
+                    parts[it.first->second].second.push_back(n);
+                }
+                for (auto& [digest, part] : parts) {
+                    if (complete) {
+                        for (auto n : part) {
+                            n->data().hash = digest;
+                        }
+                        if (part.size() > 1) {
+                            identical.push_back(std::move(part));
+                        }
+                    }
+                    else if (part.size() == 1) {
+                        part.front()->data().hash = chainKey(activeKeys[k], digest);
+                    }
+                    else {
+                        next.push_back(std::move(part));
+                        nextKeys.push_back(chainKey(activeKeys[k], digest));
+                    }
+                }
+            }
+            partitions = std::move(next);
+            keys = std::move(nextKeys);
+        }
+        return identical;
+    }
+
+    // SHA-256 every member of a group that collided under the fast algorithm. Groups
+    // that still agree keep their hash and are marked confirmed; any that split are
+    // re-keyed by their SHA-256 digests, which can't clash with the shorter ones.
+    void confirmCollisions(HashRun& run, const std::vector<Group>& groups) {
+        // Compared groups are already byte-for-byte equal
+        std::vector<Group> hashed;
+        for (const auto& g : groups) {
+            if (g.front()->data().hashFlags & HashCompared) {
+                for (auto n : g) {
+                    n->data().hashFlags |= HashConfirmed;
+                }
+            }
+            else {
+                hashed.push_back(g);
+            }
+        }
+        std::vector<Node *> work;
+        for (const auto& g : hashed) {
+            work.insert(work.end(), g.begin(), g.end());
+        }
+        std::vector<Digest> sha;
+        std::vector<Node *> read;
+        hashCached(run, HashStage::Full, HashAlgorithm::Sha256, work, sha, read,
+                   [&](const std::vector<Node *>& misses, std::vector<Digest>& fresh) {
+            hashAll(run, misses, fresh, [this](Node *n, Progress& p) {
+                return Hasher::hash_file(FileSystemTree::pathOf(n), p, false, _options.readMode, HashAlgorithm::Sha256);
+            }, "Confirming with sha256");
+        });
+        if (run.cancelled) return;
+
+        size_t i = 0;
+        for (const auto& g : hashed) {
+            std::set<Hash> digests;
+            for (size_t j = 0; j < g.size(); ++j) {
+                if (!run.errors.count(g[j])) {
+                    digests.insert(sha[i + j]);
+                }
+            }
+            if (digests.size() <= 1) {
+                for (auto n : g) {
+                    n->data().hashFlags |= HashConfirmed;
+                }
+            }
+            else {
+                for (size_t j = 0; j < g.size(); ++j) {
+                    g[j]->data().hash = sha[i + j];
+                    g[j]->data().hashFlags |= HashSha256 | HashConfirmed;
+                }
+            }
+            i += g.size();
+        }
+    }
 };
 
+inline const char* stage_name(HashStage stage) {
+    switch (stage) {
+        case HashStage::Head:
+            return "head";
+        case HashStage::Tail:
+            return "tail";
+        case HashStage::Middle:
+            return "middle";
+        case HashStage::Full:
+            return "full";
+    }
+    return "unknown";
+}
+
+inline bool parse_stage(const std::string& name, HashStage& stage) {
+    for (auto s : { HashStage::Head, HashStage::Tail, HashStage::Middle, HashStage::Full }) {
+        if (name == stage_name(s)) {
+            stage = s;
+            return true;
+        }
+    }
+    return false;
+}
+
 } // namespace dedupe 
\ No newline at end of file
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dedupe {
+
+// Sorts more records than fit in memory. Records are buffered up to the memory
+// budget, then sorted and written out as a run; merge() streams them back in order
+// through a k-way merge of the runs, reading each through a slice of the budget.
+// With more than MAX_FAN_IN runs, runs are first merged into fewer, longer ones.
+// Nothing touches the disk while everything fits. Records are written raw, so T
+// must be trivially copyable. Run files live in directory and are removed with
+// the sorter. Throws std::runtime_error when a run can't be written or read.
+template<typename T, typename Less = std::less<T>>
+class ExternalSorter {
+    static_assert(std::is_trivially_copyable<T>::value, "records are written as raw bytes");
+
+public:
+    static constexpr std::size_t MAX_FAN_IN = 256;
+
+    ExternalSorter(std::filesystem::path directory, std::size_t memory, Less less = Less())
+        : directory_(std::move(directory))
+        , capacity_(std::max<std::size_t>(memory / sizeof(T), MIN_RECORDS))
+        , less_(less)
+    {}
+
+    ~ExternalSorter() {
+        std::error_code ignored;
+        for (const auto& run : runs_) {
+            std::filesystem::remove(run, ignored);
+        }
+    }
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    void push(const T& record) {
+        if (buffer_.size() >= capacity_) {
+            spill();
+        }
+        buffer_.push_back(record);
+        ++size_;
+    }
+
+    // Records pushed so far
+    std::uint64_t size() const { return size_; }
+
+    // Runs written to disk so far, 0 while everything fits in memory
+    std::size_t runs() const { return written_; }
+
+    // Call visit(const T&) on every record in order. The sorter is empty afterwards.
+    template<typename Visit>
+    void merge(Visit&& visit) {
+        if (runs_.empty()) {
+            std::sort(buffer_.begin(), buffer_.end(), less_);
+            for (const auto& record : buffer_) {
+                visit(record);
+            }
+            clear();
+            return;
+        }
+        spill();
+        std::vector<T>().swap(buffer_);
+        while (runs_.size() > MAX_FAN_IN) {
+            std::vector<std::filesystem::path> group(runs_.begin(), runs_.begin() + MAX_FAN_IN);
+            runs_.erase(runs_.begin(), runs_.begin() + MAX_FAN_IN);
+            auto path = nextRun();
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            mergeRuns(group, [&](const T& record) {
+                out.write(reinterpret_cast<const char*>(&record), sizeof(T));
+            });
+            if (!out.flush()) {
+                throw std::runtime_error("Cannot write sort run: " + path.string());
+            }
+            runs_.push_back(path);
+        }
+        auto group = std::move(runs_);
+        runs_.clear();
+        mergeRuns(group, visit);
+        clear();
+    }
+
+private:
+    static constexpr std::size_t MIN_RECORDS = 1024;
+
+    // One run being merged, read a block of records at a time
+    struct Reader {
+        std::ifstream in;
+        std::vector<T> block;
+        std::size_t next = 0;
+
+        bool fill() {
+            in.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size() * sizeof(T)));
+            auto count = static_cast<std::size_t>(in.gcount()) / sizeof(T);
+            block.resize(count);
+            next = 0;
+            return count > 0;
+        }
+    };
+
+    std::filesystem::path nextRun() {
+        return directory_ / ("dedupe-sort-" + std::to_string(reinterpret_cast<std::uintptr_t>(this)) + "-"
+                             + std::to_string(written_++) + ".run");
+    }
+
+    void spill() {
+        if (buffer_.empty()) return;
+        std::sort(buffer_.begin(), buffer_.end(), less_);
+        auto path = nextRun();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size() * sizeof(T)));
+        if (!out.flush()) {
+            throw std::runtime_error("Cannot write sort run: " + path.string());
+        }
+        runs_.push_back(path);
+        buffer_.clear();
+    }
+
+    // Merge the runs, which are removed once read
+    template<typename Visit>
+    void mergeRuns(const std::vector<std::filesystem::path>& runs, Visit&& visit) {
+        std::size_t perRun = std::max<std::size_t>(capacity_ / std::max<std::size_t>(runs.size(), 1), 64);
+        std::vector<Reader> readers(runs.size());
+        using Head = std::pair<T, std::size_t>;
+        auto later = [this](const Head& a, const Head& b) { return less_(b.first, a.first); };
+        std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+        for (std::size_t i = 0; i < runs.size(); ++i) {
+            readers[i].in.open(runs[i], std::ios::binary);
+            if (!readers[i].in) {
+                throw std::runtime_error("Cannot read sort run: " + runs[i].string());
+            }
+            readers[i].block.resize(perRun);
+            if (readers[i].fill()) {
+                heads.emplace(readers[i].block[readers[i].next++], i);
+            }
+        }
+        while (!heads.empty()) {
+            auto [record, i] = heads.top();
+            heads.pop();
+            visit(record);
+            auto& reader = readers[i];
+            if (reader.next < reader.block.size() || (reader.block.resize(perRun), reader.fill())) {
+                heads.emplace(reader.block[reader.next++], i);
+            }
+        }
+        std::error_code ignored;
+        for (const auto& run : runs) {
+            std::filesystem::remove(run, ignored);
+        }
+    }
+
+    void clear() {
+        std::vector<T>().swap(buffer_);
+        size_ = 0;
+    }
+
+    std::filesystem::path directory_;
+    std::size_t capacity_;
+    Less less_;
+    std::vector<T> buffer_;
+    std::vector<std::filesystem::path> runs_;
+    std::size_t written_ = 0;
+    std::uint64_t size_ = 0;
+};
+
+} // namespace dedupe
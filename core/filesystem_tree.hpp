@@ -1,58 +1,98 @@
 #pragma once
 
-#include "nested_tree.hpp"
+#include "arena_tree.hpp"
+#include "digest.hpp"
+#include "listing.hpp"
+#include "name_pool.hpp"
 #include "progress.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <sstream>
 #include <memory>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
 
 namespace dedupe {
 
+// How a file's hash was settled, kept on the node so a rescan can reuse it
+enum HashFlags : std::uint8_t {
+    HashSha256 = 1,         // Re-keyed by SHA-256 after colliding under the fast algorithm
+    HashCompared = 2,       // Compared byte by byte, hash is only a key
+    HashConfirmed = 4       // Group checked by SHA-256 or byte comparison
+};
+
+// Fields by alignment, widest first, so none needs padding
 struct FileSystemNode {
     // All
-    std::filesystem::path path;
+    Name name;              // Within the parent directory, the whole path for a root, see FileSystemTree::pathOf
+    uintmax_t size;
+    std::uint64_t device;   // st_dev, 0 where stat isn't available
+    std::uint64_t inode;    // st_ino, 0 where stat isn't available
+    std::int64_t mtime;     // Nanoseconds since the epoch, 0 where stat isn't available
+    std::int64_t ctime;
+    std::uint32_t links;    // st_nlink, 0 where stat isn't available
     bool isDirectory;
     bool isDuplicate;
     bool isIdentical;
-    uintmax_t size;
 
-    // Files
-    std::string hash;  // Empty for directories
+    // Files, and directories once duplicates have been found
+    Digest hash;
+    std::uint8_t hashFlags;
+    bool reused;            // hash carried over from a previous scan, see rebuildFromPath
 
-    FileSystemNode(const std::filesystem::path& p, bool isDir = false, uintmax_t s = 0)
-        : path(p)
-        , isDirectory(isDir)
+    FileSystemNode(const Name& n, bool isDir = false, uintmax_t s = 0)
+        : name(n)
         , size(s)
+        , device(0)
+        , inode(0)
+        , mtime(0)
+        , ctime(0)
+        , links(0)
+        , isDirectory(isDir)
         , isDuplicate(false)
         , isIdentical(false)
-        , hash("")
+        , hashFlags(0)
+        , reused(false)
     {}
 };
 
-class FileSystemTree : public NestedTree<FileSystemNode> {
+// Nodes live in the tree's arena rather than a heap allocation each, see
+// ArenaTree; dedupe_bench tree compares the two.
+class FileSystemTree : public ArenaTree<FileSystemNode> {
 public:
-    using NodePtr = typename NestedTree<FileSystemNode>::NodePtr;
-    using Visitor = typename NestedTree<FileSystemNode>::Visitor;
+    using NodePtr = typename ArenaTree<FileSystemNode>::NodePtr;
+    using Visitor = typename ArenaTree<FileSystemNode>::Visitor;
 
-    static int errors;
-    static int directoryCount;
-    static int fileCount;
+    // Updated from every listing thread
+    static std::atomic<int> errors;
+    static std::atomic<int> directoryCount;
+    static std::atomic<int> fileCount;
 
-    // Build a tree from a filesystem path
+    // Build a tree from a filesystem path. With threads other than 1, directories
+    // below the root are listed in parallel, 0 for one per core; the tree comes out
+    // the same, children in listing order whichever thread listed them.
     static FileSystemTree buildFromPath(const std::filesystem::path& rootPath,
-                                      Progress& progress) {
+                                      Progress& progress, bool recursive = true, unsigned threads = 1) {
         FileSystemTree tree;
         errors = 0;
         directoryCount = fileCount = 0;
-        auto root = std::make_shared<NestedNode<FileSystemNode>>(
-            FileSystemNode(rootPath, std::filesystem::is_directory(rootPath))
-        );
+        auto root = tree.createNode(FileSystemNode(rootPath, std::filesystem::is_directory(rootPath)));
+        readStat(root->data(), rootPath);
         
         if (std::filesystem::is_directory(rootPath)) {
             ++directoryCount;
-            buildDirectoryTree(root, rootPath, progress);
+            buildRoot(root, rootPath, progress, recursive, nullptr, nullptr, threads);
         } else {
             ++fileCount;
             root->data().size = std::filesystem::file_size(rootPath);
@@ -62,15 +102,225 @@ public:
         return tree;
     }
 
-    // Find nodes by path
-    NodePtr findByPath(const std::filesystem::path& path) const {
-        return findNode([&path](const NodePtr& node) {
-            return node->data().path == path;
+    // Build a tree from a filesystem path, starting from previous, an earlier scan
+    // of the same path. Directories whose mtime hasn't moved have had nothing added,
+    // removed or renamed, so their entries are taken from previous instead of listed
+    // again; every entry is still stat'ed. With reuseHashes, files whose inode, size,
+    // mtime and ctime all match keep their hash and are marked reused, see changedSizes.
+    // threads as for buildFromPath.
+    static FileSystemTree rebuildFromPath(const std::filesystem::path& rootPath, const FileSystemTree& previous,
+                                          Progress& progress, bool recursive = true, bool reuseHashes = true,
+                                          unsigned threads = 1) {
+        FileSystemTree tree;
+        errors = 0;
+        directoryCount = fileCount = 0;
+        tree.incremental_ = true;
+        Rescan rescan(reuseHashes, tree.changedSizes_);
+        auto root = tree.createNode(FileSystemNode(rootPath, std::filesystem::is_directory(rootPath)));
+        readStat(root->data(), rootPath);
+
+        NodePtr before = previous.root();
+        if (before && before->data().isDirectory != root->data().isDirectory) {
+            forget(before, rescan);
+            before = nullptr;
+        }
+        if (root->data().isDirectory) {
+            ++directoryCount;
+            buildRoot(root, rootPath, progress, recursive, before, &rescan, threads);
+        } else {
+            ++fileCount;
+            root->data().size = std::filesystem::file_size(rootPath);
+            reuse(root->data(), before, rescan);
+        }
+
+        tree.setRoot(root);
+        return tree;
+    }
+
+    // True for trees from rebuildFromPath
+    bool isIncremental() const { return incremental_; }
+
+    // Sizes of files added, removed or changed since the previous scan. Files of any
+    // other size that are all marked reused form the same size group as before.
+    const std::unordered_set<uintmax_t>& changedSizes() const { return changedSizes_; }
+
+    // Take the hashes now in the tree as the baseline for later refreshPath calls:
+    // every file is marked reused and changedSizes starts empty, so the next
+    // findDuplicates only hashes the size groups refreshed since.
+    void settle() {
+        incremental_ = true;
+        changedSizes_.clear();
+        depthFirstTraverse([](const NodePtr& node) {
+            if (!node->data().isDirectory) {
+                node->data().reused = true;
+            }
         });
     }
 
-    // Find all files with a specific hash
-    std::vector<NodePtr> findFilesByHash(const std::string& hash) const {
+    // Bring path up to date after a change on disk: stat it again, add it if it's new
+    // (with everything below it for a directory) or drop it if it's gone. Files that
+    // didn't really change keep their hash, the sizes of those that did go into
+    // changedSizes. A path whose parent isn't in the tree yet refreshes the topmost
+    // missing directory instead. Returns the refreshed node, nullptr if it's gone or
+    // path isn't below the root. Call updateNestedSets once a batch is applied.
+    NodePtr refreshPath(const std::filesystem::path& path, Progress& progress, bool recursive = true) {
+        auto top = root();
+        if (!top || !top->data().isDirectory) return nullptr;
+        auto relative = path.lexically_relative(top->data().name.path());
+        if (relative.empty() || relative == "." || *relative.begin() == "..") return nullptr;
+
+        NodePtr parent = top;
+        NodePtr node = nullptr;
+        auto current = top->data().name.path();
+        for (auto it = relative.begin(); it != relative.end(); ++it) {
+            current /= *it;
+            node = lookup(parent, *it);
+            if (!node || !node->data().isDirectory || std::next(it) == relative.end()) break;
+            parent = node;
+        }
+        if (!recursive && parent != top) return nullptr;
+        // Replaced or dropped below either way
+        if (node) {
+            unindex(node);
+        }
+
+        incremental_ = true;
+        Rescan rescan(true, changedSizes_);
+        std::error_code ec;
+        bool isDirectory = std::filesystem::is_directory(current, ec);
+        if (!std::filesystem::exists(current, ec) || (isDirectory && !recursive)) {
+            if (node) {
+                forget(node, rescan);
+                parent->removeChild(node);
+            }
+            return nullptr;
+        }
+
+        // Built beside node, which it replaces once complete
+        auto fresh = createNode(FileSystemNode(current.filename(), isDirectory));
+        readStat(fresh->data(), current);
+        NodePtr before = node;
+        if (node && node->data().isDirectory != isDirectory) {
+            forget(node, rescan);
+            before = nullptr;
+        }
+        try {
+            if (isDirectory) {
+                buildDirectoryTree(fresh, current, progress, true, before, &rescan);
+            } else {
+                fresh->data().size = std::filesystem::file_size(current);
+                reuse(fresh->data(), before, rescan);
+            }
+        }
+        catch (const std::exception&) {
+            ++errors;
+            if (before) {
+                forget(before, rescan);
+            }
+            if (node) {
+                parent->removeChild(node);
+            }
+            destroyNode(fresh);
+            return nullptr;
+        }
+
+        if (node) {
+            parent->replaceChild(node, fresh);
+        } else {
+            parent->addChild(fresh);
+        }
+        index(fresh);
+        return fresh;
+    }
+
+    // Nodes keep only their name, the path is put together from the root down
+    static std::filesystem::path pathOf(const ArenaNode<FileSystemNode>* node) {
+        std::vector<const ArenaNode<FileSystemNode>*> chain;
+        for (; node; node = node->parent()) {
+            chain.push_back(node);
+        }
+        std::filesystem::path path;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            path /= (*it)->data().name.native();
+        }
+        return path;
+    }
+
+    // Index every node by its parent and name, and every file by its hash, so
+    // findByPath costs a hash lookup per component and findFilesByHash one in all.
+    // refreshPath keeps the indexes up to date, as does DuplicateFinder for the
+    // hashes it sets; anything else that changes the tree calls this again.
+    void buildIndexes() {
+        indexes_ = Indexes();
+        indexes_.built = true;
+        if (!root()) return;
+        size_t nodes = 0;
+        depthFirstTraverse([&nodes](const NodePtr&) { ++nodes; });
+        indexes_.children.reserve(nodes);
+        indexes_.files.reserve(nodes);
+        index(root());
+    }
+
+    void dropIndexes() {
+        indexes_ = Indexes();
+    }
+
+    bool isIndexed() const { return indexes_.built; }
+
+    // Refill the hash index after hashes changed in place. const because
+    // DuplicateFinder, which sets them, holds the tree as const.
+    void reindexHashes() const {
+        if (!indexes_.built) return;
+        indexes_.files.clear();
+        depthFirstTraverse([this](const NodePtr& node) {
+            if (!node->data().isDirectory && !node->data().hash.empty()) {
+                indexes_.files.emplace(node->data().hash, node);
+            }
+        });
+    }
+
+    // Approximate bytes held by the indexes: buckets plus one heap node per entry
+    size_t indexMemoryUsage() const {
+        const size_t overhead = 2 * sizeof(void*);      // Next pointer and cached hash
+        return (indexes_.children.bucket_count() + indexes_.files.bucket_count()) * sizeof(void*)
+            + indexes_.children.size() * (sizeof(Indexes::Children::value_type) + overhead)
+            + indexes_.files.size() * (sizeof(Indexes::Files::value_type) + overhead);
+    }
+
+    // Find nodes by path, following its components down from the root
+    NodePtr findByPath(const std::filesystem::path& path) const {
+        NodePtr node = root();
+        if (!node) return nullptr;
+        auto relative = path.lexically_relative(node->data().name.path());
+        if (relative.empty() || *relative.begin() == "..") return nullptr;
+        for (const auto& part : relative) {
+            if (part == ".") continue;
+            node = lookup(node, part);
+            if (!node) return nullptr;
+        }
+        return node;
+    }
+
+    // The child of parent called name, nullptr if there's none
+    static NodePtr child(const NodePtr& parent, const std::filesystem::path& name) {
+        for (const auto& c : parent->children()) {
+            if (c->data().name.native() == name.native()) {
+                return c;
+            }
+        }
+        return nullptr;
+    }
+
+    // Find all files with a specific hash, in no particular order when indexed
+    std::vector<NodePtr> findFilesByHash(const Digest& hash) const {
+        if (indexes_.built) {
+            std::vector<NodePtr> result;
+            auto range = indexes_.files.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                result.push_back(it->second);
+            }
+            return result;
+        }
         return findAllNodes([&hash](const NodePtr& node) {
             return !node->data().isDirectory && node->data().hash == hash;
         });
@@ -89,45 +339,324 @@ public:
     // FileSystemTree createHashAggregateTree() const {
     //     return transform<FileSystemNode>([this](const FileSystemNode& node) {
     //         if (node.isDirectory) {
-    //             return FileSystemNode(node.path, true, calculateSubtreeSize(findByPath(node.path)));
+    //             return FileSystemNode(node.name, true, calculateSubtreeSize(findByPath(node.name)));
     //         }
     //         return node;
     //     });
     // }
 
 private:
-    static void buildDirectoryTree(NodePtr& parent, const std::filesystem::path& dirPath,
-                                 Progress& progress) {
-        for (const auto& entry : std::filesystem::directory_iterator(dirPath)) {
+    // See buildIndexes. Children are keyed by the parent and the interned name.
+    struct Indexes {
+        using Key = std::pair<const ArenaNode<FileSystemNode>*, const Name::String*>;
+        struct KeyHash {
+            size_t operator()(const Key& key) const noexcept {
+                return std::hash<const void*>()(key.first) ^ (std::hash<const void*>()(key.second) * 0x9e3779b97f4a7c15ULL);
+            }
+        };
+        using Children = std::unordered_map<Key, NodePtr, KeyHash>;
+        using Files = std::unordered_multimap<Digest, NodePtr>;
+
+        bool built = false;
+        Children children;
+        Files files;
+    };
+
+    NodePtr lookup(const NodePtr& parent, const std::filesystem::path& name) const {
+        if (!indexes_.built) {
+            return child(parent, name);
+        }
+        auto pooled = Name::find(name.native());
+        if (!pooled) return nullptr;
+        auto it = indexes_.children.find({ parent, pooled });
+        return it == indexes_.children.end() ? nullptr : it->second;
+    }
+
+    // Add node and everything below it to the indexes, once it's in the tree
+    void index(const NodePtr& node) {
+        if (!indexes_.built) return;
+        const auto& data = node->data();
+        if (node->parent()) {
+            indexes_.children[{ node->parent(), &data.name.native() }] = node;
+        }
+        if (!data.isDirectory && !data.hash.empty()) {
+            indexes_.files.emplace(data.hash, node);
+        }
+        for (const auto& c : node->children()) {
+            index(c);
+        }
+    }
+
+    void unindex(const NodePtr& node) {
+        if (!indexes_.built) return;
+        const auto& data = node->data();
+        indexes_.children.erase({ node->parent(), &data.name.native() });
+        auto range = indexes_.files.equal_range(data.hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == node) {
+                indexes_.files.erase(it);
+                break;
+            }
+        }
+        for (const auto& c : node->children()) {
+            unindex(c);
+        }
+    }
+
+    // Fill in what std::filesystem doesn't tell us
+    static void readStat(FileSystemNode& node, const std::filesystem::path& path) {
+#if defined(__unix__) || defined(__APPLE__)
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0) {
+            node.device = static_cast<std::uint64_t>(st.st_dev);
+            node.inode = static_cast<std::uint64_t>(st.st_ino);
+            node.links = static_cast<std::uint32_t>(st.st_nlink);
+#if defined(__APPLE__)
+            node.mtime = st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+            node.ctime = st.st_ctimespec.tv_sec * 1000000000LL + st.st_ctimespec.tv_nsec;
+#else
+            node.mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+            node.ctime = st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+#endif
+        }
+#else
+        (void)node;
+        (void)path;
+#endif
+    }
+
+    // Carried through rebuildFromPath
+    struct Rescan {
+        bool reuseHashes;
+        std::unordered_set<uintmax_t>& changedSizes;
+        std::mutex mutex;
+
+        Rescan(bool reuse, std::unordered_set<uintmax_t>& sizes)
+            : reuseHashes(reuse), changedSizes(sizes) {}
+
+        void changed(uintmax_t size) {
+            std::lock_guard<std::mutex> lock(mutex);
+            changedSizes.insert(size);
+        }
+    };
+
+    // Carried through a parallel build: each directory below the root is listed
+    // by a task of its own. Workers never report progress (the GUI pumps its event
+    // loop from there), the thread waiting on the pool does.
+    struct Walk {
+        ThreadPool& pool;
+        std::mutex mutex;
+        std::vector<NodePtr> failed;    // Couldn't be listed, dropped once the walk is done
+
+        explicit Walk(ThreadPool& p) : pool(p) {}
+    };
+
+    static bool sameFile(const FileSystemNode& a, const FileSystemNode& b) {
+        return a.inode != 0 && a.device == b.device && a.inode == b.inode && a.size == b.size
+            && a.mtime == b.mtime && a.ctime == b.ctime;
+    }
+
+    // Take the previous scan's hash for an unchanged file, otherwise note its sizes old and new
+    static void reuse(FileSystemNode& node, const NodePtr& before, Rescan& rescan) {
+        if (before && sameFile(node, before->data())) {
+            if (rescan.reuseHashes) {
+                node.hash = before->data().hash;
+                node.hashFlags = before->data().hashFlags;
+                node.reused = true;
+            }
+            return;
+        }
+        rescan.changed(node.size);
+        if (before) {
+            rescan.changed(before->data().size);
+        }
+    }
+
+    // Every file below a node that is gone changes its size group
+    static void forget(const NodePtr& before, Rescan& rescan) {
+        if (!before->data().isDirectory) {
+            rescan.changed(before->data().size);
+        }
+        for (const auto& child : before->children()) {
+            forget(child, rescan);
+        }
+    }
+
+    static void buildRoot(const NodePtr& root, const std::filesystem::path& rootPath, Progress& progress,
+                          bool recursive, const NodePtr& previous, Rescan* rescan, unsigned threads) {
+        if (threads == 1 || !recursive) {
+            buildDirectoryTree(root, rootPath, progress, recursive, previous, rescan);
+            return;
+        }
+
+        ThreadPool pool(threads);
+        Walk walk(pool);
+        buildDirectoryTree(root, rootPath, progress, recursive, previous, rescan, &walk);
+        pool.wait([&]() {
+            std::stringstream ss;
+            ss << directoryCount + fileCount << " Scanning directories";
+            progress.report(ss.str(), 0.0);
+        });
+        for (const auto& node : walk.failed) {
+            node->parent()->removeChild(node);
+        }
+    }
+
+    // A directory below the root, listed on the pool
+    static void listDirectory(NodePtr node, const std::filesystem::path& dirPath, Progress& progress,
+                              const NodePtr& previous, Rescan* rescan, Walk* walk) {
+        try {
+            buildDirectoryTree(node, dirPath, progress, true, previous, rescan, walk);
+        }
+        catch (const std::exception&) {
+            ++errors;
+            if (rescan && previous) {
+                forget(previous, *rescan);
+            }
+            std::lock_guard<std::mutex> lock(walk->mutex);
+            walk->failed.push_back(node);
+        }
+    }
+
+    static void buildDirectoryTree(const NodePtr& parent, const std::filesystem::path& dirPath,
+                                 Progress& progress, bool recursive = true,
+                                 const NodePtr& previous = nullptr, Rescan* rescan = nullptr,
+                                 Walk* walk = nullptr) {
+        std::unordered_map<Name::String, NodePtr> before;
+        if (previous) {
+            for (auto child : previous->children()) {
+                before.emplace(child->data().name.native(), child);
+            }
+        }
+
+        // One stat per entry, relative to the open directory, see list_directory
+        std::vector<DirectoryEntry> entries;
+        const auto& dir = parent->data();
+        if (previous && dir.mtime != 0 && dir.inode == previous->data().inode
+                && dir.device == previous->data().device && dir.mtime == previous->data().mtime) {
+            std::vector<Name::String> names;
+            names.reserve(previous->childCount());
+            for (auto child : previous->children()) {
+                names.push_back(child->data().name.native());
+            }
+            list_directory(dirPath, entries, &names, recursive);
+        }
+        else {
+            list_directory(dirPath, entries, nullptr, recursive);
+        }
+
+        // Children go into the arena together once all are read, each with the
+        // node of the previous scan it replaces
+        std::vector<FileSystemNode> children;
+        std::vector<NodePtr> olds;
+        children.reserve(entries.size());
+        olds.reserve(entries.size());
+        for (const auto& entry : entries) {
+            NodePtr old = nullptr;
+            auto path = dirPath / entry.name;
             try {
-                int count = FileSystemTree::directoryCount + FileSystemTree::fileCount;
-                std::stringstream ss;
-                ss << count << " Scanning directory: " << entry.path().string();
-                progress.report(ss.str(), 0.0);
+                if (!walk) {
+                    int count = FileSystemTree::directoryCount + FileSystemTree::fileCount;
+                    std::stringstream ss;
+                    ss << count << " Scanning directory: " << path.string();
+                    progress.report(ss.str(), 0.0);
+                }
+
+                if (entry.error) {
+                    throw std::filesystem::filesystem_error("Can't stat", path,
+                                                            std::error_code(entry.error, std::system_category()));
+                }
+                if (!recursive && entry.isDirectory) {
+                    continue;
+                }
 
-                auto node = std::make_shared<NestedNode<FileSystemNode>>(
-                    FileSystemNode(entry.path(), std::filesystem::is_directory(entry.path()))
-                );
+                FileSystemNode data(entry.name, entry.isDirectory, entry.size);
+                data.device = entry.device;
+                data.inode = entry.inode;
+                data.links = entry.links;
+                data.mtime = entry.mtime;
+                data.ctime = entry.ctime;
 
-                if (std::filesystem::is_directory(entry.path())) {
+                if (rescan) {
+                    auto it = before.find(entry.name);
+                    if (it != before.end()) {
+                        old = it->second;
+                        before.erase(it);
+                        if (old->data().isDirectory != data.isDirectory) {
+                            forget(old, *rescan);
+                            old = nullptr;
+                        }
+                    }
+                }
+
+                if (data.isDirectory) {
                     ++directoryCount;
-                    buildDirectoryTree(node, entry.path(), progress);
                 } else {
                     ++fileCount;
-                    node->data().size = std::filesystem::file_size(entry.path());
+                    if (rescan) {
+                        reuse(data, old, *rescan);
+                    }
                 }
 
-                parent->addChild(node);
+                children.push_back(std::move(data));
+                olds.push_back(old);
             }
             catch (const std::exception& e) {
                 //std::cout << "Failed when scanning " << dirPath << " with " << e.what();
                 //progress.report("Failed when scanning " + entry.path().string() + " with " + e.what(), 50.0);
-                progress.report("Failed when scanning ", 50.0);
+                if (!walk) {
+                    progress.report("Failed when scanning ", 0.0);
+                }
                 //throw e;
                 ++errors;
+                if (rescan && old) {
+                    forget(old, *rescan);
+                }
+            }
+        }
+
+        // Whatever wasn't found again has gone
+        if (rescan) {
+            for (const auto& [name, old] : before) {
+                forget(old, *rescan);
+            }
+        }
+
+        size_t first = parent->childCount();
+        parent->addChildren(std::move(children));
+
+        // Only once this directory's children are all in place
+        std::vector<NodePtr> failed;
+        for (size_t i = 0; i < olds.size(); ++i) {
+            NodePtr node = parent->children()[first + i];
+            if (!node->data().isDirectory) continue;
+            auto path = dirPath / node->data().name.native();
+            if (walk) {
+                walk->pool.submit([node, old = olds[i], path = std::move(path), rescan, walk, &progress]() {
+                    listDirectory(node, path, progress, old, rescan, walk);
+                });
+                continue;
+            }
+            try {
+                buildDirectoryTree(node, path, progress, true, olds[i], rescan);
+            }
+            catch (const std::exception&) {
+                progress.report("Failed when scanning ", 0.0);
+                ++errors;
+                if (rescan && olds[i]) {
+                    forget(olds[i], *rescan);
+                }
+                failed.push_back(node);
             }
         }
+        for (const auto& node : failed) {
+            parent->removeChild(node);
+        }
     }
+
+    bool incremental_ = false;
+    std::unordered_set<uintmax_t> changedSizes_;
+    mutable Indexes indexes_;
 };
 
 } // namespace dedupe 
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "hash_cache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace dedupe {
+
+namespace {
+
+template<typename T>
+void put(char*& out, T value) {
+    std::memcpy(out, &value, sizeof(value));
+    out += sizeof(value);
+}
+
+template<typename T>
+T get(const char*& in) {
+    T value;
+    std::memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return value;
+}
+
+} // namespace
+
+HashCache::HashCache(const std::filesystem::path& file, std::size_t maxEntries, unsigned maxAge)
+    : file_(file)
+    , maxEntries_(maxEntries)
+    , maxAge_(maxAge)
+{
+    std::ifstream in(file_, std::ios::binary);
+    if (!in) {
+        return;
+    }
+
+    char header[12];
+    if (!in.read(header, sizeof(header))) {
+        throw std::runtime_error("Not a hash cache: " + file_.string());
+    }
+    const char* h = header;
+    auto magic = get<std::uint32_t>(h);
+    auto version = get<std::uint32_t>(h);
+    if (magic != MAGIC || version != VERSION) {
+        throw std::runtime_error("Not a hash cache: " + file_.string());
+    }
+    generation_ = get<std::uint32_t>(h) + 1;
+
+    char record[RECORD_SIZE];
+    while (in.read(record, sizeof(record))) {
+        const char* r = record;
+        Key key;
+        Entry entry;
+        key.device = get<std::uint64_t>(r);
+        key.inode = get<std::uint64_t>(r);
+        entry.version.size = get<std::uint64_t>(r);
+        entry.version.mtime = get<std::int64_t>(r);
+        entry.version.ctime = get<std::int64_t>(r);
+        key.params = get<std::uint64_t>(r);
+        entry.used = get<std::uint32_t>(r);
+        key.algorithm = static_cast<HashAlgorithm>(get<std::uint8_t>(r));
+        key.stage = get<std::uint8_t>(r);
+        r += 2;
+        entry.digest = Digest::fromBytes(r, Digest::SIZE);
+        entries_[key] = entry;
+    }
+}
+
+bool HashCache::lookup(const Key& key, const Version& version, Digest& digest) {
+    if (key.inode != 0) {
+        auto it = entries_.find(key);
+        if (it != entries_.end() && it->second.version == version) {
+            it->second.used = generation_;
+            digest = it->second.digest;
+            ++stats_.hits;
+            return true;
+        }
+    }
+    ++stats_.misses;
+    return false;
+}
+
+bool HashCache::contains(const Key& key, const Version& version) const {
+    auto it = entries_.find(key);
+    return key.inode != 0 && it != entries_.end() && it->second.version == version;
+}
+
+void HashCache::store(const Key& key, const Version& version, const Digest& digest) {
+    if (key.inode == 0) {
+        return;
+    }
+    entries_[key] = Entry{ version, digest, generation_ };
+    ++stats_.stored;
+}
+
+void HashCache::save() {
+    using Item = std::pair<const Key*, const Entry*>;
+    std::vector<Item> keep;
+    keep.reserve(entries_.size());
+    for (const auto& [key, entry] : entries_) {
+        if (maxAge_ == 0 || generation_ - entry.used < maxAge_) {
+            keep.emplace_back(&key, &entry);
+        }
+    }
+    if (maxEntries_ != 0 && keep.size() > maxEntries_) {
+        std::nth_element(keep.begin(), keep.begin() + maxEntries_, keep.end(), [](const Item& a, const Item& b) {
+            return a.second->used > b.second->used;
+        });
+        keep.resize(maxEntries_);
+    }
+    stats_.dropped = entries_.size() - keep.size();
+
+    // Write beside the cache and rename over it, so a crash leaves the old one intact
+    auto temp = file_;
+    temp += ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Cannot write hash cache: " + temp.string());
+        }
+        char header[12];
+        char* h = header;
+        put<std::uint32_t>(h, MAGIC);
+        put<std::uint32_t>(h, VERSION);
+        put<std::uint32_t>(h, generation_);
+        out.write(header, sizeof(header));
+
+        char record[RECORD_SIZE];
+        for (const auto& [key, entry] : keep) {
+            char* r = record;
+            put<std::uint64_t>(r, key->device);
+            put<std::uint64_t>(r, key->inode);
+            put<std::uint64_t>(r, entry->version.size);
+            put<std::int64_t>(r, entry->version.mtime);
+            put<std::int64_t>(r, entry->version.ctime);
+            put<std::uint64_t>(r, key->params);
+            put<std::uint32_t>(r, entry->used);
+            put<std::uint8_t>(r, static_cast<std::uint8_t>(key->algorithm));
+            put<std::uint8_t>(r, key->stage);
+            put<std::uint16_t>(r, 0);
+            std::memcpy(r, entry->digest.bytes.data(), Digest::SIZE);
+            out.write(record, sizeof(record));
+        }
+        if (!out) {
+            throw std::runtime_error("Cannot write hash cache: " + temp.string());
+        }
+    }
+    std::filesystem::rename(temp, file_);
+
+    // Carry on as the next generation, without the dropped entries
+    std::unordered_map<Key, Entry, KeyHash> kept;
+    for (const auto& [key, entry] : keep) {
+        kept.emplace(*key, *entry);
+    }
+    entries_ = std::move(kept);
+    ++generation_;
+}
+
+} // namespace dedupe
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+#include "digest.hpp"
+#include "hasher.hpp"
+
+namespace dedupe {
+
+// Digests from earlier runs, kept in a file of fixed-size records. An entry is
+// found by where the file lives (device, inode) and what was hashed (algorithm,
+// stage and its parameters), and only counts while size, mtime and ctime still
+// match. Any write to a file moves its ctime, so a hit means the content is
+// unchanged.
+//
+// The whole cache is held in memory and save() rewrites the file. Entries not
+// used for maxAge saves are dropped, and past maxEntries the least recently used
+// go first. Not thread safe, the finder only touches it from its own thread.
+class HashCache {
+public:
+    struct Key {
+        std::uint64_t device = 0;
+        std::uint64_t inode = 0;
+        HashAlgorithm algorithm = HashAlgorithm::Sha256;
+        std::uint8_t stage = 0;
+        std::uint64_t params = 0;   // Anything else that changes the digest, e.g. block sizes
+
+        bool operator==(const Key& other) const {
+            return device == other.device && inode == other.inode && algorithm == other.algorithm
+                && stage == other.stage && params == other.params;
+        }
+    };
+
+    // What the file looked like when it was hashed
+    struct Version {
+        std::uint64_t size = 0;
+        std::int64_t mtime = 0;     // Nanoseconds
+        std::int64_t ctime = 0;
+
+        bool operator==(const Version& other) const {
+            return size == other.size && mtime == other.mtime && ctime == other.ctime;
+        }
+    };
+
+    struct Stats {
+        std::uintmax_t hits = 0;
+        std::uintmax_t misses = 0;
+        std::uintmax_t stored = 0;
+        std::uintmax_t dropped = 0;     // By the last save
+
+        double hitRate() const {
+            auto lookups = hits + misses;
+            return lookups ? static_cast<double>(hits) / static_cast<double>(lookups) : 0.0;
+        }
+    };
+
+    // Loads the cache, a missing file is an empty cache. Throws if the file
+    // isn't a cache; a record cut short by a crash is ignored.
+    explicit HashCache(const std::filesystem::path& file, std::size_t maxEntries = 0, unsigned maxAge = 0);
+
+    // Files without an inode can't be cached, lookups on them always miss
+    bool lookup(const Key& key, const Version& version, Digest& digest);
+    void store(const Key& key, const Version& version, const Digest& digest);
+    // Like lookup, without counting towards the stats or marking the entry used
+    bool contains(const Key& key, const Version& version) const;
+
+    // Write the cache back, dropping expired and excess entries
+    void save();
+
+    std::size_t size() const { return entries_.size(); }
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct KeyHash {
+        std::size_t operator()(const Key& k) const noexcept {
+            std::uint64_t h = k.device * 0x9e3779b97f4a7c15ULL;
+            h ^= k.inode + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            h ^= k.params + (static_cast<std::uint64_t>(k.algorithm) << 8 | k.stage) + (h << 6) + (h >> 2);
+            return static_cast<std::size_t>(h);
+        }
+    };
+
+    struct Entry {
+        Version version;
+        Digest digest;
+        std::uint32_t used;     // Generation of the save it was last used before
+    };
+
+    static constexpr std::uint32_t MAGIC = 0x43484444;  // "DDHC"
+    static constexpr std::uint32_t VERSION = 1;
+    // device, inode, size, mtime, ctime, params, used, algorithm, stage, padding, digest
+    static constexpr std::size_t RECORD_SIZE = 6 * 8 + 4 + 1 + 1 + 2 + Digest::SIZE;
+
+    std::filesystem::path file_;
+    std::size_t maxEntries_;
+    unsigned maxAge_;
+    std::uint32_t generation_ = 1;
+    std::unordered_map<Key, Entry, KeyHash> entries_;
+    Stats stats_;
+};
+
+} // namespace dedupe
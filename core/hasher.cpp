@@ -1,36 +1,181 @@
 #include "hasher.hpp"
+#include "io_uring.hpp"
+#include <algorithm>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <sstream>
-#include <iomanip>
+#include <new>
+#include <stdexcept>
 #include <openssl/sha.h>
+#include <xxhash.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DEDUPE_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace dedupe {
 
-std::string Hasher::hash_file(const std::filesystem::path& file_path,
-                            Progress& progress, bool quick) {
+namespace {
+
+class Sha256Context : public HashContext {
+public:
+    Sha256Context() { SHA256_Init(&sha256_); }
+
+    void update(const void* data, std::size_t length) override {
+        SHA256_Update(&sha256_, data, length);
+    }
+
+    Digest final() override {
+        Digest digest;
+        SHA256_Final(digest.bytes.data(), &sha256_);
+        return digest;
+    }
+
+private:
+    SHA256_CTX sha256_;
+};
+
+class Xxh3Context : public HashContext {
+public:
+    Xxh3Context() : state_(XXH3_createState()) {
+        if (!state_) {
+            throw std::bad_alloc();
+        }
+        XXH3_128bits_reset(state_);
+    }
+
+    ~Xxh3Context() override { XXH3_freeState(state_); }
+
+    void update(const void* data, std::size_t length) override {
+        XXH3_128bits_update(state_, data, length);
+    }
+
+    Digest final() override {
+        // Canonical form is big endian, the same bytes on every platform
+        XXH128_canonical_t canonical;
+        XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(state_));
+        return Digest::fromBytes(canonical.digest, sizeof(canonical.digest));
+    }
+
+private:
+    XXH3_state_t* state_;
+};
+
+} // namespace
+
+const char* algorithm_name(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::Sha256:
+            return "sha256";
+        case HashAlgorithm::Xxh3_128:
+            return "xxh3-128";
+    }
+    return "unknown";
+}
+
+std::size_t digest_size(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::Sha256:
+            return SHA256_DIGEST_LENGTH;
+        case HashAlgorithm::Xxh3_128:
+            return sizeof(XXH128_canonical_t);
+    }
+    return Digest::SIZE;
+}
+
+bool parse_algorithm(const std::string& name, HashAlgorithm& algorithm) {
+    for (auto a : { HashAlgorithm::Sha256, HashAlgorithm::Xxh3_128 }) {
+        if (name == algorithm_name(a)) {
+            algorithm = a;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::unique_ptr<HashContext> HashContext::create(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::Sha256:
+            return std::make_unique<Sha256Context>();
+        case HashAlgorithm::Xxh3_128:
+            return std::make_unique<Xxh3Context>();
+    }
+    throw std::invalid_argument("Unknown hash algorithm");
+}
+
+Digest Hasher::hash_file(const std::filesystem::path& file_path,
+                            Progress& progress, bool quick, ReadMode mode,
+                            HashAlgorithm algorithm) {
     if (!std::filesystem::exists(file_path)) {
         throw std::runtime_error("File does not exist: " + file_path.string());
     }
 
-    return hash_content(file_path, progress, quick);
+    return hash_content(file_path, progress, quick, mode, algorithm);
 }
 
-std::string Hasher::hash_content(const std::filesystem::path& file_path,
-    Progress& progress, bool quick) {
+Digest Hasher::hash_content(const std::filesystem::path& file_path,
+    Progress& progress, bool quick, ReadMode mode, HashAlgorithm algorithm) {
+    // A quick hash is a single small read, not worth a mapping
+    if (mode == ReadMode::Mapped && !quick) {
+        Digest hash;
+        if (hash_mapped(file_path, progress, algorithm, hash)) {
+            return hash;
+        }
+    }
+
     std::ifstream file(file_path, std::ios::binary);
     if (!file) {
         throw std::runtime_error("Cannot open file: " + file_path.string());
     }
-    return hash_stream(file, progress, quick);
+    return hash_stream(file, progress, quick, algorithm);
 }
 
 
 
-std::string Hasher::hash_stream(std::istream& file, 
-    Progress& progress, bool quick) {
+Digest Hasher::hash_ranges(const std::filesystem::path& file_path, Progress& progress,
+                           const std::vector<ByteRange>& ranges, HashAlgorithm algorithm,
+                           std::uint64_t salt) {
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file: " + file_path.string());
+    }
+
+    auto context = HashContext::create(algorithm);
+    unsigned char prefix[sizeof(salt)];
+    for (std::size_t i = 0; i < sizeof(salt); i++) {
+        prefix[i] = static_cast<unsigned char>(salt >> (8 * i));
+    }
+    context->update(prefix, sizeof(prefix));
+
+    std::vector<char> buffer(BUFFER_SIZE);
+    for (const auto& range : ranges) {
+        if (progress.is_cancelled()) {
+            return Digest();
+        }
+        file.seekg(static_cast<std::streamoff>(range.offset));
+        std::uintmax_t remaining = range.length;
+        while (remaining > 0) {
+            auto want = static_cast<std::streamsize>(std::min<std::uintmax_t>(BUFFER_SIZE, remaining));
+            file.read(buffer.data(), want);
+            if (file.gcount() != want) {
+                throw std::runtime_error("Short read: " + file_path.string());
+            }
+            context->update(buffer.data(), static_cast<std::size_t>(want));
+            remaining -= static_cast<std::uintmax_t>(want);
+        }
+    }
+    return context->final();
+}
+
+Digest Hasher::hash_stream(std::istream& file, 
+    Progress& progress, bool quick, HashAlgorithm algorithm) {
 
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
+    auto context = HashContext::create(algorithm);
 
     std::vector<char> buffer(BUFFER_SIZE);
     std::uintmax_t total_read = 0;
@@ -38,10 +183,10 @@ std::string Hasher::hash_stream(std::istream& file,
 
     while (file.read(buffer.data(), BUFFER_SIZE)) {
         if (progress.is_cancelled()) {
-            return "";
+            return Digest();
         }
 
-        SHA256_Update(&sha256, buffer.data(), file.gcount());
+        context->update(buffer.data(), file.gcount());
         total_read += file.gcount();
 
         //if (file_size > 0) {
@@ -55,31 +200,350 @@ std::string Hasher::hash_stream(std::istream& file,
     }
 
     if (!quick && file.gcount() > 0) {
-        SHA256_Update(&sha256, buffer.data(), file.gcount());
+        context->update(buffer.data(), file.gcount());
     }
 
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_Final(hash, &sha256);
+    return context->final();
+}
+
+std::vector<Chunk> Hasher::chunk_stream(std::istream& file, Progress& progress,
+                                        const ChunkParams& params, HashAlgorithm algorithm) {
+    Chunker chunker(params);
+    std::vector<Chunk> chunks;
+    std::vector<std::uint8_t> buffer(std::max(CHUNK_BUFFER, 2 * params.maxSize));
+    std::uintmax_t offset = 0;
+    std::size_t start = 0;
+    std::size_t end = 0;
+    bool eof = false;
 
-    std::stringstream ss;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
+    while (true) {
+        // Keep a whole max chunk ahead of each cut until the stream runs out
+        if (!eof && end - start < params.maxSize) {
+            if (progress.is_cancelled()) {
+                return chunks;
+            }
+            std::memmove(buffer.data(), buffer.data() + start, end - start);
+            end -= start;
+            start = 0;
+            file.read(reinterpret_cast<char*>(buffer.data() + end), static_cast<std::streamsize>(buffer.size() - end));
+            end += static_cast<std::size_t>(file.gcount());
+            eof = !file;
+            continue;
+        }
+        if (start == end) {
+            break;
+        }
+
+        std::size_t length = chunker.cut(buffer.data() + start, end - start);
+        auto context = HashContext::create(algorithm);
+        context->update(buffer.data() + start, length);
+        chunks.push_back(Chunk{ offset, static_cast<std::uint32_t>(length), context->final() });
+        offset += length;
+        start += length;
     }
+    return chunks;
+}
 
-    return ss.str();
+std::vector<Chunk> Hasher::chunk_file(const std::filesystem::path& file_path, Progress& progress,
+                                      const ChunkParams& params, HashAlgorithm algorithm) {
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file: " + file_path.string());
+    }
+    auto chunks = chunk_stream(file, progress, params, algorithm);
+    if (file.bad()) {
+        throw std::runtime_error("Read failed: " + file_path.string());
+    }
+    return chunks;
+}
+
+bool Hasher::mapping_supported() {
+#ifdef DEDUPE_HAVE_MMAP
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Hasher::uring_supported() {
+    static const bool supported = IoUring::create(1) != nullptr;
+    return supported;
+}
+
+std::vector<FileDigest> Hasher::hash_files(const std::vector<std::filesystem::path>& files,
+                                           Progress& progress, ReadMode mode,
+                                           HashAlgorithm algorithm, unsigned queue_depth) {
+    std::vector<FileDigest> results(files.size());
+    if (mode == ReadMode::Uring && hash_uring(files, progress, algorithm, queue_depth, results)) {
+        return results;
+    }
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        if (progress.is_cancelled()) break;
+        try {
+            results[i].digest = hash_content(files[i], progress, false, mode, algorithm);
+        }
+        catch (const std::exception& e) {
+            results[i].error = e.what();
+        }
+    }
+    return results;
 }
 
-std::string Hasher::hash_string(std::string& str, Progress &progress) {
+bool Hasher::hash_mapped(const std::filesystem::path& file_path, Progress& progress,
+                         HashAlgorithm algorithm, Digest& hash) {
+#ifdef DEDUPE_HAVE_MMAP
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Pipes, devices and empty files can't be mapped, stream those
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    auto context = HashContext::create(algorithm);
+
+    // Map a window at a time so huge files don't need contiguous address space.
+    // MAP_WINDOW is a multiple of any page size so offsets stay aligned.
+    // Note a file truncated while mapped raises SIGBUS, which is why Stream stays the default.
+    const std::uintmax_t file_size = static_cast<std::uintmax_t>(st.st_size);
+    for (std::uintmax_t offset = 0; offset < file_size; offset += MAP_WINDOW) {
+        std::size_t length = static_cast<std::size_t>(std::min<std::uintmax_t>(MAP_WINDOW, file_size - offset));
+        void* addr = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(offset));
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        ::madvise(addr, length, MADV_SEQUENTIAL);
+
+        const unsigned char* data = static_cast<const unsigned char*>(addr);
+        for (std::size_t done = 0; done < length; done += MAP_CHUNK) {
+            if (progress.is_cancelled()) {
+                ::munmap(addr, length);
+                ::close(fd);
+                hash.clear();
+                return true;
+            }
+            context->update(data + done, std::min(MAP_CHUNK, length - done));
+        }
+        ::munmap(addr, length);
+    }
+    ::close(fd);
+
+    hash = context->final();
+    return true;
+#else
+    (void)file_path;
+    (void)progress;
+    (void)algorithm;
+    (void)hash;
+    return false;
+#endif
+}
+
+Digest Hasher::hash_string(std::string& str, Progress &progress, HashAlgorithm algorithm) {
     std::stringstream ss{ str };
-    return hash_stream(ss, progress);
+    return hash_stream(ss, progress, false, algorithm);
 }
 
-std::string Hasher::fake_size_hash(uintmax_t size) {
-    std::stringstream ss;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(size);
+Digest Hasher::hash_digests(const std::vector<Digest>& digests, HashAlgorithm algorithm) {
+    auto context = HashContext::create(algorithm);
+    for (const auto& d : digests) {
+        context->update(d.bytes.data(), d.bytes.size());
+    }
+    return context->final();
+}
+
+// Stand-in for files that never needed hashing: unique within their size. The
+// marker byte keeps size 0 from looking like an empty digest.
+Digest Hasher::fake_size_hash(uintmax_t size) {
+    Digest digest;
+    for (std::size_t i = 0; i < sizeof(size); i++) {
+        digest.bytes[i] = static_cast<std::uint8_t>(size >> (8 * i));
+    }
+    digest.bytes[Digest::SIZE - 1] = 0xff;
+    return digest;
+}
+
+// Every slot is one registered buffer with at most one read in flight. Slots go
+// round robin to the open files, so one big file can have several reads queued
+// while many small ones get one each. A file's blocks are digested in order as
+// their reads complete.
+bool Hasher::hash_uring(const std::vector<std::filesystem::path>& files, Progress& progress,
+                        HashAlgorithm algorithm, unsigned queue_depth, std::vector<FileDigest>& results) {
+#ifdef DEDUPE_HAVE_MMAP
+    if (queue_depth == 0) queue_depth = 1;
+
+    struct Stream {
+        std::size_t file;
+        int fd;
+        std::uintmax_t size;
+        std::uintmax_t submitted;
+        std::unique_ptr<HashContext> context;
+        std::deque<unsigned> slots;     // Reads in offset order
+        bool failed;
+    };
+    struct Slot {
+        Stream* stream = nullptr;
+        unsigned length = 0;
+        int result = 0;
+        bool ready = false;
+    };
+
+    // Declared before the ring so it goes first, nothing may still read into them
+    struct AlignedDelete {
+        void operator()(char* p) const { ::operator delete[](p, std::align_val_t(4096)); }
+    };
+    std::unique_ptr<char[], AlignedDelete> memory(
+        static_cast<char*>(::operator new[](queue_depth * URING_BLOCK, std::align_val_t(4096))));
+
+    auto ring = IoUring::create(queue_depth);
+    if (!ring) {
+        return false;
+    }
+    std::vector<std::pair<void*, std::size_t>> buffers;
+    for (unsigned i = 0; i < queue_depth; ++i) {
+        buffers.emplace_back(memory.get() + i * URING_BLOCK, URING_BLOCK);
+    }
+    ring->registerBuffers(buffers);
+
+    std::vector<Slot> slots(queue_depth);
+    std::vector<unsigned> idle;
+    for (unsigned i = queue_depth; i > 0; --i) {
+        idle.push_back(i - 1);
+    }
+    std::vector<std::unique_ptr<Stream>> streams;
+    std::size_t next = 0;
+    unsigned in_flight = 0;
+    bool cancelled = false;
+    std::vector<IoUring::Completion> completions;
+
+    auto finish = [&](Stream& s) {
+        ::close(s.fd);
+        if (!s.failed && !cancelled) {
+            results[s.file].digest = s.context->final();
+        }
+    };
+
+    for (;;) {
+        if (!cancelled && progress.is_cancelled()) {
+            cancelled = true;
+        }
+        if (!cancelled) {
+            // Keep up to queue_depth files open
+            while (streams.size() < queue_depth && next < files.size()) {
+                std::size_t i = next++;
+                int fd = ::open(files[i].c_str(), O_RDONLY);
+                if (fd < 0) {
+                    results[i].error = "Cannot open file: " + files[i].string();
+                    continue;
+                }
+                struct stat st;
+                if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                    // Pipes and devices have no size to split into reads, stream them
+                    ::close(fd);
+                    try {
+                        results[i].digest = hash_content(files[i], progress, false, ReadMode::Stream, algorithm);
+                    }
+                    catch (const std::exception& e) {
+                        results[i].error = e.what();
+                    }
+                    continue;
+                }
+                auto s = std::make_unique<Stream>(Stream{ i, fd, static_cast<std::uintmax_t>(st.st_size), 0,
+                                                          HashContext::create(algorithm), {}, false });
+                if (s->size == 0) {
+                    finish(*s);
+                    continue;
+                }
+                streams.push_back(std::move(s));
+            }
+
+            // Hand idle slots round robin to files with bytes left to request
+            bool queued = true;
+            while (!idle.empty() && queued) {
+                queued = false;
+                for (auto& s : streams) {
+                    if (idle.empty()) break;
+                    if (s->failed || s->submitted >= s->size) continue;
+                    unsigned slot = idle.back();
+                    auto length = static_cast<unsigned>(std::min<std::uintmax_t>(URING_BLOCK, s->size - s->submitted));
+                    if (!ring->queueRead(s->fd, memory.get() + slot * URING_BLOCK, length, s->submitted, slot, slot)) {
+                        break;
+                    }
+                    idle.pop_back();
+                    slots[slot] = Slot{ s.get(), length, 0, false };
+                    s->slots.push_back(slot);
+                    s->submitted += length;
+                    ++in_flight;
+                    queued = true;
+                }
+            }
+        }
+
+        if (in_flight == 0) {
+            if (cancelled || next >= files.size()) break;
+            continue;
+        }
+
+        completions.clear();
+        ring->submitAndWait(completions);
+        for (const auto& c : completions) {
+            auto& slot = slots[c.tag];
+            slot.result = c.result;
+            slot.ready = true;
+            --in_flight;
+
+            Stream& s = *slot.stream;
+            if (!s.failed && c.result < 0) {
+                s.failed = true;
+                results[s.file].error = "Read failed: " + files[s.file].string() + ": " + std::strerror(-c.result);
+            }
+            else if (!s.failed && static_cast<unsigned>(c.result) != slot.length) {
+                // Regular files only come up short when they shrink underneath us
+                s.failed = true;
+                results[s.file].error = "Short read: " + files[s.file].string();
+            }
+
+            while (!s.slots.empty() && slots[s.slots.front()].ready) {
+                unsigned done = s.slots.front();
+                s.slots.pop_front();
+                if (!s.failed && !cancelled) {
+                    s.context->update(memory.get() + done * URING_BLOCK, slots[done].length);
+                }
+                idle.push_back(done);
+            }
+        }
+
+        // Retire files that are fully digested, or failed with nothing left in flight
+        for (auto it = streams.begin(); it != streams.end();) {
+            Stream& s = **it;
+            bool finished = s.slots.empty() && (s.failed || cancelled || s.submitted >= s.size);
+            if (finished) {
+                finish(s);
+                it = streams.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    for (auto& s : streams) {
+        finish(*s);
     }
-    return ss.str();
+    return true;
+#else
+    (void)files;
+    (void)progress;
+    (void)algorithm;
+    (void)queue_depth;
+    (void)results;
+    return false;
+#endif
 }
 
-} // namespace dedupe 
\ No newline at end of file
+} // namespace dedupe
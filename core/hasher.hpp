@@ -1,27 +1,134 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <memory>
+#include <vector>
 #include <filesystem>
+#include "chunker.hpp"
+#include "digest.hpp"
 #include "progress.hpp"
 
 namespace dedupe {
 
+// Digest algorithms. Values are stable, they are written to results and caches.
+enum class HashAlgorithm : std::uint8_t {
+    Sha256 = 0,     // OpenSSL SHA-256, cryptographic
+    Xxh3_128 = 1    // xxHash XXH3 128-bit, several times faster, fine for grouping candidates
+};
+
+const char* algorithm_name(HashAlgorithm algorithm);
+// Bytes of Digest the algorithm fills
+std::size_t digest_size(HashAlgorithm algorithm);
+// Accepts the names returned by algorithm_name, returns false for anything else
+bool parse_algorithm(const std::string& name, HashAlgorithm& algorithm);
+
+// Part of a file, see Hasher::hash_ranges
+struct ByteRange {
+    std::uintmax_t offset;
+    std::uintmax_t length;
+};
+
+// A content-defined chunk of a file, see Hasher::chunk_stream
+struct Chunk {
+    std::uintmax_t offset;
+    std::uint32_t length;
+    Digest digest;
+};
+
+// Incremental digest, one implementation per HashAlgorithm
+class HashContext {
+public:
+    virtual ~HashContext() = default;
+    virtual void update(const void* data, std::size_t length) = 0;
+    // The context can't be updated afterwards
+    virtual Digest final() = 0;
+
+    static std::unique_ptr<HashContext> create(HashAlgorithm algorithm);
+};
+
+// How file content is fed to the digest
+enum class ReadMode {
+    Stream,     // std::ifstream into a small buffer
+    Mapped,     // mmap windows and hash straight from the page cache, POSIX only
+    Uring       // Batches only: io_uring reads kept in flight across files, Linux only.
+                // Single files are streamed.
+};
+
+// Result of hashing one file of a batch, error is set instead if it couldn't be read
+struct FileDigest {
+    Digest digest;
+    std::string error;
+};
+
 class Hasher {
 public:
-    // Calculate SHA-256 hash of a file
-    static std::string hash_file(const std::filesystem::path& file_path,
-                                 Progress& progress, bool quick = false);
+    // Calculate hash of a file, SHA-256 unless another algorithm is asked for
+    static Digest hash_file(const std::filesystem::path& file_path,
+                                 Progress& progress, bool quick = false,
+                                 ReadMode mode = ReadMode::Stream,
+                                 HashAlgorithm algorithm = HashAlgorithm::Sha256);
 
     // Calculate hash of file content
-    static std::string hash_content(const std::filesystem::path& file_path,
-                                  Progress& progress, bool quick = false);
+    static Digest hash_content(const std::filesystem::path& file_path,
+                                  Progress& progress, bool quick = false,
+                                  ReadMode mode = ReadMode::Stream,
+                                  HashAlgorithm algorithm = HashAlgorithm::Sha256);
 
-    static std::string hash_stream(std::istream& file, Progress& progress, bool quick = false);
-    static std::string hash_string(std::string &str, Progress& progress);
-    static std::string fake_size_hash(uintmax_t size);
+    // Hash only the given ranges, in order. The salt is digested first so partial
+    // digests can never equal a whole-file digest, and callers can keep digests
+    // of different sizes or sampling schemes apart.
+    static Digest hash_ranges(const std::filesystem::path& file_path, Progress& progress,
+                              const std::vector<ByteRange>& ranges,
+                              HashAlgorithm algorithm = HashAlgorithm::Sha256,
+                              std::uint64_t salt = 0);
+
+    static Digest hash_stream(std::istream& file, Progress& progress, bool quick = false,
+                                   HashAlgorithm algorithm = HashAlgorithm::Sha256);
+    // Cut the stream into content-defined chunks with Chunker and digest each
+    // one. Chunks are returned in order and cover the stream; an empty stream has
+    // none. Returns what was chunked so far if cancelled.
+    static std::vector<Chunk> chunk_stream(std::istream& file, Progress& progress,
+                                           const ChunkParams& params = ChunkParams(),
+                                           HashAlgorithm algorithm = HashAlgorithm::Sha256);
+    static std::vector<Chunk> chunk_file(const std::filesystem::path& file_path, Progress& progress,
+                                         const ChunkParams& params = ChunkParams(),
+                                         HashAlgorithm algorithm = HashAlgorithm::Sha256);
+    static Digest hash_string(std::string &str, Progress& progress,
+                              HashAlgorithm algorithm = HashAlgorithm::Sha256);
+    // Hash of the raw bytes of a sequence of digests, e.g. a directory's sorted children
+    static Digest hash_digests(const std::vector<Digest>& digests,
+                               HashAlgorithm algorithm = HashAlgorithm::Sha256);
+    static Digest fake_size_hash(uintmax_t size);
+
+    // Hash whole files as one batch, results line up with files. With ReadMode::Uring
+    // up to queue_depth reads are kept in flight across the files through one ring;
+    // without io_uring, or in other modes, each file is hashed in turn.
+    // Digests are left empty if cancelled.
+    static std::vector<FileDigest> hash_files(const std::vector<std::filesystem::path>& files,
+                                              Progress& progress, ReadMode mode = ReadMode::Uring,
+                                              HashAlgorithm algorithm = HashAlgorithm::Sha256,
+                                              unsigned queue_depth = 32);
+
+    // True if hash_content can actually use ReadMode::Mapped on this platform
+    static bool mapping_supported();
+    // True if hash_files can actually use ReadMode::Uring, i.e. it was compiled in
+    // and the kernel hands out rings
+    static bool uring_supported();
 
 private:
+    // Returns false if the file can't be mapped and the caller should stream it instead
+    static bool hash_mapped(const std::filesystem::path& file_path, Progress& progress,
+                            HashAlgorithm algorithm, Digest& hash);
+    // Returns false if no ring could be set up and the caller should hash file by file
+    static bool hash_uring(const std::vector<std::filesystem::path>& files, Progress& progress,
+                           HashAlgorithm algorithm, unsigned queue_depth, std::vector<FileDigest>& results);
+
     static constexpr std::size_t BUFFER_SIZE = 8192; // 8KB buffer for reading
+    static constexpr std::size_t MAP_WINDOW = 64 * 1024 * 1024; // Mapped at a time, keeps 32-bit address space happy
+    static constexpr std::size_t MAP_CHUNK = 1024 * 1024; // Digest update size between cancellation checks
+    static constexpr std::size_t URING_BLOCK = 256 * 1024; // Bytes per io_uring read
+    static constexpr std::size_t CHUNK_BUFFER = 4 * 1024 * 1024; // Read at a time by chunk_stream, at least a max chunk more
 };
 
-} // namespace dedupe 
\ No newline at end of file
+} // namespace dedupe
@@ -0,0 +1,202 @@
+#include "io_uring.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define DEDUPE_HAVE_IO_URING 1
+#endif
+#endif
+
+namespace dedupe {
+
+#ifdef DEDUPE_HAVE_IO_URING
+
+// The shared rings. Head and tail indices are written by one side and read by the
+// other, hence the acquire/release accesses.
+struct IoUring::Ring {
+    int fd = -1;
+    void* sqRing = MAP_FAILED;
+    std::size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    std::size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    std::size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    unsigned queued = 0;
+    bool registered = false;
+    // READV needs an iovec per submission slot that outlives the submit
+    std::vector<iovec> iovecs;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) ::munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) ::munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) ::munmap(sqRing, sqRingSize);
+        if (fd >= 0) ::close(fd);
+    }
+};
+
+std::unique_ptr<IoUring> IoUring::create(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    auto ring = std::make_unique<Ring>();
+    ring->fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ring->fd < 0) {
+        return nullptr;
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        ring->sqRingSize = ring->cqRingSize = std::max(ring->sqRingSize, ring->cqRingSize);
+    }
+    ring->sqRing = ::mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        return nullptr;
+    }
+    ring->cqRing = single ? ring->sqRing
+        : ::mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED) {
+        return nullptr;
+    }
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES));
+    if (ring->sqes == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto sq = static_cast<char*>(ring->sqRing);
+    auto cq = static_cast<char*>(ring->cqRing);
+    ring->sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqEntries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    ring->iovecs.resize(ring->sqEntries);
+
+    return std::unique_ptr<IoUring>(new IoUring(std::move(ring)));
+}
+
+bool IoUring::registerBuffers(const std::vector<std::pair<void*, std::size_t>>& buffers) {
+    std::vector<iovec> iovs;
+    for (const auto& [data, size] : buffers) {
+        iovs.push_back({ data, size });
+    }
+    ring_->registered = ::syscall(__NR_io_uring_register, ring_->fd, IORING_REGISTER_BUFFERS,
+                                  iovs.data(), static_cast<unsigned>(iovs.size())) == 0;
+    return ring_->registered;
+}
+
+bool IoUring::queueRead(int fd, void* buffer, unsigned length, std::uint64_t offset,
+                        unsigned bufferIndex, std::uint64_t tag) {
+    auto& r = *ring_;
+    unsigned head = __atomic_load_n(r.sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *r.sqTail + r.queued;
+    if (tail - head >= r.sqEntries) {
+        return false;
+    }
+
+    unsigned index = tail & r.sqMask;
+    io_uring_sqe& sqe = r.sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.fd = fd;
+    sqe.off = offset;
+    sqe.user_data = tag;
+    if (r.registered) {
+        sqe.opcode = IORING_OP_READ_FIXED;
+        sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+        sqe.len = length;
+        sqe.buf_index = static_cast<std::uint16_t>(bufferIndex);
+    }
+    else {
+        r.iovecs[index] = { buffer, length };
+        sqe.opcode = IORING_OP_READV;
+        sqe.addr = reinterpret_cast<std::uint64_t>(&r.iovecs[index]);
+        sqe.len = 1;
+    }
+    r.sqArray[index] = index;
+    ++r.queued;
+    return true;
+}
+
+void IoUring::submitAndWait(std::vector<Completion>& completions) {
+    auto& r = *ring_;
+    unsigned submit = r.queued;
+    if (submit > 0) {
+        __atomic_store_n(r.sqTail, *r.sqTail + submit, __ATOMIC_RELEASE);
+        r.queued = 0;
+    }
+
+    for (;;) {
+        long ret = ::syscall(__NR_io_uring_enter, r.fd, submit, 1u, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret >= 0) break;
+        if (errno == EINTR) {
+            // Entries the kernel already consumed don't need submitting again
+            submit = *r.sqTail - __atomic_load_n(r.sqHead, __ATOMIC_ACQUIRE);
+            continue;
+        }
+        throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+    }
+
+    unsigned head = *r.cqHead;
+    unsigned tail = __atomic_load_n(r.cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = r.cqes[head & r.cqMask];
+        completions.push_back({ cqe.user_data, cqe.res });
+    }
+    __atomic_store_n(r.cqHead, head, __ATOMIC_RELEASE);
+}
+
+#else
+
+struct IoUring::Ring {};
+
+std::unique_ptr<IoUring> IoUring::create(unsigned) {
+    return nullptr;
+}
+
+bool IoUring::registerBuffers(const std::vector<std::pair<void*, std::size_t>>&) {
+    return false;
+}
+
+bool IoUring::queueRead(int, void*, unsigned, std::uint64_t, unsigned, std::uint64_t) {
+    return false;
+}
+
+void IoUring::submitAndWait(std::vector<Completion>&) {
+    throw std::runtime_error("io_uring is not supported on this platform");
+}
+
+#endif
+
+IoUring::IoUring(std::unique_ptr<Ring> ring) : ring_(std::move(ring)) {}
+
+IoUring::~IoUring() = default;
+
+} // namespace dedupe
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace dedupe {
+
+// Just enough io_uring for batched reads. Talks to the kernel through the raw
+// syscalls so there is no liburing dependency; on other platforms, or kernels
+// without io_uring, create() returns nullptr and callers read the usual way.
+class IoUring {
+public:
+    struct Completion {
+        std::uint64_t tag;
+        int result;     // Bytes read, or -errno
+    };
+
+    // nullptr if io_uring isn't compiled in or the kernel refuses a ring
+    // (too old, blocked by seccomp or the io_uring_disabled sysctl)
+    static std::unique_ptr<IoUring> create(unsigned entries);
+
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Register read buffers with the kernel so it can skip pinning them on every
+    // read. Returns false if refused (e.g. RLIMIT_MEMLOCK), reads still work unregistered.
+    bool registerBuffers(const std::vector<std::pair<void*, std::size_t>>& buffers);
+
+    // Queue a read into buffers[bufferIndex] when registered, else into buffer.
+    // Returns false when the submission queue is full.
+    bool queueRead(int fd, void* buffer, unsigned length, std::uint64_t offset,
+                   unsigned bufferIndex, std::uint64_t tag);
+
+    // Submit everything queued and wait for at least one completion, appending
+    // all available completions. Throws on ring errors.
+    void submitAndWait(std::vector<Completion>& completions);
+
+private:
+    struct Ring;
+    explicit IoUring(std::unique_ptr<Ring> ring);
+
+    std::unique_ptr<Ring> ring_;
+};
+
+} // namespace dedupe
@@ -0,0 +1,102 @@
+#include "layout.hpp"
+#include <cstring>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace dedupe {
+
+bool physical_offset(const std::filesystem::path& path, std::uint64_t& offset) {
+#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Room for the first extent only
+    std::vector<char> buffer(sizeof(fiemap) + sizeof(fiemap_extent));
+    auto map = reinterpret_cast<fiemap*>(buffer.data());
+    map->fm_start = 0;
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_flags = 0;
+    map->fm_extent_count = 1;
+    bool ok = ::ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0
+        && !(map->fm_extents[0].fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC));
+    ::close(fd);
+    if (ok) {
+        offset = map->fm_extents[0].fe_physical;
+    }
+    return ok;
+#else
+    (void)path;
+    (void)offset;
+    return false;
+#endif
+}
+
+std::uint64_t shared_extents_key(const std::filesystem::path& path) {
+#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    // A batch of extents at a time until the last one comes back
+    const unsigned batch = 64;
+    std::vector<char> buffer(sizeof(fiemap) + batch * sizeof(fiemap_extent));
+    auto map = reinterpret_cast<fiemap*>(buffer.data());
+    std::uint64_t key = 0xcbf29ce484222325ULL;
+    std::uint64_t start = 0;
+    bool shared = true, last = false;
+    while (shared && !last) {
+        std::memset(map, 0, sizeof(fiemap));
+        map->fm_start = start;
+        map->fm_length = FIEMAP_MAX_OFFSET - start;
+        map->fm_flags = FIEMAP_FLAG_SYNC;
+        map->fm_extent_count = batch;
+        if (::ioctl(fd, FS_IOC_FIEMAP, map) != 0 || map->fm_mapped_extents == 0) {
+            shared = false;
+            break;
+        }
+        for (unsigned i = 0; i < map->fm_mapped_extents; ++i) {
+            const auto& extent = map->fm_extents[i];
+            if (!(extent.fe_flags & FIEMAP_EXTENT_SHARED)
+                    || (extent.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC))) {
+                shared = false;
+                break;
+            }
+            for (auto value : { extent.fe_logical, extent.fe_physical, extent.fe_length }) {
+                key = (key ^ value) * 0x100000001b3ULL;
+            }
+            last = (extent.fe_flags & FIEMAP_EXTENT_LAST) != 0;
+            start = extent.fe_logical + extent.fe_length;
+        }
+    }
+    ::close(fd);
+    return shared && key != 0 ? key : 0;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
+LayoutKey layout_key(const std::filesystem::path& path, std::uint64_t device, std::uint64_t inode,
+                     bool extents) {
+    LayoutKey key;
+    key.device = device;
+    key.position = inode;
+    std::uint64_t offset;
+    if (extents && physical_offset(path, offset)) {
+        key.estimated = false;
+        key.position = offset;
+    }
+    return key;
+}
+
+} // namespace dedupe
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <tuple>
+
+namespace dedupe {
+
+// Where a file sits on its device, for issuing reads in an order that keeps a
+// spinning disk's head moving one way. Files with a known physical offset sort
+// by it; the rest sort by inode, which most filesystems allocate roughly in
+// disk order, after them.
+struct LayoutKey {
+    std::uint64_t device = 0;
+    bool estimated = true;          // position is an inode, not a byte offset
+    std::uint64_t position = 0;
+
+    bool operator<(const LayoutKey& other) const {
+        return std::tie(device, estimated, position) < std::tie(other.device, other.estimated, other.position);
+    }
+};
+
+// Physical byte offset of the file's first extent via FS_IOC_FIEMAP. False where
+// that isn't available: other platforms, filesystems without extents (tmpfs,
+// network mounts), empty files and data still held in delayed allocation.
+bool physical_offset(const std::filesystem::path& path, std::uint64_t& offset);
+
+// Fingerprint of where all of a file's data sits, via FS_IOC_FIEMAP, when every
+// extent is marked shared: reflinked copies (cp --reflink, deduplicated extents)
+// of one file get the same key. 0 when any extent is unshared or the map is
+// unavailable, as for physical_offset.
+std::uint64_t shared_extents_key(const std::filesystem::path& path);
+
+// Key from the physical offset when extents is set and FIEMAP answers, else the inode
+LayoutKey layout_key(const std::filesystem::path& path, std::uint64_t device, std::uint64_t inode,
+                     bool extents = true);
+
+} // namespace dedupe
@@ -0,0 +1,222 @@
+#include "listing.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
+
+namespace dedupe {
+
+#if defined(__linux__)
+
+namespace {
+
+// As the kernel writes them, glibc only declares it from 2.30
+struct LinuxDirent64 {
+    std::uint64_t d_ino;
+    std::int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+class DirectoryFd {
+public:
+    explicit DirectoryFd(const std::filesystem::path& dir)
+        : fd_(::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) {
+        if (fd_ < 0) {
+            throw std::filesystem::filesystem_error("Can't open directory", dir,
+                                                    std::error_code(errno, std::system_category()));
+        }
+    }
+    ~DirectoryFd() { ::close(fd_); }
+    DirectoryFd(const DirectoryFd&) = delete;
+    DirectoryFd& operator=(const DirectoryFd&) = delete;
+
+    int get() const { return fd_; }
+
+private:
+    int fd_;
+};
+
+void fill(DirectoryEntry& entry, bool isDirectory, std::uintmax_t size, std::uint64_t device, std::uint64_t inode,
+          std::uint32_t links, std::int64_t mtime, std::int64_t ctime) {
+    entry.isDirectory = isDirectory;
+    entry.size = isDirectory ? 0 : size;
+    entry.device = device;
+    entry.inode = inode;
+    entry.links = links;
+    entry.mtime = mtime;
+    entry.ctime = ctime;
+}
+
+void stat_at(int dirfd, DirectoryEntry& entry) {
+#if defined(STATX_TYPE)
+    // statx is missing before Linux 4.11 and inside some sandboxes, use fstatat there
+    static std::atomic<bool> haveStatx{ true };
+    if (haveStatx) {
+        struct statx stx;
+        constexpr unsigned mask = STATX_TYPE | STATX_SIZE | STATX_INO | STATX_NLINK | STATX_MTIME | STATX_CTIME;
+        if (::statx(dirfd, entry.name.c_str(), AT_NO_AUTOMOUNT | AT_STATX_SYNC_AS_STAT, mask, &stx) == 0) {
+            fill(entry, S_ISDIR(stx.stx_mode), stx.stx_size, makedev(stx.stx_dev_major, stx.stx_dev_minor), stx.stx_ino,
+                 stx.stx_nlink,
+                 stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec,
+                 stx.stx_ctime.tv_sec * 1000000000LL + stx.stx_ctime.tv_nsec);
+            return;
+        }
+        if (errno != ENOSYS && errno != EPERM) {
+            entry.error = errno;
+            return;
+        }
+        haveStatx = false;
+    }
+#endif
+    struct stat st;
+    if (::fstatat(dirfd, entry.name.c_str(), &st, AT_NO_AUTOMOUNT) != 0) {
+        entry.error = errno;
+        return;
+    }
+    fill(entry, S_ISDIR(st.st_mode), static_cast<std::uintmax_t>(st.st_size), st.st_dev, st.st_ino,
+         static_cast<std::uint32_t>(st.st_nlink),
+         st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec, st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec);
+}
+
+} // namespace
+
+void list_directory(const std::filesystem::path& dir, std::vector<DirectoryEntry>& entries,
+                    const std::vector<std::filesystem::path::string_type>* names, bool directories) {
+    entries.clear();
+    DirectoryFd fd(dir);
+
+    if (names) {
+        entries.reserve(names->size());
+        for (const auto& name : *names) {
+            entries.emplace_back();
+            entries.back().name = name;
+        }
+    }
+    else {
+        alignas(LinuxDirent64) char buffer[32 * 1024];
+        for (;;) {
+            long length = ::syscall(SYS_getdents64, fd.get(), buffer, sizeof(buffer));
+            if (length < 0) {
+                throw std::filesystem::filesystem_error("Can't read directory", dir,
+                                                        std::error_code(errno, std::system_category()));
+            }
+            if (length == 0) break;
+            for (long offset = 0; offset < length;) {
+                auto d = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+                offset += d->d_reclen;
+                if (d->d_name[0] == '.' && (d->d_name[1] == 0 || (d->d_name[1] == '.' && d->d_name[2] == 0))) continue;
+                if (!directories && d->d_type == DT_DIR) continue;
+                entries.emplace_back();
+                entries.back().name = d->d_name;
+            }
+        }
+    }
+
+    for (auto& entry : entries) {
+        stat_at(fd.get(), entry);
+    }
+    if (!directories) {
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [](const DirectoryEntry& e) { return e.isDirectory; }), entries.end());
+    }
+}
+
+#else
+
+void list_directory(const std::filesystem::path& dir, std::vector<DirectoryEntry>& entries,
+                    const std::vector<std::filesystem::path::string_type>* names, bool directories) {
+    entries.clear();
+    std::vector<std::filesystem::path> paths;
+    if (names) {
+        for (const auto& name : *names) {
+            paths.push_back(dir / name);
+        }
+    }
+    else {
+        for (const auto& item : std::filesystem::directory_iterator(dir)) {
+            paths.push_back(item.path());
+        }
+    }
+
+    for (const auto& path : paths) {
+        DirectoryEntry entry;
+        entry.name = path.filename().native();
+        std::error_code ec;
+        entry.isDirectory = std::filesystem::is_directory(path, ec);
+        if (!entry.isDirectory) {
+            entry.size = std::filesystem::file_size(path, ec);
+        }
+        if (ec) {
+            entry.error = ec.value() ? ec.value() : EIO;
+        }
+#if defined(__unix__) || defined(__APPLE__)
+        struct stat st;
+        if (!ec && ::stat(path.c_str(), &st) == 0) {
+            entry.device = static_cast<std::uint64_t>(st.st_dev);
+            entry.inode = static_cast<std::uint64_t>(st.st_ino);
+            entry.links = static_cast<std::uint32_t>(st.st_nlink);
+#if defined(__APPLE__)
+            entry.mtime = st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+            entry.ctime = st.st_ctimespec.tv_sec * 1000000000LL + st.st_ctimespec.tv_nsec;
+#else
+            entry.mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+            entry.ctime = st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+#endif
+        }
+#endif
+        if (directories || !entry.isDirectory) {
+            entries.push_back(std::move(entry));
+        }
+    }
+}
+
+#endif
+
+bool walk_files(const std::filesystem::path& root, bool recursive,
+                const std::function<void(const std::filesystem::path&, const DirectoryEntry&)>& file,
+                WalkCounts& counts, const std::function<bool(const std::filesystem::path&)>& next) {
+    std::vector<std::filesystem::path> directories{ root };
+    std::vector<DirectoryEntry> entries;
+    while (!directories.empty()) {
+        auto dir = std::move(directories.back());
+        directories.pop_back();
+        if (next && !next(dir)) return false;
+        try {
+            list_directory(dir, entries, nullptr, recursive);
+        }
+        catch (const std::exception&) {
+            ++counts.errors;
+            continue;
+        }
+        for (const auto& entry : entries) {
+            if (entry.error) {
+                ++counts.errors;
+            }
+            else if (entry.isDirectory) {
+                ++counts.directories;
+                directories.push_back(dir / entry.name);
+            }
+            else {
+                ++counts.files;
+                file(dir / entry.name, entry);
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace dedupe
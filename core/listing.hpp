@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dedupe {
+
+// One entry of a directory with what the tree needs from its stat. Symlinks are
+// followed, as std::filesystem::is_directory does.
+struct DirectoryEntry {
+    std::filesystem::path::string_type name;
+    bool isDirectory = false;
+    std::uintmax_t size = 0;
+    std::uint64_t device = 0;       // 0 where stat isn't available
+    std::uint64_t inode = 0;
+    std::uint32_t links = 0;        // Hard links to the inode
+    std::int64_t mtime = 0;         // Nanoseconds since the epoch
+    std::int64_t ctime = 0;
+    int error = 0;                  // errno from stat, the other fields are unset
+};
+
+// List dir and stat each entry. With names, those entries are stat'ed instead of
+// reading the directory. Without directories, subdirectories are left out, those
+// the listing marks as directories without a stat. On Linux this is one getdents64 pass over
+// a directory fd and a statx per entry relative to it, with only the fields above
+// requested; elsewhere std::filesystem. Throws std::filesystem::filesystem_error
+// when dir can't be opened or read.
+void list_directory(const std::filesystem::path& dir, std::vector<DirectoryEntry>& entries,
+                    const std::vector<std::filesystem::path::string_type>* names = nullptr,
+                    bool directories = true);
+
+struct WalkCounts {
+    std::uint64_t files = 0;
+    std::uint64_t directories = 0;      // Below root
+    std::uint64_t errors = 0;           // Directories that couldn't be listed, entries that couldn't be stat'ed
+};
+
+// Every file below root, depth first and without building a tree: only directories
+// still to list are kept. Calls file(path, entry) for each, and before listing each
+// directory, next(dir) if given, which stops the walk by returning false. Returns
+// false if stopped. Without recursive only root is listed.
+bool walk_files(const std::filesystem::path& root, bool recursive,
+                const std::function<void(const std::filesystem::path&, const DirectoryEntry&)>& file,
+                WalkCounts& counts, const std::function<bool(const std::filesystem::path&)>& next = nullptr);
+
+} // namespace dedupe
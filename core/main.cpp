@@ -1,15 +1,386 @@
-#include "scanner.hpp"
+#include "filesystem_tree.hpp"
+#include "chunk_index.hpp"
+#include "duplicate_finder.hpp"
+#include "hash_cache.hpp"
+#include "reclaimer.hpp"
+#include "sharded_scan.hpp"
+#include "streaming_finder.hpp"
+#include "tree_snapshot.hpp"
 #include "progress.hpp"
+#include "watcher.hpp"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
 #include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <atomic>
 
+std::atomic<int> dedupe::FileSystemTree::errors{ 0 };
+std::atomic<int> dedupe::FileSystemTree::directoryCount{ 0 };
+std::atomic<int> dedupe::FileSystemTree::fileCount{ 0 };
+
+namespace {
+
+std::atomic<bool> stopWatching{false};
+
+void request_stop(int) {
+    stopWatching = true;
+}
+
+} // namespace
+
 void print_help() {
-    std::cout << "Usage: dedupe++ [options] <directory>\n\n"
+    std::cout << "Usage: dedupe++ [options] <directory>\n"
+              << "       dedupe++ watch [options] <directory>\n\n"
+              << "watch scans once, then keeps following changes below directory and reports\n"
+              << "duplicates as they appear, until interrupted.\n\n"
               << "Options:\n"
               << "  --help              Show this help message\n"
-              << "  --no-recursive      Do not scan directories recursively (default: recursive)\n";
+              << "  --no-recursive      Do not scan directories recursively (default: recursive)\n"
+              << "  --threads <n>       Number of hashing threads (default: hardware concurrency)\n"
+              << "  --scan-threads <n>  Directories listed in parallel, 1 to list one at a time (default: hardware concurrency)\n"
+              << "  --read-mode <mode>  How files are read for hashing: stream, mmap or uring (default: stream)\n"
+              << "  --queue-depth <n>   Reads in flight per thread with --read-mode uring (default: 32)\n"
+              << "  --hdd-threads <n>   Concurrent reads per spinning disk (default: 2)\n"
+              << "  --ssd-threads <n>   Concurrent reads per SSD or NVMe drive (default: 16)\n"
+              << "  --no-device-limits  Let every device use all threads\n"
+              << "  --no-layout-order   Read files in tree order instead of on-disk order\n"
+              << "  --cache <file>      Keep digests in file and reuse them for unchanged files\n"
+              << "  --cache-max <n>     Entries kept in the cache, least recently used go first (default: no limit)\n"
+              << "  --cache-max-age <n> Drop cache entries unused for n runs (default: keep)\n"
+              << "  --snapshot <file>   Save the scan to file and rescan incrementally from it next time\n"
+              << "  --hash <algorithm>  Digest used to group files: xxh3-128 or sha256 (default: xxh3-128)\n"
+              << "  --confirm           Re-check duplicate groups with sha256 when grouping with a faster hash\n"
+              << "  --stages <list>     Comma separated refinement stages from head,tail,middle,full\n"
+              << "                      (default: all; full always runs last)\n"
+              << "  --block-size <n>    Bytes read by the head and tail stages and per middle sample (default: 8192)\n"
+              << "  --samples <n>       Blocks sampled by the middle stage (default: 4)\n"
+              << "  --compare-max <n>   Compare partitions of at most n files byte by byte instead of\n"
+              << "                      hashing them in full, 0 to always hash (default: 3)\n"
+              << "  --compare-min-size <n>  Smallest file size to compare rather than hash (default: 1048576)\n"
+              << "  --prefilter-min <n> Stages hashing at least n files first drop those without a partner\n"
+              << "                      through a Bloom filter, 0 to disable (default: 100000)\n"
+              << "  --reflinks          Count reflinked copies of a file as one, checking extents with FIEMAP\n"
+              << "  --similar <percent> Also list pairs of directories sharing at least this percentage of\n"
+              << "                      their files' contents, by Jaccard similarity (default: off)\n"
+              << "  --shared-chunks <n> Also cut files into content-defined chunks and list the n pairs of\n"
+              << "                      files sharing the most content, and the bytes each file shares\n"
+              << "  --cdc-size <n>      Average chunk size for --shared-chunks, a power of two (default: 65536)\n"
+              << "  --cdc-min-file <n>  Smallest file chunked by --shared-chunks (default: 1048576)\n"
+              << "  --stream            Find duplicates without building the tree, sorting on disk to stay within\n"
+              << "                      --memory; groups are printed as found (options needing the tree are refused)\n"
+              << "  --shards <n>        Scan and hash in n worker processes, each given whole subtrees and then\n"
+              << "                      whole size groups; groups are printed once all are merged (options\n"
+              << "                      needing the tree are refused)\n"
+              << "  --memory <MB>       Memory for --stream's sorts and batches (default: 256)\n"
+              << "  --temp-dir <dir>    Where --stream and --shards keep their working files (default: system temp)\n"
+              << "  --reclaim <mode>    Reclaim the space duplicates take: dedupe shares their extents with\n"
+              << "                      FIDEDUPERANGE (btrfs, XFS), link replaces them with hard links\n"
+              << "  --dry-run           With --reclaim, report what would be reclaimed without changing anything\n"
+              << "  --reclaim-threads <n>  Batches reclaimed at once (default: hardware concurrency)\n"
+              << "  --chunk-size <n>    Bytes deduplicated per call with --reclaim dedupe (default: 16777216)\n"
+              << "  --link-unconfirmed  Let --reclaim link replace groups not confirmed by sha256 or comparison\n"
+              << "  --settle <ms>       watch: wait for changes to stop for this long before applying them (default: 200)\n"
+              << "  --rescan-interval <s>  watch: rescan this often when directories can't be watched (default: 60)\n";
+}
+
+// Print the groups, sorted by hash so output is stable between runs
+void print_groups(const dedupe::DuplicateFinder& finder) {
+    std::vector<const dedupe::DuplicateFiles*> duplicates;
+    for (const auto& [hash, group] : finder.hashToDuplicate()) {
+        if (group.isIdentical()) {
+            duplicates.push_back(&group);
+        }
+    }
+    std::sort(duplicates.begin(), duplicates.end(), [](auto a, auto b) {
+        return a->signature.hash < b->signature.hash;
+    });
+
+    std::uintmax_t reclaimable = 0;
+    for (const auto* group : duplicates) {
+        reclaimable += group->reclaimableBytes();
+    }
+    std::cout << "\nFound " << duplicates.size() << " groups of duplicate files, " << reclaimable
+              << " bytes reclaimable:\n\n";
+
+    for (const auto* group : duplicates) {
+        std::cout << (group->isDirectory ? "Directory hash" : "Hash")
+                  << " (" << dedupe::algorithm_name(group->signature.algorithm)
+                  << (group->signature.compared ? ", compared" : group->signature.confirmed ? ", confirmed sha256" : "") << "): "
+                  << group->signature.hash.toHex(dedupe::digest_size(group->signature.algorithm));
+        if (group->copies < group->nodes.size()) {
+            std::cout << ", " << group->copies << " copies";
+        }
+        std::cout << "\n";
+        auto paths = group->paths();
+        std::sort(paths.begin(), paths.end());
+        for (const auto& file : paths) {
+            std::cout << "  " << file.string() << "\n";
+        }
+        std::cout << "\n";
+    }
+}
+
+// Hard linked paths share their data, so they are listed apart from duplicates
+void print_hard_links(const dedupe::DuplicateFinder& finder) {
+    std::vector<std::vector<std::filesystem::path>> sets;
+    for (const auto& links : finder.hardLinks()) {
+        sets.emplace_back();
+        for (auto node : links) {
+            sets.back().push_back(dedupe::FileSystemTree::pathOf(node));
+        }
+        std::sort(sets.back().begin(), sets.back().end());
+    }
+    std::sort(sets.begin(), sets.end());
+
+    std::cout << "Found " << sets.size() << " sets of hard links, " << finder.linkedFiles() << " paths not read again:\n\n";
+    for (const auto& paths : sets) {
+        for (const auto& path : paths) {
+            std::cout << "  " << path.string() << "\n";
+        }
+        std::cout << "\n";
+    }
+}
+
+void print_similar(const dedupe::DuplicateFinder& finder) {
+    const auto& similar = finder.similarDirectories();
+    std::cout << "Found " << similar.size() << " pairs of similar directories:\n\n";
+    for (const auto& pair : similar) {
+        std::cout << static_cast<int>(pair.similarity * 100) << "% similar, " << pair.sharedFiles
+                  << " files shared (" << pair.sharedBytes << " bytes)\n"
+                  << "  " << dedupe::FileSystemTree::pathOf(pair.first).string() << "\n"
+                  << "  " << dedupe::FileSystemTree::pathOf(pair.second).string() << "\n\n";
+    }
+}
+
+// Content shared below whole files, from the chunks of one path per distinct content
+void print_shared_chunks(const dedupe::ChunkIndex& index, std::size_t count) {
+    auto files = index.files();
+    auto pairs = index.topPairs(count);
+    std::cout << "Chunked " << files.size() << " files, " << index.totalBytes() << " bytes in " << index.chunkCount()
+              << " chunks, " << index.distinctChunks() << " distinct (" << index.uniqueBytes() << " bytes)\n\n"
+              << "Top " << pairs.size() << " pairs of files by shared content:\n\n";
+    for (const auto& pair : pairs) {
+        const auto& first = files[pair.first];
+        const auto& second = files[pair.second];
+        std::cout << pair.sharedBytes << " bytes shared\n"
+                  << "  " << first.path.string() << " (" << first.bytes << " bytes)\n"
+                  << "  " << second.path.string() << " (" << second.bytes << " bytes)\n\n";
+    }
+
+    std::vector<const dedupe::ChunkIndex::FileReport*> sharing;
+    for (const auto& file : files) {
+        if (file.sharedBytes > 0) {
+            sharing.push_back(&file);
+        }
+    }
+    std::sort(sharing.begin(), sharing.end(), [](auto a, auto b) {
+        if (a->sharedBytes != b->sharedBytes) return a->sharedBytes > b->sharedBytes;
+        return a->path < b->path;
+    });
+    std::cout << sharing.size() << " files share chunks with others:\n\n";
+    for (const auto* file : sharing) {
+        std::cout << "  " << file->sharedBytes << "/" << file->bytes << " bytes  " << file->path.string() << "\n";
+    }
+    for (const auto& [path, why] : index.failed()) {
+        std::cout << "  Failed " << path.string() << ": " << why << "\n";
+    }
+    std::cout << "\n";
+}
+
+void print_reclaim(const dedupe::Reclaimer::Stats& stats, const dedupe::ReclaimOptions& options) {
+    const char* mode = options.mode == dedupe::ReclaimMode::Dedupe ? "dedupe" : "link";
+    if (options.dryRun) {
+        std::cout << "Would reclaim (" << mode << "): " << stats.files << " files in " << stats.groups
+                  << " groups, " << stats.bytes << " bytes\n";
+    }
+    else {
+        std::cout << "\nReclaimed (" << mode << "): " << stats.files << " files in " << stats.groups << " groups, "
+                  << stats.bytes << " bytes in " << stats.seconds << " s ("
+                  << stats.bytesPerSecond() / (1024 * 1024) << " MB/s)" << (stats.cancelled ? ", cancelled" : "") << "\n";
+    }
+    if (stats.differed) {
+        std::cout << "  " << stats.differed << " files changed since they were hashed, left as they are\n";
+    }
+    if (stats.skipped) {
+        std::cout << "  " << stats.skipped << " groups not confirmed, skipped; use --confirm, --hash sha256 or --link-unconfirmed\n";
+    }
+    for (const auto& [path, why] : stats.failed) {
+        std::cout << "  Failed " << path.string() << ": " << why << "\n";
+    }
+}
+
+void print_stream_group(const dedupe::StreamGroup& group, dedupe::HashAlgorithm algorithm) {
+    std::cout << "Hash (" << dedupe::algorithm_name(algorithm) << "): "
+              << group.hash.toHex(dedupe::digest_size(algorithm)) << ", " << group.size << " bytes";
+    if (group.copies < group.paths.size()) {
+        std::cout << ", " << group.copies << " copies";
+    }
+    std::cout << "\n";
+    auto paths = group.paths;
+    std::sort(paths.begin(), paths.end());
+    for (const auto& file : paths) {
+        std::cout << "  " << file.string() << "\n";
+    }
+    std::cout << "\n";
+}
+
+// Find duplicates with the tree left out, printing each group as the last merge yields it
+int stream(const std::filesystem::path& directory, const dedupe::StreamOptions& options, dedupe::Progress& progress) {
+    dedupe::StreamingFinder finder(options);
+    bool first = true;
+    bool found = finder.find(directory, progress, [&](const dedupe::StreamGroup& group) {
+        std::cout << (first ? "\n\n" : "");
+        first = false;
+        print_stream_group(group, options.algorithm);
+    });
+    if (!found) {
+        std::cout << "\nCancelled\n";
+        return 1;
+    }
+
+    const auto& stats = finder.stats();
+    std::cout << (first ? "\n\n" : "") << "Scanned " << stats.files << " files in " << stats.directories
+              << " directories, " << stats.candidates << " sharing a size, " << stats.errors << " errors\n"
+              << "Hashed: " << stats.headHashed << " heads, " << stats.fullHashed << " files in full, "
+              << stats.runs << " sorted runs spilled to disk\n"
+              << "Found " << stats.groups << " groups of duplicate files (" << stats.duplicates << " paths), "
+              << stats.reclaimableBytes << " bytes reclaimable\n";
+    return 0;
+}
+
+// Scan with worker processes, see ShardedScan
+int shard(const std::filesystem::path& directory, const dedupe::ShardOptions& options, dedupe::Progress& progress) {
+    dedupe::ShardedScan scan(options);
+    bool first = true;
+    bool found = scan.find(directory, progress, [&](const dedupe::StreamGroup& group) {
+        std::cout << (first ? "\n\n" : "");
+        first = false;
+        print_stream_group(group, options.algorithm);
+    });
+    if (!found) {
+        std::cout << "\nCancelled\n";
+        return 1;
+    }
+
+    const auto& stats = scan.stats();
+    std::cout << (first ? "\n\n" : "") << "Scanned " << stats.files << " files in " << stats.directories
+              << " directories in " << stats.scanSeconds << " s, " << stats.errors << " errors\n"
+              << "Shards:";
+    for (std::size_t i = 0; i < stats.shardFiles.size(); ++i) {
+        std::cout << " " << stats.shardFiles[i] << "/" << stats.shardCandidates[i];
+    }
+    std::cout << " files scanned/hashed\n"
+              << "Hashed: " << stats.candidates << " files sharing a size, " << stats.hashed
+              << " reads of heads then whole files, in " << stats.hashSeconds << " s\n"
+              << "Found " << stats.groups << " groups of duplicate files (" << stats.duplicates << " paths), "
+              << stats.reclaimableBytes << " bytes reclaimable\n";
+    return 0;
+}
+
+// Follow changes below directory, starting from tree with its duplicates found. Each
+// batch of changes is applied to the tree and duplicates are found again; only the
+// size groups touched are hashed, everything else keeps its hash. Directories that
+// couldn't be watched, or changes lost to a queue overflow, are caught by an
+// incremental rescan instead.
+void watch(dedupe::FileSystemTree& tree, const std::filesystem::path& directory, bool recursive, unsigned scanThreads,
+           const dedupe::FinderOptions& options, dedupe::HashCache* cache,
+           std::chrono::milliseconds settle, std::chrono::seconds rescanInterval) {
+    dedupe::Progress quiet(nullptr, []() { return stopWatching.load(); });
+    dedupe::Watcher watcher(recursive);
+    watcher.addTree(directory);
+    if (!watcher.supported()) {
+        std::cout << "Watching isn't supported here, rescanning every " << rescanInterval.count() << "s\n";
+    }
+    else if (watcher.exhausted()) {
+        std::cout << "Watch limit reached, " << watcher.unwatched() << " directories unwatched and rescanned every "
+                  << rescanInterval.count() << "s. Raise fs.inotify.max_user_watches to watch them all.\n";
+    }
+    // Each change is looked up by path, which would otherwise scan every sibling
+    tree.buildIndexes();
+    std::cout << "Watching " << watcher.watched() << " directories (indexes "
+              << tree.indexMemoryUsage() / 1024 << " KB), interrupt to stop\n" << std::flush;
+
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    tree.settle();
+    dedupe::LatencyStats latency;
+    auto lastRescan = dedupe::Watcher::Clock::now();
+    std::vector<dedupe::Watcher::Change> changes;
+
+    while (!stopWatching) {
+        bool complete = watcher.poll(std::chrono::milliseconds(1000), settle, changes);
+        auto now = dedupe::Watcher::Clock::now();
+        bool rescan = !complete
+            || ((!watcher.supported() || watcher.exhausted()) && now - lastRescan >= rescanInterval);
+        if (changes.empty() && !rescan) continue;
+
+        // By path: refreshing a directory frees the nodes below it, even ones
+        // refreshed earlier in the batch
+        std::vector<std::filesystem::path> touched;
+        if (rescan) {
+            tree = dedupe::FileSystemTree::rebuildFromPath(directory, tree, quiet, recursive, true, scanThreads);
+            tree.buildIndexes();
+            lastRescan = now;
+            if (!complete || watcher.exhausted()) {
+                watcher.addTree(directory);
+            }
+        }
+        else {
+            for (const auto& change : changes) {
+                if (auto node = tree.refreshPath(change.path, quiet, recursive)) {
+                    auto path = dedupe::FileSystemTree::pathOf(node);
+                    if (std::find(touched.begin(), touched.end(), path) == touched.end()) {
+                        touched.push_back(path);
+                    }
+                }
+            }
+            tree.updateNestedSets();
+        }
+
+        dedupe::DuplicateFinder finder(tree, options);
+        finder.setCache(cache);
+        if (!finder.findDuplicates(quiet)) break;
+        auto applied = dedupe::Watcher::Clock::now();
+        for (const auto& change : changes) {
+            latency.add(applied - change.seen);
+        }
+
+        std::cout << (rescan ? "Rescanned" : "Applied " + std::to_string(changes.size()) + " changes") << ": "
+                  << tree.changedSizes().size() << " sizes changed, " << finder.reusedFiles() << " files reused";
+        if (latency.count()) {
+            std::cout << ", latency mean " << latency.meanMs() << " ms, p99 " << latency.percentileMs(99)
+                      << " ms, max " << latency.maxMs() << " ms";
+        }
+        std::cout << "\n";
+        for (const auto& path : touched) {
+            auto node = tree.findByPath(path);
+            if (!node) continue;
+            const auto& data = node->data();
+            auto group = finder.hashToDuplicate().find(data.hash);
+            if (group == finder.hashToDuplicate().end() || !group->second.isIdentical()) continue;
+            std::cout << "  " << (data.isDirectory ? "Duplicate directory " : "Duplicate ")
+                      << dedupe::FileSystemTree::pathOf(node).string() << "\n";
+            for (auto other : group->second.nodes) {
+                if (other != node) {
+                    std::cout << "    = " << dedupe::FileSystemTree::pathOf(other).string() << "\n";
+                }
+            }
+        }
+        std::cout << std::flush;
+        tree.settle();
+    }
+
+    std::cout << "\nStopped after " << latency.count() << " changes";
+    if (latency.count()) {
+        std::cout << ", latency mean " << latency.meanMs() << " ms, p50 " << latency.percentileMs(50)
+                  << " ms, p99 " << latency.percentileMs(99) << " ms, max " << latency.maxMs() << " ms";
+    }
+    std::cout << "\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -19,11 +390,49 @@ int main(int argc, char* argv[]) {
     }
 
     bool recursive = true;  // Default to recursive
+    dedupe::FinderOptions options;
+    dedupe::ReclaimOptions reclaimOptions;
+    bool reclaim = false;
     std::filesystem::path directory;
+    std::filesystem::path cacheFile;
+    std::filesystem::path snapshotFile;
+    std::size_t cacheMax = 0;
+    unsigned cacheMaxAge = 0;
+    unsigned scanThreads = 0;
+    bool watching = false;
+    bool streaming = false;
+    dedupe::StreamOptions streamOptions;
+    unsigned shards = 0;
+    std::size_t sharedChunks = 0;
+    dedupe::ChunkOptions chunkOptions;
+    std::uintmax_t chunkMinFile = 1024 * 1024;
+    std::chrono::milliseconds settle(200);
+    std::chrono::seconds rescanInterval(60);
+
+    // Read only by the tree finder and what follows it, which --stream and --shards don't build
+    const std::set<std::string> treeOptions = {
+        "--scan-threads", "--queue-depth", "--hdd-threads", "--ssd-threads", "--no-device-limits", "--no-layout-order",
+        "--cache", "--cache-max", "--cache-max-age", "--snapshot", "--confirm", "--stages", "--samples",
+        "--compare-max", "--compare-min-size", "--prefilter-min", "--reflinks", "--similar", "--shared-chunks",
+        "--cdc-size", "--cdc-min-file", "--reclaim", "--dry-run", "--reclaim-threads", "--chunk-size",
+        "--link-unconfirmed"
+    };
+    std::vector<std::string> treeOnly;
+    bool memory = false;
+    bool tempDir = false;
+
+    int first = 1;
+    if (std::string(argv[1]) == "watch") {
+        watching = true;
+        ++first;
+    }
 
-    for (int i = 1; i < argc; ++i) {
+    for (int i = first; i < argc; ++i) {
         std::string arg = argv[i];
-        
+        if (treeOptions.count(arg)) {
+            treeOnly.push_back(arg);
+        }
+
         if (arg == "--help") {
             print_help();
             return 0;
@@ -31,6 +440,154 @@ int main(int argc, char* argv[]) {
         else if (arg == "--no-recursive") {
             recursive = false;
         }
+        else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--scan-threads" && i + 1 < argc) {
+            scanThreads = static_cast<unsigned>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--read-mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "mmap") {
+                options.readMode = dedupe::ReadMode::Mapped;
+            }
+            else if (mode == "uring") {
+                options.readMode = dedupe::ReadMode::Uring;
+            }
+            else if (mode == "stream") {
+                options.readMode = dedupe::ReadMode::Stream;
+            }
+            else {
+                std::cerr << "Error: Unknown read mode " << mode << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--queue-depth" && i + 1 < argc) {
+            options.queueDepth = static_cast<unsigned>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--hdd-threads" && i + 1 < argc) {
+            options.rotationalThreads = static_cast<unsigned>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--ssd-threads" && i + 1 < argc) {
+            options.solidStateThreads = static_cast<unsigned>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--no-device-limits") {
+            options.deviceLimits = false;
+        }
+        else if (arg == "--no-layout-order") {
+            options.layoutOrder = false;
+        }
+        else if (arg == "--cache" && i + 1 < argc) {
+            cacheFile = argv[++i];
+        }
+        else if (arg == "--cache-max" && i + 1 < argc) {
+            cacheMax = std::stoull(argv[++i]);
+        }
+        else if (arg == "--cache-max-age" && i + 1 < argc) {
+            cacheMaxAge = static_cast<unsigned>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--snapshot" && i + 1 < argc) {
+            snapshotFile = argv[++i];
+        }
+        else if (arg == "--hash" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (!dedupe::parse_algorithm(name, options.algorithm)) {
+                std::cerr << "Error: Unknown hash algorithm " << name << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--confirm") {
+            options.confirm = true;
+        }
+        else if (arg == "--stages" && i + 1 < argc) {
+            options.stages.clear();
+            std::stringstream list(argv[++i]);
+            std::string name;
+            while (std::getline(list, name, ',')) {
+                dedupe::HashStage stage;
+                if (!dedupe::parse_stage(name, stage)) {
+                    std::cerr << "Error: Unknown stage " << name << "\n";
+                    return 1;
+                }
+                options.stages.push_back(stage);
+            }
+        }
+        else if (arg == "--block-size" && i + 1 < argc) {
+            options.headSize = options.tailSize = options.sampleSize = std::stoull(argv[++i]);
+        }
+        else if (arg == "--samples" && i + 1 < argc) {
+            options.middleSamples = static_cast<unsigned>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--compare-max" && i + 1 < argc) {
+            options.compareMaxFiles = static_cast<unsigned>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--compare-min-size" && i + 1 < argc) {
+            options.compareMinSize = std::stoull(argv[++i]);
+        }
+        else if (arg == "--prefilter-min" && i + 1 < argc) {
+            options.prefilterMinFiles = std::stoull(argv[++i]);
+        }
+        else if (arg == "--reflinks") {
+            options.reflinks = true;
+        }
+        else if (arg == "--similar" && i + 1 < argc) {
+            options.similarity = std::stod(argv[++i]) / 100.0;
+        }
+        else if (arg == "--shared-chunks" && i + 1 < argc) {
+            sharedChunks = std::stoull(argv[++i]);
+        }
+        else if (arg == "--cdc-size" && i + 1 < argc) {
+            chunkOptions.params = dedupe::ChunkParams::around(std::stoull(argv[++i]));
+        }
+        else if (arg == "--cdc-min-file" && i + 1 < argc) {
+            chunkMinFile = std::stoull(argv[++i]);
+        }
+        else if (arg == "--stream") {
+            streaming = true;
+        }
+        else if (arg == "--shards" && i + 1 < argc) {
+            shards = static_cast<unsigned>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--memory" && i + 1 < argc) {
+            streamOptions.memoryBudget = static_cast<std::size_t>(std::stoull(argv[++i])) * 1024 * 1024;
+            memory = true;
+        }
+        else if (arg == "--temp-dir" && i + 1 < argc) {
+            streamOptions.tempDirectory = argv[++i];
+            tempDir = true;
+        }
+        else if (arg == "--reclaim" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "dedupe") {
+                reclaimOptions.mode = dedupe::ReclaimMode::Dedupe;
+            }
+            else if (mode == "link") {
+                reclaimOptions.mode = dedupe::ReclaimMode::HardLink;
+            }
+            else {
+                std::cerr << "Error: Unknown reclaim mode " << mode << "\n";
+                return 1;
+            }
+            reclaim = true;
+        }
+        else if (arg == "--dry-run") {
+            reclaimOptions.dryRun = true;
+        }
+        else if (arg == "--reclaim-threads" && i + 1 < argc) {
+            reclaimOptions.threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--chunk-size" && i + 1 < argc) {
+            reclaimOptions.chunkSize = std::stoull(argv[++i]);
+        }
+        else if (arg == "--link-unconfirmed") {
+            reclaimOptions.unconfirmed = true;
+        }
+        else if (arg == "--settle" && i + 1 < argc) {
+            settle = std::chrono::milliseconds(std::stoul(argv[++i]));
+        }
+        else if (arg == "--rescan-interval" && i + 1 < argc) {
+            rescanInterval = std::chrono::seconds(std::stoul(argv[++i]));
+        }
         else {
             directory = arg;
         }
@@ -41,29 +598,150 @@ int main(int argc, char* argv[]) {
         print_help();
         return 1;
     }
+    if ((streaming || shards) && watching) {
+        std::cerr << "Error: --stream and --shards can't watch, they keep no tree to update\n";
+        return 1;
+    }
+    if (streaming && shards) {
+        std::cerr << "Error: --stream and --shards are separate ways to scan, choose one\n";
+        return 1;
+    }
+    if ((streaming || shards) && !treeOnly.empty()) {
+        std::cerr << "Error: " << (streaming ? "--stream" : "--shards") << " builds no tree, so it can't take";
+        for (const auto& option : treeOnly) {
+            std::cerr << " " << option;
+        }
+        std::cerr << "\n";
+        return 1;
+    }
+    if (memory && !streaming) {
+        std::cerr << "Error: --memory only applies to --stream\n";
+        return 1;
+    }
+    if (tempDir && !streaming && !shards) {
+        std::cerr << "Error: --temp-dir only applies to --stream and --shards\n";
+        return 1;
+    }
 
     try {
+        if (!std::filesystem::is_directory(directory)) {
+            throw std::runtime_error("Invalid directory: " + directory.string());
+        }
+
         std::atomic<bool> cancelled{false};
         dedupe::Progress progress(
             [](const std::string& message, double progress) {
-                std::cout << "\r" << message << " [" 
+                std::cout << "\r" << message << " ["
                          << static_cast<int>(progress * 100) << "%]" << std::flush;
             },
             [&cancelled]() { return cancelled.load(); }
         );
 
-        dedupe::Scanner scanner(recursive);
-        auto duplicates = scanner.scan_directory(directory, progress);
-        
-        std::cout << "\n\nFound " << duplicates.size() << " groups of duplicate files:\n\n";
-        
-        for (const auto& group : duplicates) {
-            std::cout << "Hash: " << group.hash << "\n";
-            for (const auto& file : group.files) {
-                std::cout << "  " << file.string() << "\n";
+        if (streaming) {
+            streamOptions.recursive = recursive;
+            streamOptions.threads = options.threads;
+            streamOptions.readMode = options.readMode;
+            streamOptions.algorithm = options.algorithm;
+            streamOptions.headSize = options.headSize;
+            return stream(directory, streamOptions, progress);
+        }
+        if (shards) {
+            dedupe::ShardOptions shardOptions;
+            shardOptions.shards = shards;
+            shardOptions.threads = options.threads;
+            shardOptions.recursive = recursive;
+            shardOptions.readMode = options.readMode;
+            shardOptions.algorithm = options.algorithm;
+            shardOptions.headSize = options.headSize;
+            shardOptions.tempDirectory = streamOptions.tempDirectory;
+            return shard(directory, shardOptions, progress);
+        }
+
+        // Listings from a snapshot of the same scan are reusable, its hashes only
+        // if they were made with the same options
+        dedupe::TreeSnapshot::Header header{ directory, recursive, dedupe::DuplicateFinder::fingerprint(options) };
+        dedupe::FileSystemTree previous;
+        dedupe::TreeSnapshot::Header previousHeader;
+        bool incremental = !snapshotFile.empty()
+            && dedupe::TreeSnapshot::load(snapshotFile, previous, previousHeader)
+            && previousHeader.root == header.root && previousHeader.recursive == header.recursive;
+        auto tree = incremental
+            ? dedupe::FileSystemTree::rebuildFromPath(directory, previous, progress, recursive,
+                                                      previousHeader.fingerprint == header.fingerprint, scanThreads)
+            : dedupe::FileSystemTree::buildFromPath(directory, progress, recursive, scanThreads);
+        previous = dedupe::FileSystemTree();
+        dedupe::DuplicateFinder finder(tree, options);
+        std::unique_ptr<dedupe::HashCache> cache;
+        if (!cacheFile.empty()) {
+            cache = std::make_unique<dedupe::HashCache>(cacheFile, cacheMax, cacheMaxAge);
+            finder.setCache(cache.get());
+        }
+        bool found = finder.findDuplicates(progress);
+        if (cache) {
+            cache->save();
+        }
+        // Groups and statistics of a cancelled run are partial
+        if (!found) {
+            std::cout << "\nCancelled\n";
+            return 1;
+        }
+        if (!snapshotFile.empty()) {
+            dedupe::TreeSnapshot::save(snapshotFile, tree, header);
+        }
+
+        std::cout << "\n\n";
+        for (auto stage : { dedupe::HashStage::Head, dedupe::HashStage::Tail, dedupe::HashStage::Middle, dedupe::HashStage::Full }) {
+            const auto& stats = finder.stageStats(stage);
+            std::cout << "Stage " << dedupe::stage_name(stage) << ": " << stats.files << " files, "
+                      << stats.bytes << " bytes read";
+            if (stats.prefiltered) {
+                std::cout << ", " << stats.prefiltered << " without a partner by prefilter";
             }
             std::cout << "\n";
         }
+        std::cout << "Compared: " << finder.compareStats().files << " files, "
+                  << finder.compareStats().bytes << " bytes read\n";
+        if (incremental) {
+            std::cout << "Snapshot: " << finder.reusedFiles() << " files reused, "
+                      << tree.changedSizes().size() << " sizes changed\n";
+        }
+        if (cache) {
+            const auto& stats = cache->stats();
+            std::cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses ("
+                      << static_cast<int>(stats.hitRate() * 100) << "% hit rate), " << cache->size()
+                      << " entries, " << stats.dropped << " dropped\n";
+        }
+
+        print_groups(finder);
+        if (!finder.hardLinks().empty()) {
+            print_hard_links(finder);
+        }
+        if (options.similarity > 0) {
+            print_similar(finder);
+        }
+        if (sharedChunks) {
+            chunkOptions.algorithm = options.algorithm;
+            chunkOptions.threads = options.threads;
+            dedupe::ChunkIndex index(chunkOptions);
+            if (index.build(dedupe::ChunkIndex::distinctFiles(tree, finder, chunkMinFile), progress)) {
+                std::cout << "\n\n";
+                print_shared_chunks(index, sharedChunks);
+            }
+        }
+        if (reclaim) {
+            auto stats = dedupe::Reclaimer(reclaimOptions).reclaim(dedupe::Reclaimer::identicalFiles(finder), progress);
+            print_reclaim(stats, reclaimOptions);
+        }
+
+        if (watching) {
+            watch(tree, directory, recursive, scanThreads, options, cache.get(), settle, rescanInterval);
+            if (cache) {
+                cache->save();
+            }
+            if (!snapshotFile.empty()) {
+                dedupe::TreeSnapshot::save(snapshotFile, tree, header);
+            }
+        }
 
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
@@ -71,4 +749,4 @@ int main(int argc, char* argv[]) {
     }
 
     return 0;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace dedupe {
+
+// A file name interned in a pool shared by every tree in the process. Each
+// distinct name is stored once, so the "IMG_0001.JPG" or "Thumbs.db" found in
+// thousands of directories costs one pointer per node, and is freed with the
+// last Name holding it, so rescans and watching don't leave dropped names
+// behind. Names compare by pointer. Interning is safe from any thread.
+class Name {
+public:
+    using String = std::filesystem::path::string_type;
+
+    Name() : entry_(intern(String())) {}
+    Name(const String& name) : entry_(intern(name)) {}
+    Name(const String::value_type* name) : entry_(intern(name)) {}
+    Name(const std::filesystem::path& name) : entry_(intern(name.native())) {}
+
+    Name(const Name& other) : entry_(other.entry_) { ++entry_->second; }
+    // Leaves other empty of any name, fit only to assign to or destroy
+    Name(Name&& other) noexcept : entry_(other.entry_) { other.entry_ = nullptr; }
+    Name& operator=(Name other) noexcept {
+        std::swap(entry_, other.entry_);
+        return *this;
+    }
+    ~Name() {
+        if (entry_) release(entry_);
+    }
+
+    const String& native() const { return entry_->first; }
+    std::filesystem::path path() const { return entry_->first; }
+    bool empty() const { return entry_->first.empty(); }
+
+    bool operator==(const Name& other) const { return entry_ == other.entry_; }
+    bool operator!=(const Name& other) const { return entry_ != other.entry_; }
+
+    // The pooled copy of name, nullptr if no Name holds it. Lookups of names no
+    // tree holds don't grow the pool.
+    static const String* find(const String& name) {
+        auto& shard = shardOf(name);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.names.find(name);
+        return it == shard.names.end() ? nullptr : &it->first;
+    }
+
+private:
+    // Name and the count of Names holding it
+    using Entry = std::pair<const String, std::atomic<std::size_t>>;
+
+    // Elements of an unordered_map keep their address as it grows. Sharded so
+    // parallel scans rarely wait on each other.
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<String, std::atomic<std::size_t>> names;
+    };
+
+    static Shard& shardOf(const String& name) {
+        static std::array<Shard, 16> shards;
+        return shards[std::hash<String>()(name) % shards.size()];
+    }
+
+    static Entry* intern(const String& name) {
+        auto& shard = shardOf(name);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto& entry = *shard.names.try_emplace(name, 0).first;
+        ++entry.second;
+        return &entry;
+    }
+
+    // Counts only reach zero, and only grow from it, under the shard's lock, so
+    // a name is never erased while intern hands it out
+    static void release(Entry* entry) {
+        auto count = entry->second.load();
+        while (count > 1) {
+            if (entry->second.compare_exchange_weak(count, count - 1)) return;
+        }
+        auto& shard = shardOf(entry->first);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (--entry->second == 0) {
+            shard.names.erase(shard.names.find(entry->first));
+        }
+    }
+
+    Entry* entry_;
+};
+
+} // namespace dedupe
@@ -7,8 +7,10 @@
 
 namespace dedupe {
 
+// A node owns its children; the link back to the parent is a plain pointer so
+// a tree holds no reference cycles and is freed with its root.
 template<typename T>
-class NestedNode : public std::enable_shared_from_this<NestedNode<T>> {
+class NestedNode {
 public:
     using NodePtr = std::shared_ptr<NestedNode<T>>;
     using NodeList = std::vector<NodePtr>;
@@ -25,7 +27,7 @@ public:
     T& data() { return data_; }
     int left() const { return left_; }
     int right() const { return right_; }
-    const NodePtr& parent() const { return parent_; }
+    NestedNode* parent() const { return parent_; }
     const NodeList& children() const { return children_; }
     NodeList& children() { return children_; }
     size_t childCount() const { return children_.size(); }
@@ -33,11 +35,11 @@ public:
     // Setters
     void setLeft(int left) { left_ = left; }
     void setRight(int right) { right_ = right; }
-    void setParent(const NodePtr& parent) { parent_ = parent; }
+    void setParent(NestedNode* parent) { parent_ = parent; }
 
     // Tree operations
     void addChild(const NodePtr& child) {
-        child->setParent(this->shared_from_this());
+        child->setParent(this);
         children_.push_back(child);
     }
 
@@ -61,7 +63,7 @@ private:
     T data_;
     int left_;      // Nested set left value
     int right_;     // Nested set right value
-    NodePtr parent_;
+    NestedNode* parent_;
     NodeList children_;
 };
 
@@ -17,6 +17,7 @@ public:
         , cancellation_callback_(std::move(cancellation_callback))
     {}
 
+    // progress is the fraction done, from 0 to 1
     void report(const std::string& message, double progress) {
         if (progress_callback_) {
             progress_callback_(message, progress);
@@ -0,0 +1,310 @@
+#include "reclaimer.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <system_error>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace dedupe {
+
+int SystemReclaimBackend::open(const std::filesystem::path& path, bool target) {
+#if defined(__linux__)
+    int fd = ::open(path.c_str(), (target ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    // The kernel also lets the owner dedupe into a file it can only read
+    if (fd < 0 && target && (errno == EACCES || errno == EPERM || errno == EROFS || errno == ETXTBSY)) {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    return fd < 0 ? -errno : fd;
+#else
+    (void)path;
+    (void)target;
+    return -EOPNOTSUPP;
+#endif
+}
+
+void SystemReclaimBackend::close(int handle) {
+#if defined(__linux__)
+    ::close(handle);
+#else
+    (void)handle;
+#endif
+}
+
+void SystemReclaimBackend::dedupe(int source, std::uint64_t offset, std::uint64_t length,
+                                  const std::vector<int>& targets, std::vector<RangeResult>& results) {
+    results.assign(targets.size(), RangeResult());
+#if defined(__linux__) && defined(FIDEDUPERANGE)
+    std::vector<char> buffer(sizeof(file_dedupe_range) + targets.size() * sizeof(file_dedupe_range_info));
+    auto range = reinterpret_cast<file_dedupe_range*>(buffer.data());
+    range->src_offset = offset;
+    range->src_length = length;
+    range->dest_count = static_cast<std::uint16_t>(targets.size());
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+        range->info[i].dest_fd = targets[i];
+        range->info[i].dest_offset = offset;
+    }
+    if (::ioctl(source, FIDEDUPERANGE, range) != 0) {
+        int error = errno;
+        for (auto& result : results) {
+            result.status = -error;
+        }
+        return;
+    }
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+        results[i].bytes = range->info[i].bytes_deduped;
+        results[i].status = range->info[i].status;
+    }
+#else
+    (void)source;
+    (void)offset;
+    (void)length;
+    for (auto& result : results) {
+        result.status = -EOPNOTSUPP;
+    }
+#endif
+}
+
+void SystemReclaimBackend::link(const std::filesystem::path& source, const std::filesystem::path& target) {
+    auto temporary = target.parent_path() / ("." + target.filename().string() + ".dedupe-link");
+    std::filesystem::create_hard_link(source, temporary);
+    std::error_code ignored;
+    try {
+        std::filesystem::rename(temporary, target);
+    }
+    catch (...) {
+        std::filesystem::remove(temporary, ignored);
+        throw;
+    }
+    // rename does nothing when both names are already links to one inode
+    std::filesystem::remove(temporary, ignored);
+}
+
+Reclaimer::Reclaimer(ReclaimOptions options)
+    : options_(std::move(options))
+    , owned_(std::make_unique<SystemReclaimBackend>())
+    , backend_(owned_.get())
+{}
+
+Reclaimer::Reclaimer(ReclaimOptions options, ReclaimBackend& backend)
+    : options_(std::move(options))
+    , backend_(&backend)
+{}
+
+std::vector<const DuplicateFiles*> Reclaimer::identicalFiles(const DuplicateFinder& finder) {
+    std::vector<const DuplicateFiles*> groups;
+    for (const auto& [hash, group] : finder.hashToDuplicate()) {
+        if (group.isIdentical() && !group.isDirectory) {
+            groups.push_back(&group);
+        }
+    }
+    std::sort(groups.begin(), groups.end(), [](auto a, auto b) {
+        if (a->reclaimableBytes() != b->reclaimableBytes()) {
+            return a->reclaimableBytes() > b->reclaimableBytes();
+        }
+        return a->signature.hash < b->signature.hash;
+    });
+    return groups;
+}
+
+bool Reclaimer::trusted(const DuplicateFiles& group) const {
+    return options_.mode == ReclaimMode::Dedupe || options_.unconfirmed || group.signature.confirmed
+        || group.signature.compared;
+}
+
+Reclaimer::Stats Reclaimer::reclaim(const std::vector<const DuplicateFiles*>& groups, Progress& progress) {
+    Stats stats;
+    auto start = std::chrono::steady_clock::now();
+    unsigned batchSize = std::clamp(options_.batchSize, 1u, MAX_BATCH);
+
+    // Each device's copies go against its most linked path. Deduping works on inodes,
+    // so takes each once; a hard link frees an inode only when all its paths are replaced.
+    std::vector<Batch> batches;
+    std::uintmax_t total = 0;
+    for (auto group : groups) {
+        if (group->isDirectory || !group->isIdentical() || group->signature.size == 0) continue;
+        if (!trusted(*group)) {
+            ++stats.skipped;
+            continue;
+        }
+        std::vector<std::uint64_t> devices;
+        std::unordered_map<std::uint64_t, std::vector<const ArenaNode<FileSystemNode>*>> byDevice;
+        for (auto node : group->nodes) {
+            auto& members = byDevice[node->data().device];
+            if (members.empty()) {
+                devices.push_back(node->data().device);
+            }
+            members.push_back(node);
+        }
+
+        bool any = false;
+        for (auto device : devices) {
+            const auto& members = byDevice[device];
+            auto source = *std::max_element(members.begin(), members.end(), [](auto a, auto b) {
+                return a->data().links < b->data().links;
+            });
+            std::set<std::uint64_t> inodes{ source->data().inode };
+            std::vector<std::filesystem::path> targets;
+            std::vector<bool> repeated;
+            for (auto member : members) {
+                auto inode = member->data().inode;
+                if (member == source || (inode != 0 && inode == source->data().inode)) continue;
+                bool first = inode == 0 || inodes.insert(inode).second;
+                if (!first && options_.mode == ReclaimMode::Dedupe) continue;
+                targets.push_back(FileSystemTree::pathOf(member));
+                repeated.push_back(!first);
+                total += first ? group->signature.size : 0;
+            }
+            for (std::size_t i = 0; i < targets.size(); i += batchSize) {
+                Batch batch;
+                batch.source = FileSystemTree::pathOf(source);
+                batch.size = group->signature.size;
+                auto end = std::min(targets.size(), i + batchSize);
+                batch.targets.assign(targets.begin() + i, targets.begin() + end);
+                batch.repeated.assign(repeated.begin() + i, repeated.begin() + end);
+                batches.push_back(std::move(batch));
+                any = true;
+            }
+        }
+        stats.groups += any;
+    }
+
+    if (options_.dryRun) {
+        for (const auto& batch : batches) {
+            stats.files += batch.targets.size();
+        }
+        stats.bytes = total;
+        return stats;
+    }
+
+    // Batches only count into their own stats, merged once all are through
+    Run run;
+    std::vector<Stats> results(batches.size());
+    ThreadPool pool(options_.threads);
+    for (std::size_t i = 0; i < batches.size(); ++i) {
+        pool.submit([this, &run, &batches, &results, i]() {
+            if (run.cancelled) return;
+            if (options_.mode == ReclaimMode::Dedupe) {
+                dedupe(batches[i], results[i], run);
+            }
+            else {
+                link(batches[i], results[i], run);
+            }
+        });
+    }
+    pool.wait([&]() {
+        if (progress.is_cancelled()) {
+            run.cancelled = true;
+        }
+        std::stringstream ss;
+        ss << run.done / (1024 * 1024) << "/" << total / (1024 * 1024) << " MB Reclaiming space";
+        progress.report(ss.str(), total ? static_cast<double>(run.done) / total : 1.0);
+    });
+
+    for (auto& result : results) {
+        stats.files += result.files;
+        stats.differed += result.differed;
+        stats.bytes += result.bytes;
+        std::move(result.failed.begin(), result.failed.end(), std::back_inserter(stats.failed));
+    }
+    stats.cancelled = run.cancelled;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+void Reclaimer::dedupe(const Batch& batch, Stats& stats, Run& run) {
+    int source = backend_->open(batch.source, false);
+    if (source < 0) {
+        for (const auto& target : batch.targets) {
+            stats.failed.emplace_back(target, "Cannot open " + batch.source.string() + ": " + std::generic_category().message(-source));
+        }
+        return;
+    }
+
+    // Targets still going, as handles and indices into batch.targets
+    std::vector<int> handles;
+    std::vector<std::size_t> live;
+    for (std::size_t i = 0; i < batch.targets.size(); ++i) {
+        int handle = backend_->open(batch.targets[i], true);
+        if (handle < 0) {
+            stats.failed.emplace_back(batch.targets[i], "Cannot open: " + std::generic_category().message(-handle));
+            continue;
+        }
+        handles.push_back(handle);
+        live.push_back(i);
+    }
+
+    std::vector<ReclaimBackend::RangeResult> results;
+    std::uint64_t offset = 0;
+    while (!handles.empty() && offset < batch.size && !run.cancelled) {
+        auto length = std::min<std::uint64_t>(std::max<std::uint64_t>(options_.chunkSize, 1), batch.size - offset);
+        backend_->dedupe(source, offset, length, handles, results);
+
+        // A call may stop short; all carry on from the least any got, redoing a shared range is harmless
+        std::uint64_t step = length;
+        for (const auto& result : results) {
+            if (result.status == ReclaimBackend::SAME) {
+                step = std::min(step, result.bytes);
+            }
+        }
+        std::size_t kept = 0;
+        for (std::size_t k = 0; k < handles.size(); ++k) {
+            const auto& result = results[k];
+            if (result.status == ReclaimBackend::SAME && step > 0) {
+                stats.bytes += step;
+                run.done += step;
+                handles[kept] = handles[k];
+                live[kept++] = live[k];
+                continue;
+            }
+            if (result.status == ReclaimBackend::DIFFERS) {
+                ++stats.differed;
+            }
+            else {
+                stats.failed.emplace_back(batch.targets[live[k]], result.status < 0
+                    ? std::generic_category().message(-result.status) : "No progress at offset " + std::to_string(offset));
+            }
+            backend_->close(handles[k]);
+        }
+        handles.resize(kept);
+        live.resize(kept);
+        offset += step;
+    }
+
+    if (offset >= batch.size) {
+        stats.files += handles.size();
+    }
+    for (int handle : handles) {
+        backend_->close(handle);
+    }
+    backend_->close(source);
+}
+
+void Reclaimer::link(const Batch& batch, Stats& stats, Run& run) {
+    for (std::size_t i = 0; i < batch.targets.size(); ++i) {
+        if (run.cancelled) return;
+        // Other links to an inode already counted free nothing more
+        auto bytes = batch.repeated[i] ? 0 : batch.size;
+        try {
+            backend_->link(batch.source, batch.targets[i]);
+            ++stats.files;
+            stats.bytes += bytes;
+        }
+        catch (const std::filesystem::filesystem_error& e) {
+            stats.failed.emplace_back(batch.targets[i], e.what());
+        }
+        run.done += bytes;
+    }
+}
+
+} // namespace dedupe
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "duplicate_finder.hpp"
+#include "progress.hpp"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dedupe {
+
+enum class ReclaimMode {
+    Dedupe,         // Share extents with FIDEDUPERANGE; btrfs and XFS, the kernel checks contents match
+    HardLink,       // Replace copies with hard links to the first, on any filesystem
+};
+
+struct ReclaimOptions {
+    ReclaimMode mode = ReclaimMode::Dedupe;
+    bool dryRun = false;            // Count what would be reclaimed without touching anything
+    unsigned threads = 0;           // Batches run at once, 0 = hardware concurrency
+    std::uint64_t chunkSize = 16 * 1024 * 1024;    // Bytes per FIDEDUPERANGE call, btrfs does at most 16MB
+    unsigned batchSize = 64;        // Copies per FIDEDUPERANGE call, at most Reclaimer::MAX_BATCH
+    // HardLink trusts the finder, so by default only groups confirmed with SHA-256
+    // or byte comparison are linked. Dedupe is always checked by the kernel.
+    bool unconfirmed = false;
+};
+
+// Where space is actually reclaimed, so the Reclaimer can be tested against a mock.
+// Handles and statuses follow FIDEDUPERANGE: a status is 0 when the ranges matched,
+// 1 when they differ, or -errno.
+class ReclaimBackend {
+public:
+    static constexpr int SAME = 0;
+    static constexpr int DIFFERS = 1;
+
+    struct RangeResult {
+        std::uint64_t bytes = 0;    // Bytes deduplicated, may fall short of the length asked
+        int status = SAME;
+    };
+
+    virtual ~ReclaimBackend() = default;
+
+    // A handle to path, opened for writing when it will be a target. -errno on failure.
+    virtual int open(const std::filesystem::path& path, bool target) = 0;
+    virtual void close(int handle) = 0;
+    // Share length bytes of source at offset with the same range of each target, one
+    // result per target
+    virtual void dedupe(int source, std::uint64_t offset, std::uint64_t length,
+                        const std::vector<int>& targets, std::vector<RangeResult>& results) = 0;
+    // Replace target with a hard link to source. Throws std::filesystem::filesystem_error.
+    virtual void link(const std::filesystem::path& source, const std::filesystem::path& target) = 0;
+};
+
+// FIDEDUPERANGE and link(2). Elsewhere than Linux dedupe reports EOPNOTSUPP.
+// A hard link is made under a temporary name and renamed over the target, so the
+// target is never missing; it takes the source's owner, mode and times.
+class SystemReclaimBackend : public ReclaimBackend {
+public:
+    int open(const std::filesystem::path& path, bool target) override;
+    void close(int handle) override;
+    void dedupe(int source, std::uint64_t offset, std::uint64_t length,
+                const std::vector<int>& targets, std::vector<RangeResult>& results) override;
+    void link(const std::filesystem::path& source, const std::filesystem::path& target) override;
+};
+
+// Acts on duplicate groups: in each, the most linked path on a device stays and every
+// other copy on that device is deduplicated against it or replaced by a link to it.
+// Directories and groups with nothing to reclaim are left alone. Copies are batched
+// per source and the batches run on a pool.
+//
+// Hard links aren't checked again before replacing, so HardLink is only safe on a
+// tree nothing writes to between finding and reclaiming. FIDEDUPERANGE compares
+// under lock, a copy changed since is reported as differing and left as it is.
+class Reclaimer {
+public:
+    // FIDEDUPERANGE takes at most a page of targets
+    static constexpr unsigned MAX_BATCH = 127;
+
+    struct Stats {
+        std::size_t groups = 0;         // Groups with copies to reclaim
+        std::size_t skipped = 0;        // Groups left alone, see ReclaimOptions::unconfirmed
+        std::size_t files = 0;          // Copies deduplicated or linked in full
+        std::size_t differed = 0;       // Copies the kernel found no longer match
+        std::uintmax_t bytes = 0;       // Bytes deduplicated or freed; ranges already shared count again
+        double seconds = 0;
+        bool cancelled = false;
+        std::vector<std::pair<std::filesystem::path, std::string>> failed;     // Copies left as they were, with why
+
+        double bytesPerSecond() const { return seconds > 0 ? bytes / seconds : 0; }
+    };
+
+    explicit Reclaimer(ReclaimOptions options = ReclaimOptions());
+    Reclaimer(ReclaimOptions options, ReclaimBackend& backend);
+
+    Stats reclaim(const std::vector<const DuplicateFiles*>& groups, Progress& progress);
+
+    // The identical file groups found, largest first
+    static std::vector<const DuplicateFiles*> identicalFiles(const DuplicateFinder& finder);
+
+private:
+    struct Batch {
+        std::filesystem::path source;
+        std::vector<std::filesystem::path> targets;
+        std::vector<bool> repeated;     // Target is another link to an earlier target's inode
+        std::uintmax_t size = 0;
+    };
+
+    // Shared by the batches of one reclaim
+    struct Run {
+        std::atomic<std::uintmax_t> done{ 0 };     // Bytes through so far
+        std::atomic<bool> cancelled{ false };
+    };
+
+    bool trusted(const DuplicateFiles& group) const;
+    void dedupe(const Batch& batch, Stats& stats, Run& run);
+    void link(const Batch& batch, Stats& stats, Run& run);
+
+    ReclaimOptions options_;
+    std::unique_ptr<ReclaimBackend> owned_;
+    ReclaimBackend* backend_;
+};
+
+} // namespace dedupe
@@ -52,7 +52,7 @@ std::vector<DuplicateGroup> Scanner::process_size_groups(
     Progress& progress) {
     
     std::vector<DuplicateGroup> result;
-    std::unordered_map<std::string, DuplicateGroup> hash_groups;
+    std::unordered_map<Digest, DuplicateGroup> hash_groups;
 
     // Only process groups with more than one file
     for (const auto& [size, files] : size_groups) {
@@ -65,9 +65,9 @@ std::vector<DuplicateGroup> Scanner::process_size_groups(
             }
 
             try {
-                std::string hash = Hasher::hash_file(file, progress);
+                Digest hash = Hasher::hash_file(file, progress);
                 if (!hash.empty()) {
-                    hash_groups[hash].hash = hash;
+                    hash_groups[hash].hash = hash.toHex();
                     hash_groups[hash].files.push_back(file);
                 }
             } catch (const std::exception& e) {
@@ -0,0 +1,550 @@
+#include "sharded_scan.hpp"
+#include "listing.hpp"
+#include "temp_directory.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace dedupe {
+
+namespace {
+
+// One file in a shard file, with its digest once hashed
+struct Entry {
+    std::uint64_t size = 0;
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    Digest digest;
+    std::filesystem::path::string_type path;
+
+    bool sameInode(const Entry& other) const {
+        return size == other.size && device == other.device && inode == other.inode;
+    }
+};
+
+// Leads every shard file, rewritten once the shard is done
+struct Counts {
+    std::uint64_t files = 0;
+    std::uint64_t directories = 0;
+    std::uint64_t errors = 0;
+    std::uint64_t hashed = 0;
+};
+
+class ShardWriter {
+public:
+    explicit ShardWriter(const std::filesystem::path& file)
+        : file_(file)
+        , out_(file, std::ios::binary | std::ios::trunc)
+    {
+        write(Counts());
+    }
+
+    void add(const Entry& entry) {
+        auto length = static_cast<std::uint32_t>(entry.path.size());
+        out_.write(reinterpret_cast<const char*>(&entry.size), sizeof(entry.size));
+        out_.write(reinterpret_cast<const char*>(&entry.device), sizeof(entry.device));
+        out_.write(reinterpret_cast<const char*>(&entry.inode), sizeof(entry.inode));
+        out_.write(reinterpret_cast<const char*>(entry.digest.bytes.data()), Digest::SIZE);
+        out_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out_.write(reinterpret_cast<const char*>(entry.path.data()), length * sizeof(entry.path[0]));
+    }
+
+    void finish(const Counts& counts) {
+        out_.seekp(0);
+        write(counts);
+        out_.close();
+        if (!out_) {
+            throw std::runtime_error("Cannot write shard file: " + file_.string());
+        }
+    }
+
+private:
+    void write(const Counts& counts) {
+        out_.write(reinterpret_cast<const char*>(&counts), sizeof(counts));
+    }
+
+    std::filesystem::path file_;
+    std::ofstream out_;
+};
+
+class ShardReader {
+public:
+    explicit ShardReader(const std::filesystem::path& file)
+        : in_(file, std::ios::binary)
+    {
+        if (!in_.read(reinterpret_cast<char*>(&counts_), sizeof(counts_))) {
+            throw std::runtime_error("Cannot read shard file: " + file.string());
+        }
+    }
+
+    const Counts& counts() const { return counts_; }
+
+    bool next(Entry& entry) {
+        std::uint32_t length = 0;
+        in_.read(reinterpret_cast<char*>(&entry.size), sizeof(entry.size));
+        in_.read(reinterpret_cast<char*>(&entry.device), sizeof(entry.device));
+        in_.read(reinterpret_cast<char*>(&entry.inode), sizeof(entry.inode));
+        in_.read(reinterpret_cast<char*>(entry.digest.bytes.data()), Digest::SIZE);
+        in_.read(reinterpret_cast<char*>(&length), sizeof(length));
+        entry.path.resize(length);
+        in_.read(reinterpret_cast<char*>(entry.path.data()), length * sizeof(entry.path[0]));
+        return static_cast<bool>(in_);
+    }
+
+private:
+    std::ifstream in_;
+    Counts counts_;
+};
+
+Entry entry_of(const std::filesystem::path& path, const DirectoryEntry& listed) {
+    Entry entry;
+    entry.size = listed.size;
+    entry.device = listed.device;
+    entry.inode = listed.inode;
+    entry.path = path.native();
+    return entry;
+}
+
+// A subtree to be walked by one shard, with what the estimate listed of it
+struct Subtree {
+    std::filesystem::path path;
+    std::uint64_t estimate = 1;
+    std::vector<DirectoryEntry> entries;
+};
+
+Subtree estimate(const std::filesystem::path& path) {
+    Subtree subtree;
+    subtree.path = path;
+    try {
+        list_directory(path, subtree.entries);
+    }
+    catch (const std::exception&) {
+        return subtree;
+    }
+    subtree.estimate += subtree.entries.size();
+    std::vector<DirectoryEntry> below;
+    for (const auto& entry : subtree.entries) {
+        if (!entry.isDirectory) continue;
+        try {
+            list_directory(path / entry.name, below);
+            subtree.estimate += below.size();
+        }
+        catch (const std::exception&) {
+        }
+    }
+    return subtree;
+}
+
+// Hash one shard's size groups: every inode's head, or whole file when that
+// covers it, then in full those whose heads still agree. Writes the entries of
+// inodes that share their digest with another.
+Counts hash_shard(std::vector<Entry>& entries, const ShardOptions& options, unsigned threads, ShardWriter& out) {
+    Counts counts;
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return std::tie(a.size, a.device, a.inode, a.path) < std::tie(b.size, b.device, b.inode, b.path);
+    });
+    std::vector<std::size_t> firsts;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        if (i == 0 || !entries[i].sameInode(entries[i - 1])) {
+            firsts.push_back(i);
+        }
+    }
+
+    ThreadPool pool(threads);
+    std::atomic<std::uint64_t> errors{ 0 };
+    Progress quiet;
+    std::vector<Digest> digests(firsts.size());
+    auto hashAll = [&](const std::vector<std::size_t>& inodes, bool head) {
+        for (auto k : inodes) {
+            pool.submit([&, k, head]() {
+                const auto& entry = entries[firsts[k]];
+                try {
+                    if (entry.size == 0) {
+                        digests[k] = Hasher::fake_size_hash(0);
+                    }
+                    else if (!head || entry.size <= options.headSize) {
+                        digests[k] = Hasher::hash_file(entry.path, quiet, false, options.readMode, options.algorithm);
+                    }
+                    else {
+                        digests[k] = Hasher::hash_ranges(entry.path, quiet, { { 0, options.headSize } },
+                                                         options.algorithm, entry.size);
+                    }
+                }
+                catch (const std::exception&) {
+                    digests[k] = Digest();
+                    ++errors;
+                }
+            });
+        }
+        pool.wait();
+        counts.hashed += inodes.size();
+    };
+
+    // Runs of inodes sharing size and digest, at least two long
+    auto shared = [&]() {
+        std::vector<std::size_t> order;
+        for (std::size_t k = 0; k < firsts.size(); ++k) {
+            if (!digests[k].empty()) {
+                order.push_back(k);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+            return std::tie(entries[firsts[a]].size, digests[a]) < std::tie(entries[firsts[b]].size, digests[b]);
+        });
+        std::vector<std::vector<std::size_t>> runs;
+        for (std::size_t i = 0; i < order.size();) {
+            std::size_t j = i + 1;
+            while (j < order.size() && entries[firsts[order[j]]].size == entries[firsts[order[i]]].size
+                   && digests[order[j]] == digests[order[i]]) {
+                ++j;
+            }
+            if (j - i > 1) {
+                runs.emplace_back(order.begin() + i, order.begin() + j);
+            }
+            i = j;
+        }
+        return runs;
+    };
+
+    std::vector<std::size_t> all(firsts.size());
+    for (std::size_t k = 0; k < all.size(); ++k) {
+        all[k] = k;
+    }
+    hashAll(all, true);
+
+    // Whole-file digests from the head pass are final, the rest are read in full
+    std::vector<bool> candidate(firsts.size(), false);
+    std::vector<std::size_t> full;
+    for (const auto& run : shared()) {
+        for (auto k : run) {
+            candidate[k] = true;
+            if (entries[firsts[k]].size > options.headSize) {
+                full.push_back(k);
+            }
+        }
+    }
+    for (std::size_t k = 0; k < digests.size(); ++k) {
+        if (!candidate[k]) {
+            digests[k].clear();
+        }
+    }
+    if (!full.empty()) {
+        hashAll(full, false);
+    }
+
+    for (const auto& run : shared()) {
+        for (auto k : run) {
+            std::size_t end = k + 1 < firsts.size() ? firsts[k + 1] : entries.size();
+            for (std::size_t i = firsts[k]; i < end; ++i) {
+                entries[i].digest = digests[k];
+                out.add(entries[i]);
+            }
+        }
+    }
+    counts.errors = errors;
+    return counts;
+}
+
+} // namespace
+
+std::vector<std::vector<std::size_t>> ShardedScan::balance(const std::vector<std::uint64_t>& weights,
+                                                           unsigned shards) {
+    std::vector<std::vector<std::size_t>> dealt(std::max(shards, 1u));
+    std::vector<std::uint64_t> loads(dealt.size(), 0);
+    std::vector<std::size_t> order(weights.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) { return weights[a] > weights[b]; });
+    for (auto i : order) {
+        auto lightest = std::min_element(loads.begin(), loads.end()) - loads.begin();
+        dealt[lightest].push_back(i);
+        loads[lightest] += weights[i];
+    }
+    return dealt;
+}
+
+bool ShardedScan::runWorkers(const std::vector<std::function<bool()>>& jobs, Progress& progress,
+                             const std::string& label) {
+    auto report = [&](std::size_t done) {
+        std::stringstream ss;
+        ss << done << "/" << jobs.size() << " " << label;
+        progress.report(ss.str(), jobs.empty() ? 1.0 : static_cast<double>(done) / jobs.size());
+    };
+#if defined(__unix__) || defined(__APPLE__)
+    if (options_.processes) {
+        std::vector<pid_t> running;
+        bool failed = false, cancelled = false;
+        for (const auto& job : jobs) {
+            pid_t pid = ::fork();
+            if (pid == 0) {
+                // Nothing of the parent's runs here: no atexit handlers, no stdio flush
+                int code = 1;
+                try {
+                    code = job() ? 0 : 1;
+                }
+                catch (...) {
+                }
+                ::_exit(code);
+            }
+            if (pid < 0) {
+                failed = true;
+                break;
+            }
+            running.push_back(pid);
+        }
+        if (failed) {
+            for (auto pid : running) {
+                ::kill(pid, SIGKILL);
+            }
+        }
+
+        std::size_t total = running.size(), done = 0;
+        while (done < total) {
+            for (auto& pid : running) {
+                int status = 0;
+                if (pid > 0 && ::waitpid(pid, &status, WNOHANG) == pid) {
+                    failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+                    pid = 0;
+                    ++done;
+                }
+            }
+            if (!cancelled && progress.is_cancelled()) {
+                cancelled = true;
+                for (auto pid : running) {
+                    if (pid > 0) ::kill(pid, SIGKILL);
+                }
+            }
+            report(done);
+            if (done < total) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        }
+        if (cancelled) return false;
+        if (failed) {
+            throw std::runtime_error("A shard worker failed: " + label);
+        }
+        return true;
+    }
+#endif
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        if (progress.is_cancelled()) return false;
+        report(i);
+        if (!jobs[i]()) {
+            throw std::runtime_error("A shard worker failed: " + label);
+        }
+    }
+    return true;
+}
+
+bool ShardedScan::find(const std::filesystem::path& root, Progress& progress, const GroupCallback& found) {
+    stats_ = ShardStats();
+    unsigned shards = std::max(options_.shards, 1u);
+    unsigned threads = options_.threads ? options_.threads : std::max(1u, ThreadPool::resolveThreads(0) / shards);
+    TempDirectory temp(options_.tempDirectory, "dedupe-shards");
+    auto shardFile = [&](const char* kind, std::size_t i) {
+        return temp.path / (std::string(kind) + "-" + std::to_string(i));
+    };
+    auto start = std::chrono::steady_clock::now();
+
+    // The root's own files are the coordinator's, its subdirectories are dealt out.
+    // A subtree too heavy for one shard is opened up and its subdirectories dealt instead.
+    ShardWriter rootFiles(shardFile("scan", shards));
+    Counts rootCounts;
+    std::vector<Subtree> subtrees;
+    auto take = [&](const std::filesystem::path& dir, const std::vector<DirectoryEntry>& entries) {
+        for (const auto& listed : entries) {
+            if (listed.error) {
+                ++rootCounts.errors;
+            }
+            else if (listed.isDirectory) {
+                ++rootCounts.directories;
+                subtrees.push_back(estimate(dir / listed.name));
+            }
+            else {
+                ++rootCounts.files;
+                rootFiles.add(entry_of(dir / listed.name, listed));
+            }
+        }
+    };
+    std::vector<DirectoryEntry> entries;
+    list_directory(root, entries, nullptr, options_.recursive);
+    take(root, entries);
+    for (unsigned opened = 0; opened < 4 * shards && !subtrees.empty(); ++opened) {
+        std::uint64_t total = 0;
+        for (const auto& subtree : subtrees) {
+            total += subtree.estimate;
+        }
+        auto heaviest = std::max_element(subtrees.begin(), subtrees.end(), [](const auto& a, const auto& b) {
+            return a.estimate < b.estimate;
+        });
+        bool nested = std::any_of(heaviest->entries.begin(), heaviest->entries.end(),
+                                  [](const auto& e) { return e.isDirectory; });
+        if (subtrees.size() >= 4 * shards || heaviest->estimate * shards <= total || !nested) break;
+        auto opening = std::move(*heaviest);
+        subtrees.erase(heaviest);
+        take(opening.path, opening.entries);
+        if (progress.is_cancelled()) return false;
+    }
+    rootFiles.finish(rootCounts);
+
+    std::vector<std::uint64_t> weights;
+    for (const auto& subtree : subtrees) {
+        weights.push_back(subtree.estimate);
+    }
+    auto dealt = balance(weights, shards);
+    std::vector<std::function<bool()>> jobs;
+    for (unsigned i = 0; i < shards; ++i) {
+        jobs.push_back([&, i]() {
+            ShardWriter out(shardFile("scan", i));
+            WalkCounts walked;
+            auto file = [&](const std::filesystem::path& path, const DirectoryEntry& listed) {
+                out.add(entry_of(path, listed));
+            };
+            for (auto s : dealt[i]) {
+                walk_files(subtrees[s].path, true, file, walked);
+            }
+            Counts counts;
+            counts.files = walked.files;
+            counts.directories = walked.directories;
+            counts.errors = walked.errors;
+            out.finish(counts);
+            return true;
+        });
+    }
+    if (!runWorkers(jobs, progress, "Scanning shards")) return false;
+    stats_.scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+
+    // Sizes across all shards, then the ones held by more than one inode dealt out by bytes
+    struct SizeInfo {
+        std::uint64_t device, inode;
+        std::uint64_t files = 0;
+        bool shared = false;
+    };
+    std::unordered_map<std::uint64_t, SizeInfo> sizes;
+    for (std::size_t i = 0; i <= shards; ++i) {
+        ShardReader in(shardFile("scan", i));
+        stats_.files += in.counts().files;
+        stats_.directories += in.counts().directories;
+        stats_.errors += in.counts().errors;
+        if (i < shards) {
+            stats_.shardFiles.push_back(in.counts().files);
+        }
+        Entry entry;
+        while (in.next(entry)) {
+            auto [it, first] = sizes.try_emplace(entry.size, SizeInfo{ entry.device, entry.inode });
+            auto& info = it->second;
+            ++info.files;
+            info.shared |= !first && (info.device != entry.device || info.inode != entry.inode);
+        }
+    }
+    std::vector<std::uint64_t> candidateSizes;
+    weights.clear();
+    for (const auto& [size, info] : sizes) {
+        if (info.shared) {
+            candidateSizes.push_back(size);
+            weights.push_back(std::max<std::uint64_t>(size, 4096) * info.files);
+        }
+    }
+    std::unordered_map<std::uint64_t, std::size_t> sizeShard;
+    dealt = balance(weights, shards);
+    for (std::size_t i = 0; i < dealt.size(); ++i) {
+        for (auto c : dealt[i]) {
+            sizeShard[candidateSizes[c]] = i;
+        }
+    }
+    sizes.clear();
+
+    {
+        std::vector<std::unique_ptr<ShardWriter>> work;
+        for (unsigned i = 0; i < shards; ++i) {
+            work.push_back(std::make_unique<ShardWriter>(shardFile("work", i)));
+        }
+        stats_.shardCandidates.assign(shards, 0);
+        for (std::size_t i = 0; i <= shards; ++i) {
+            ShardReader in(shardFile("scan", i));
+            Entry entry;
+            while (in.next(entry)) {
+                auto it = sizeShard.find(entry.size);
+                if (it == sizeShard.end()) continue;
+                work[it->second]->add(entry);
+                ++stats_.shardCandidates[it->second];
+                ++stats_.candidates;
+            }
+        }
+        for (auto& writer : work) {
+            writer->finish(Counts());
+        }
+    }
+
+    jobs.clear();
+    for (unsigned i = 0; i < shards; ++i) {
+        jobs.push_back([&, i]() {
+            std::vector<Entry> work;
+            ShardReader in(shardFile("work", i));
+            Entry entry;
+            while (in.next(entry)) {
+                work.push_back(std::move(entry));
+            }
+            ShardWriter out(shardFile("hashed", i));
+            out.finish(hash_shard(work, options_, threads, out));
+            return true;
+        });
+    }
+    if (!runWorkers(jobs, progress, "Hashing shards")) return false;
+
+    // Merge the digests, what shares size and digest is a group
+    std::vector<Entry> hashed;
+    for (unsigned i = 0; i < shards; ++i) {
+        ShardReader in(shardFile("hashed", i));
+        stats_.hashed += in.counts().hashed;
+        stats_.errors += in.counts().errors;
+        Entry entry;
+        while (in.next(entry)) {
+            hashed.push_back(std::move(entry));
+        }
+    }
+    std::sort(hashed.begin(), hashed.end(), [](const Entry& a, const Entry& b) {
+        return std::tie(a.size, a.digest, a.device, a.inode, a.path) < std::tie(b.size, b.digest, b.device, b.inode, b.path);
+    });
+    StreamGroup group;
+    for (std::size_t i = 0; i < hashed.size();) {
+        group.size = hashed[i].size;
+        group.hash = hashed[i].digest;
+        group.paths.clear();
+        group.copies = 0;
+        std::size_t j = i;
+        for (; j < hashed.size() && hashed[j].size == group.size && hashed[j].digest == group.hash; ++j) {
+            group.copies += j == i || !hashed[j].sameInode(hashed[j - 1]);
+            group.paths.emplace_back(hashed[j].path);
+        }
+        if (group.copies > 1) {
+            ++stats_.groups;
+            stats_.duplicates += group.paths.size();
+            stats_.reclaimableBytes += (group.copies - 1) * group.size;
+            found(group);
+        }
+        i = j;
+    }
+    stats_.hashSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+} // namespace dedupe
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "hasher.hpp"
+#include "progress.hpp"
+#include "streaming_finder.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dedupe {
+
+struct ShardOptions {
+    unsigned shards = 4;                // Worker processes
+    unsigned threads = 0;               // Hashing threads per worker, 0 = hardware concurrency / shards
+    bool processes = true;              // false runs each shard's work here in turn, as without fork
+    bool recursive = true;
+    ReadMode readMode = ReadMode::Stream;
+    HashAlgorithm algorithm = HashAlgorithm::Xxh3_128;
+    std::uintmax_t headSize = 8192;     // Bytes hashed before files of a size are read in full
+    std::filesystem::path tempDirectory;    // Shard files, empty = system temp
+};
+
+struct ShardStats {
+    std::uint64_t files = 0;
+    std::uint64_t directories = 0;
+    std::uint64_t candidates = 0;       // Files sharing their size with another inode
+    std::uint64_t hashed = 0;           // Inodes read, by head and full hash together
+    std::uint64_t groups = 0;
+    std::uint64_t duplicates = 0;       // Paths in groups
+    std::uintmax_t reclaimableBytes = 0;
+    std::uint64_t errors = 0;
+    std::vector<std::uint64_t> shardFiles;      // Files each shard scanned, the root's own not included
+    std::vector<std::uint64_t> shardCandidates; // Files each shard hashed
+    double scanSeconds = 0;
+    double hashSeconds = 0;
+};
+
+// Duplicate finding spread over worker processes, for storage whose metadata
+// servers one process can't keep busy. The coordinator lists root and splits its
+// subdirectories among the shards by an estimate from listing two levels down,
+// opening up any subtree too big for one shard. Each worker walks its subtrees
+// and writes what it found to a file. The coordinator then merges sizes across
+// shards and deals every size held by more than one inode to a shard, balanced by
+// bytes, so each size group is hashed whole in one place: heads first, then in
+// full where heads agree. Workers write digests back to files, and merging those
+// gives the same groups as a single-process scan.
+//
+// Workers are forked; fork() copies only the calling thread, so start a scan
+// before any other threads hold locks. Hard links are read once and count as one copy.
+class ShardedScan {
+public:
+    using GroupCallback = std::function<void(const StreamGroup&)>;
+
+    explicit ShardedScan(ShardOptions options = ShardOptions()) : options_(std::move(options)) {}
+
+    // Scan root and call found for each group of duplicates, in order of size then
+    // digest. Returns false if cancelled. Throws std::runtime_error when a worker
+    // fails or shard files can't be written.
+    bool find(const std::filesystem::path& root, Progress& progress, const GroupCallback& found);
+
+    const ShardStats& stats() const { return stats_; }
+
+    // Deal weights out to shards, heaviest first onto the lightest shard. Returns
+    // the indices of the weights each shard got.
+    static std::vector<std::vector<std::size_t>> balance(const std::vector<std::uint64_t>& weights, unsigned shards);
+
+private:
+    // Run the jobs in worker processes, or in turn without them. Returns false if cancelled.
+    bool runWorkers(const std::vector<std::function<bool()>>& jobs, Progress& progress, const std::string& label);
+
+    ShardOptions options_;
+    ShardStats stats_;
+};
+
+} // namespace dedupe
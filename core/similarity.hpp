@@ -0,0 +1,111 @@
+#pragma once
+
+#include "digest.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace dedupe {
+
+// MinHash sketch of a set of file digests: for each of SIZE hash functions, the
+// smallest value any member hashes to. Two sketches agree in a slot with
+// probability equal to the Jaccard similarity of their sets, and the sketch of a
+// union is the slotwise minimum, so a directory's comes from its children's.
+class MinHash {
+public:
+    static constexpr std::size_t SIZE = 128;
+
+    MinHash() { mins_.fill(EMPTY); }
+
+    // Sketch of the set holding just digest
+    static MinHash of(const Digest& digest) {
+        // Fold the whole digest, faked size hashes only fill the first bytes
+        std::uint64_t words[Digest::SIZE / 8];
+        std::memcpy(words, digest.bytes.data(), sizeof(words));
+        std::uint64_t x = 0;
+        for (auto w : words) {
+            x = mix(x ^ w);
+        }
+        MinHash sketch;
+        for (std::size_t i = 0; i < SIZE; ++i) {
+            sketch.mins_[i] = static_cast<std::uint32_t>(mix(x + (i + 1) * 0x9e3779b97f4a7c15ULL) >> 32);
+        }
+        return sketch;
+    }
+
+    void merge(const MinHash& other) {
+        for (std::size_t i = 0; i < SIZE; ++i) {
+            mins_[i] = std::min(mins_[i], other.mins_[i]);
+        }
+    }
+
+    bool empty() const { return mins_[0] == EMPTY && mins_[1] == EMPTY; }
+
+    // Estimated Jaccard similarity of the two sets
+    double similarity(const MinHash& other) const {
+        std::size_t same = 0;
+        for (std::size_t i = 0; i < SIZE; ++i) {
+            same += mins_[i] == other.mins_[i];
+        }
+        return static_cast<double>(same) / SIZE;
+    }
+
+    const std::array<std::uint32_t, SIZE>& values() const { return mins_; }
+
+    // splitmix64 finaliser
+    static std::uint64_t mix(std::uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+private:
+    static constexpr std::uint32_t EMPTY = ~std::uint32_t(0);
+
+    std::array<std::uint32_t, SIZE> mins_;
+};
+
+// Locality sensitive hashing over sketches: each is cut into bands of rows slots,
+// and two sharing any band exactly become a candidate pair, so similar sketches
+// are found without comparing every pair. A pair with similarity s is caught with
+// probability 1 - (1 - s^rows)^bands. With 16 bands of 8 rows that is 95% at 0.8
+// and 6% at 0.5; with 32 bands of 4 rows, 99% at 0.6.
+// Returns index pairs (first < second) into sketches, each once.
+inline std::vector<std::pair<std::size_t, std::size_t>> similar_candidates(const std::vector<MinHash>& sketches,
+                                                                          std::size_t rows = 8) {
+    std::unordered_set<std::uint64_t> seen;
+    std::vector<std::pair<std::size_t, std::size_t>> pairs;
+    std::unordered_map<std::uint64_t, std::vector<std::size_t>> buckets;
+    for (std::size_t band = 0; band + rows <= MinHash::SIZE; band += rows) {
+        buckets.clear();
+        for (std::size_t i = 0; i < sketches.size(); ++i) {
+            const auto& values = sketches[i].values();
+            std::uint64_t key = band;
+            for (std::size_t r = band; r < band + rows; ++r) {
+                key = MinHash::mix(key ^ values[r]);
+            }
+            buckets[key].push_back(i);
+        }
+        for (const auto& [key, members] : buckets) {
+            for (std::size_t a = 0; a < members.size(); ++a) {
+                for (std::size_t b = a + 1; b < members.size(); ++b) {
+                    auto pair = std::make_pair(members[a], members[b]);
+                    if (seen.insert((static_cast<std::uint64_t>(pair.first) << 32) | pair.second).second) {
+                        pairs.push_back(pair);
+                    }
+                }
+            }
+        }
+    }
+    return pairs;
+}
+
+} // namespace dedupe
@@ -0,0 +1,274 @@
+#include "streaming_finder.hpp"
+#include "external_sort.hpp"
+#include "listing.hpp"
+#include "temp_directory.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+namespace dedupe {
+
+namespace {
+
+// One file as the passes see it, paths stay on disk
+struct Record {
+    std::uint64_t size;
+    Digest digest;              // Empty until hashed
+    std::uint64_t device;
+    std::uint64_t inode;
+    std::uint64_t path;         // Offset into the PathStore
+
+    bool sameKey(const Record& other) const { return size == other.size && digest == other.digest; }
+    bool sameInode(const Record& other) const { return device == other.device && inode == other.inode; }
+};
+
+// By size and digest, with links to one inode next to each other
+struct RecordLess {
+    bool operator()(const Record& a, const Record& b) const {
+        return std::tie(a.size, a.digest, a.device, a.inode, a.path)
+             < std::tie(b.size, b.digest, b.device, b.inode, b.path);
+    }
+};
+
+using Sorter = ExternalSorter<Record, RecordLess>;
+
+// Paths appended to a file as length and characters, found again by offset
+class PathStore {
+public:
+    explicit PathStore(std::filesystem::path file)
+        : file_(std::move(file))
+        , out_(file_, std::ios::binary | std::ios::trunc)
+    {
+        if (!out_) {
+            throw std::runtime_error("Cannot write path file: " + file_.string());
+        }
+    }
+
+    std::uint64_t add(const std::filesystem::path& path) {
+        const auto& native = path.native();
+        auto length = static_cast<std::uint32_t>(native.size());
+        auto offset = offset_;
+        out_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out_.write(reinterpret_cast<const char*>(native.data()), length * sizeof(native[0]));
+        offset_ += sizeof(length) + length * sizeof(native[0]);
+        return offset;
+    }
+
+    // No more paths, switch to reading
+    void finish() {
+        out_.close();
+        if (!out_) {
+            throw std::runtime_error("Cannot write path file: " + file_.string());
+        }
+        in_.open(file_, std::ios::binary);
+    }
+
+    std::filesystem::path get(std::uint64_t offset) {
+        std::uint32_t length = 0;
+        in_.seekg(static_cast<std::streamoff>(offset));
+        in_.read(reinterpret_cast<char*>(&length), sizeof(length));
+        std::filesystem::path::string_type native(length, 0);
+        in_.read(reinterpret_cast<char*>(native.data()), length * sizeof(native[0]));
+        if (!in_) {
+            throw std::runtime_error("Cannot read path file: " + file_.string());
+        }
+        return native;
+    }
+
+private:
+    std::filesystem::path file_;
+    std::ofstream out_;
+    std::ifstream in_;
+    std::uint64_t offset_ = 0;
+};
+
+// Merge input and pass on the records of every key held by at least two inodes.
+// A key's records are held back only until a second inode shows up.
+template<typename Visit>
+void candidates(Sorter& input, Visit&& visit) {
+    std::vector<Record> pending;
+    bool open = false;
+    Record key{};
+    input.merge([&](const Record& record) {
+        if (!record.sameKey(key)) {
+            pending.clear();
+            open = false;
+            key = record;
+        }
+        if (open) {
+            visit(record);
+        }
+        else if (pending.empty() || record.sameInode(pending.front())) {
+            pending.push_back(record);
+        }
+        else {
+            for (const auto& held : pending) {
+                visit(held);
+            }
+            pending.clear();
+            open = true;
+            visit(record);
+        }
+    });
+}
+
+} // namespace
+
+bool StreamingFinder::find(const std::filesystem::path& root, Progress& progress, const GroupCallback& found) {
+    stats_ = StreamStats();
+    TempDirectory temp(options_.tempDirectory, "dedupe-stream");
+    PathStore paths(temp.path / "paths");
+    // One sort is read while the next is filled
+    std::size_t sortMemory = options_.memoryBudget / 2;
+    std::size_t batchSize = std::max<std::size_t>(options_.batchSize, 1);
+
+    std::atomic<bool> cancelled{ false };
+    std::atomic<std::uint64_t> errors{ 0 };
+    Progress workerProgress(nullptr, [&]() { return cancelled.load(); });
+
+    // Walk depth first, pending directories are the only thing kept
+    auto bySize = std::make_unique<Sorter>(temp.path, sortMemory);
+    WalkCounts walked;
+    auto file = [&](const std::filesystem::path& path, const DirectoryEntry& entry) {
+        bySize->push(Record{ entry.size, Digest(), entry.device, entry.inode, paths.add(path) });
+    };
+    bool complete = walk_files(root, options_.recursive, file, walked, [&](const std::filesystem::path& dir) {
+        std::stringstream ss;
+        ss << walked.files + walked.directories << " Scanning directory: " << dir.string();
+        progress.report(ss.str(), 0.0);
+        return !progress.is_cancelled();
+    });
+    if (!complete) return false;
+    stats_.files = walked.files;
+    stats_.directories = walked.directories;
+    errors += walked.errors;
+    paths.finish();
+
+    // Hash batches of records on the pool into output, each inode once. A batch only
+    // ends between inodes so all links to one get its digest.
+    ThreadPool pool(options_.threads);
+    std::vector<Record> batch;
+    auto hashBatch = [&](Sorter& output, bool head, std::uint64_t& hashed, const std::string& label, double value) {
+        std::vector<std::size_t> firsts;
+        std::vector<std::filesystem::path> files;
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (i == 0 || !batch[i].sameInode(batch[i - 1])) {
+                firsts.push_back(i);
+                files.push_back(paths.get(batch[i].path));
+            }
+        }
+        std::vector<Digest> digests(firsts.size());
+        std::atomic<std::size_t> done{ 0 };
+        for (std::size_t k = 0; k < firsts.size(); ++k) {
+            pool.submit([&, k]() {
+                if (cancelled) return;
+                auto size = batch[firsts[k]].size;
+                try {
+                    if (size == 0) {
+                        digests[k] = Hasher::fake_size_hash(0);
+                    }
+                    else if (!head || size <= options_.headSize) {
+                        digests[k] = Hasher::hash_file(files[k], workerProgress, false, options_.readMode,
+                                                       options_.algorithm);
+                    }
+                    else {
+                        digests[k] = Hasher::hash_ranges(files[k], workerProgress, { { 0, options_.headSize } },
+                                                         options_.algorithm, size);
+                    }
+                }
+                catch (const std::exception&) {
+                    ++errors;
+                }
+                ++done;
+            });
+        }
+        pool.wait([&]() {
+            if (progress.is_cancelled()) {
+                cancelled = true;
+            }
+            std::stringstream ss;
+            ss << hashed + done << "/" << stats_.candidates << " " << label;
+            progress.report(ss.str(), value);
+        });
+        hashed += firsts.size();
+        for (std::size_t k = 0; k < firsts.size(); ++k) {
+            if (digests[k].empty()) continue;
+            std::size_t end = k + 1 < firsts.size() ? firsts[k + 1] : batch.size();
+            for (std::size_t i = firsts[k]; i < end; ++i) {
+                batch[i].digest = digests[k];
+                output.push(batch[i]);
+            }
+        }
+        batch.clear();
+    };
+
+    // A pass hashes the candidates of input into output. Files already hashed whole
+    // by the head pass are passed on as they are.
+    auto pass = [&](Sorter& input, Sorter& output, bool head, std::uint64_t& hashed, const std::string& label,
+                    double value) {
+        candidates(input, [&](const Record& record) {
+            if (cancelled) return;
+            if (head) {
+                ++stats_.candidates;
+            }
+            if (!head && (record.size == 0 || record.size <= options_.headSize)) {
+                output.push(record);
+                return;
+            }
+            if (batch.size() >= batchSize && !record.sameInode(batch.back())) {
+                hashBatch(output, head, hashed, label, value);
+            }
+            batch.push_back(record);
+        });
+        if (!batch.empty() && !cancelled) {
+            hashBatch(output, head, hashed, label, value);
+        }
+        batch.clear();
+        stats_.runs += input.runs();
+    };
+
+    auto byHead = std::make_unique<Sorter>(temp.path, sortMemory);
+    pass(*bySize, *byHead, true, stats_.headHashed, "Hashing heads", 0.3);
+    bySize.reset();
+    if (cancelled) return false;
+
+    auto byContent = std::make_unique<Sorter>(temp.path, sortMemory);
+    pass(*byHead, *byContent, false, stats_.fullHashed, "Hashing files", 0.6);
+    byHead.reset();
+    if (cancelled) return false;
+
+    // What still shares a key is a group
+    StreamGroup group;
+    Record previous{};
+    auto flush = [&]() {
+        if (group.copies > 1) {
+            ++stats_.groups;
+            stats_.duplicates += group.paths.size();
+            stats_.reclaimableBytes += (group.copies - 1) * group.size;
+            found(group);
+        }
+        group.paths.clear();
+        group.copies = 0;
+    };
+    candidates(*byContent, [&](const Record& record) {
+        if (!group.paths.empty() && !record.sameKey(previous)) {
+            flush();
+        }
+        group.size = record.size;
+        group.hash = record.digest;
+        group.copies += group.paths.empty() || !record.sameInode(previous);
+        group.paths.push_back(paths.get(record.path));
+        previous = record;
+    });
+    flush();
+    stats_.runs += byContent->runs();
+    stats_.errors = errors;
+    return true;
+}
+
+} // namespace dedupe
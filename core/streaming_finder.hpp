@@ -0,0 +1,76 @@
+#pragma once
+
+#include "digest.hpp"
+#include "hasher.hpp"
+#include "progress.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace dedupe {
+
+struct StreamOptions {
+    std::size_t memoryBudget = 256 * 1024 * 1024;  // Bytes for sort buffers and batches, roughly
+    std::filesystem::path tempDirectory;            // Sort runs and the path file, empty = system temp
+    bool recursive = true;
+    unsigned threads = 0;                           // Hashing workers, 0 = hardware concurrency
+    ReadMode readMode = ReadMode::Stream;
+    HashAlgorithm algorithm = HashAlgorithm::Xxh3_128;
+    std::uintmax_t headSize = 8192;                 // Bytes hashed by the first pass; smaller files are done
+    std::size_t batchSize = 4096;                   // Records hashed together on the pool
+};
+
+// Files found to hold the same content
+struct StreamGroup {
+    std::uintmax_t size = 0;
+    Digest hash;
+    std::vector<std::filesystem::path> paths;
+    std::size_t copies = 0;         // Distinct inodes among paths, hard links are one copy
+};
+
+struct StreamStats {
+    std::uint64_t files = 0;
+    std::uint64_t directories = 0;
+    std::uint64_t candidates = 0;   // Files sharing their size with another inode
+    std::uint64_t headHashed = 0;   // Inodes read by the head pass, then in full
+    std::uint64_t fullHashed = 0;
+    std::uint64_t groups = 0;
+    std::uint64_t duplicates = 0;   // Paths in groups
+    std::uintmax_t reclaimableBytes = 0;
+    std::size_t runs = 0;           // Sorted runs spilled to disk over all passes, 0 if it all fit
+    std::uint64_t errors = 0;       // Directories or files that couldn't be read
+};
+
+// Duplicate finding for trees too large to hold in memory. No tree is built: the
+// walk writes each file's path to a file on disk and a (size, inode, path id)
+// record to an external sort. Merging the sorted runs brings each size together,
+// and sizes held by a single inode are dropped there. The rest are hashed over
+// their first headSize bytes into another sort, and what still shares size and
+// head digest is hashed in full into a third; merging that one yields the groups.
+// Each pass only holds a batch of records besides its sort buffers, so memory
+// stays near memoryBudget whatever the tree's size, while disk use grows with it.
+//
+// Hard links are read once per pass and count as one copy; groups of one copy
+// aren't reported. Empty files share a group without being read.
+class StreamingFinder {
+public:
+    using GroupCallback = std::function<void(const StreamGroup&)>;
+
+    explicit StreamingFinder(StreamOptions options = StreamOptions()) : options_(std::move(options)) {}
+
+    // Walk root and call found for each group of duplicates, in order of size then
+    // digest. Returns false if cancelled. Throws std::runtime_error when the
+    // temporary files can't be written.
+    bool find(const std::filesystem::path& root, Progress& progress, const GroupCallback& found);
+
+    const StreamStats& stats() const { return stats_; }
+
+private:
+    StreamOptions options_;
+    StreamStats stats_;
+};
+
+} // namespace dedupe
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <system_error>
+
+namespace dedupe {
+
+// A fresh directory for working files, removed with everything in it however the
+// owner's scope ends. Created below parent, or the system temp directory if empty.
+struct TempDirectory {
+    std::filesystem::path path;
+
+    TempDirectory(const std::filesystem::path& parent, const std::string& prefix) {
+        auto base = parent.empty() ? std::filesystem::temp_directory_path() : parent;
+        std::filesystem::create_directories(base);
+        // create_directory is false when the name exists, maybe another run's
+        // directory: draw names until one is created here, so no two runs share one
+        std::random_device device;
+        std::mt19937_64 random((std::uint64_t(device()) << 32)
+            ^ std::uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()));
+        do {
+            path = base / (prefix + "-" + std::to_string(random()));
+        } while (!std::filesystem::create_directory(path));
+    }
+
+    ~TempDirectory() { std::error_code ignored; std::filesystem::remove_all(path, ignored); }
+
+    TempDirectory(const TempDirectory&) = delete;
+    TempDirectory& operator=(const TempDirectory&) = delete;
+};
+
+}
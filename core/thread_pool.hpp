@@ -0,0 +1,193 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dedupe {
+
+// Work-stealing thread pool.
+// Each worker owns a deque: it pops its own work from the back and steals from
+// the front of the others when it runs dry. The thread calling wait() takes part
+// as an extra worker, so a pool of size 1 runs everything on the caller.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(unsigned threads = 0)
+        : queues_(resolveThreads(threads))
+    {
+        for (auto& q : queues_) {
+            q = std::make_unique<Queue>();
+        }
+        // The last queue belongs to whichever thread is waiting
+        for (size_t i = 0; i + 1 < queues_.size(); ++i) {
+            workers_.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& w : workers_) {
+            w.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads taking part in the work, including the waiting thread
+    unsigned size() const { return static_cast<unsigned>(queues_.size()); }
+
+    static unsigned resolveThreads(unsigned threads) {
+        if (threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        return threads == 0 ? 1 : threads;
+    }
+
+    // Queue a task. Tasks submitted from a worker go on that worker's own deque.
+    void submit(Task task) {
+        size_t index = (current().pool == this)
+            ? current().index
+            : next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+        ++pending_;
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            ++queued_;
+        }
+        wake_.notify_one();
+        done_.notify_all();
+    }
+
+    // Help run tasks until every submitted task has finished. The optional tick is
+    // called on this thread between tasks, e.g. to report progress or poll for
+    // cancellation. Rethrows the first exception escaping a task.
+    void wait(const std::function<void()>& tick = nullptr) {
+        Current saved = current();
+        current() = Current{ this, queues_.size() - 1 };
+        while (pending_ > 0) {
+            Task task;
+            if (tryPop(queues_.size() - 1, task) || trySteal(queues_.size() - 1, task)) {
+                run(task);
+            }
+            else {
+                std::unique_lock<std::mutex> lock(wakeMutex_);
+                done_.wait_for(lock, std::chrono::milliseconds(50), [this]() {
+                    return pending_ == 0 || queued_ > 0;
+                });
+            }
+            if (tick) {
+                tick();
+            }
+        }
+        current() = saved;
+
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            std::swap(error, error_);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    struct Current {
+        const ThreadPool* pool = nullptr;
+        size_t index = 0;
+    };
+
+    static Current& current() {
+        static thread_local Current c;
+        return c;
+    }
+
+    bool tryPop(size_t index, Task& task) {
+        auto& q = *queues_[index];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) return false;
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        --queued_;
+        return true;
+    }
+
+    bool trySteal(size_t thief, Task& task) {
+        for (size_t n = 1; n < queues_.size(); ++n) {
+            auto& q = *queues_[(thief + n) % queues_.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty()) {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                --queued_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(Task& task) {
+        try {
+            task();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        if (--pending_ == 0) {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            done_.notify_all();
+        }
+    }
+
+    void workerLoop(size_t index) {
+        current() = Current{ this, index };
+        for (;;) {
+            Task task;
+            if (tryPop(index, task) || trySteal(index, task)) {
+                run(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            wake_.wait(lock, [this]() { return stopping_ || queued_ > 0; });
+            if (stopping_) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::atomic<size_t> pending_{ 0 };
+    std::atomic<long> queued_{ 0 };
+    std::atomic<size_t> next_{ 0 };
+    std::exception_ptr error_;
+    bool stopping_ = false;
+};
+
+} // namespace dedupe
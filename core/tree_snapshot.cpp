@@ -0,0 +1,150 @@
+#include "tree_snapshot.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace dedupe {
+
+namespace {
+
+using Node = ArenaNode<FileSystemNode>;
+
+template<typename T>
+void put(std::ostream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+T get(std::istream& in) {
+    T value;
+    if (!in.read(reinterpret_cast<char*>(&value), sizeof(value))) {
+        throw std::runtime_error("Snapshot is cut short");
+    }
+    return value;
+}
+
+void putString(std::ostream& out, const std::string& s) {
+    put<std::uint32_t>(out, static_cast<std::uint32_t>(s.size()));
+    out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+std::string getString(std::istream& in) {
+    auto length = get<std::uint32_t>(in);
+    std::string s(length, '\0');
+    if (!in.read(&s[0], length)) {
+        throw std::runtime_error("Snapshot is cut short");
+    }
+    return s;
+}
+
+// Pre-order: each node then its children. Nodes only know their names (the
+// root its whole path), as in the tree.
+void writeNode(std::ostream& out, const Node& node) {
+    const auto& d = node.data();
+    putString(out, d.name.path().u8string());
+    put<std::uint8_t>(out, d.isDirectory);
+    put<std::uint64_t>(out, d.size);
+    put<std::uint64_t>(out, d.device);
+    put<std::uint64_t>(out, d.inode);
+    put<std::uint32_t>(out, d.links);
+    put<std::int64_t>(out, d.mtime);
+    put<std::int64_t>(out, d.ctime);
+    out.write(reinterpret_cast<const char*>(d.hash.bytes.data()), Digest::SIZE);
+    put<std::uint8_t>(out, d.hashFlags);
+    put<std::uint32_t>(out, static_cast<std::uint32_t>(node.children().size()));
+    for (auto child : node.children()) {
+        writeNode(out, *child);
+    }
+}
+
+// Into tree's arena. A node's children are read whole, each with everything
+// below it, then linked in one range.
+Node* readNode(std::istream& in, std::uint32_t version, FileSystemTree& tree) {
+    FileSystemNode data(std::filesystem::u8path(getString(in)));
+    data.isDirectory = get<std::uint8_t>(in) != 0;
+    data.size = get<std::uint64_t>(in);
+    data.device = get<std::uint64_t>(in);
+    data.inode = get<std::uint64_t>(in);
+    if (version >= 2) {
+        data.links = get<std::uint32_t>(in);
+    }
+    data.mtime = get<std::int64_t>(in);
+    data.ctime = get<std::int64_t>(in);
+    if (!in.read(reinterpret_cast<char*>(data.hash.bytes.data()), Digest::SIZE)) {
+        throw std::runtime_error("Snapshot is cut short");
+    }
+    data.hashFlags = get<std::uint8_t>(in);
+    auto children = get<std::uint32_t>(in);
+
+    auto node = tree.createNode(std::move(data));
+    std::vector<Node*> read;
+    try {
+        for (std::uint32_t i = 0; i < children; ++i) {
+            read.push_back(readNode(in, version, tree));
+        }
+    }
+    catch (...) {
+        for (auto child : read) {
+            tree.destroyNode(child);
+        }
+        tree.destroyNode(node);
+        throw;
+    }
+    node->addChildren(read);
+    return node;
+}
+
+} // namespace
+
+void TreeSnapshot::save(const std::filesystem::path& file, const FileSystemTree& tree, const Header& header) {
+    auto temp = file;
+    temp += ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Cannot write snapshot: " + temp.string());
+        }
+        put<std::uint32_t>(out, MAGIC);
+        put<std::uint32_t>(out, VERSION);
+        putString(out, header.root.u8string());
+        put<std::uint8_t>(out, header.recursive);
+        put<std::uint64_t>(out, header.fingerprint);
+        put<std::uint8_t>(out, tree.root() != nullptr);
+        if (tree.root()) {
+            writeNode(out, *tree.root());
+        }
+        if (!out) {
+            throw std::runtime_error("Cannot write snapshot: " + temp.string());
+        }
+    }
+    std::filesystem::rename(temp, file);
+}
+
+bool TreeSnapshot::load(const std::filesystem::path& file, FileSystemTree& tree, Header& header) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    try {
+        if (get<std::uint32_t>(in) != MAGIC) {
+            throw std::runtime_error("Not a snapshot");
+        }
+        auto version = get<std::uint32_t>(in);
+        if (version < 1 || version > VERSION) {
+            throw std::runtime_error("Unknown snapshot version");
+        }
+        header.root = std::filesystem::u8path(getString(in));
+        header.recursive = get<std::uint8_t>(in) != 0;
+        header.fingerprint = get<std::uint64_t>(in);
+        if (get<std::uint8_t>(in)) {
+            tree.setRoot(readNode(in, version, tree));
+        }
+    }
+    catch (const std::runtime_error& e) {
+        throw std::runtime_error(std::string(e.what()) + ": " + file.string());
+    }
+    return true;
+}
+
+} // namespace dedupe
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include "filesystem_tree.hpp"
+
+namespace dedupe {
+
+// A scanned tree saved to disk with its hashes, to seed FileSystemTree::rebuildFromPath
+// on the next run. The header records what the tree was built with, so callers
+// can tell whether its listings and hashes still apply.
+class TreeSnapshot {
+public:
+    struct Header {
+        std::filesystem::path root;
+        bool recursive = true;
+        std::uint64_t fingerprint = 0;      // DuplicateFinder::fingerprint of the options used
+    };
+
+    // Written beside file and renamed over it. Throws if it can't be written.
+    static void save(const std::filesystem::path& file, const FileSystemTree& tree, const Header& header);
+
+    // False if there is no snapshot; throws if file isn't one or is cut short
+    static bool load(const std::filesystem::path& file, FileSystemTree& tree, Header& header);
+
+private:
+    static constexpr std::uint32_t MAGIC = 0x53544444;  // "DDTS"
+    static constexpr std::uint32_t VERSION = 2;       // 2 added link counts, 1 still loads
+};
+
+} // namespace dedupe
@@ -0,0 +1,194 @@
+#include "watcher.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+#include <system_error>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#define DEDUPE_HAVE_INOTIFY 1
+#endif
+
+namespace dedupe {
+
+#ifdef DEDUPE_HAVE_INOTIFY
+
+namespace {
+
+// Files are picked up once written and closed rather than on every write, so a
+// file being copied in is hashed once, complete
+constexpr std::uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+    | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+// Whether path is dir or below it
+bool within(const std::string& path, const std::filesystem::path& dir) {
+    const auto& root = dir.native();
+    return path.compare(0, root.size(), root) == 0 && (path.size() == root.size() || path[root.size()] == '/');
+}
+
+} // namespace
+
+Watcher::Watcher(bool recursive)
+    : recursive_(recursive) {
+    fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+Watcher::~Watcher() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool Watcher::add(const std::filesystem::path& dir) {
+    int wd = ::inotify_add_watch(fd_, dir.c_str(), WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            unwatched_.insert(dir.native());
+        }
+        return false;
+    }
+    paths_[wd] = dir;
+    descriptors_[dir.native()] = wd;
+    return true;
+}
+
+void Watcher::forgetUnwatched(const std::filesystem::path& dir) {
+    for (auto it = unwatched_.begin(); it != unwatched_.end();) {
+        it = within(*it, dir) ? unwatched_.erase(it) : std::next(it);
+    }
+}
+
+void Watcher::addTree(const std::filesystem::path& dir) {
+    if (fd_ < 0) return;
+    forgetUnwatched(dir);
+    add(dir);
+    if (!recursive_) return;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(dir, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_directory(ec) && !it->is_symlink(ec)) {
+            add(it->path());
+        }
+    }
+}
+
+void Watcher::removeTree(const std::filesystem::path& dir) {
+    forgetUnwatched(dir);
+    for (auto it = descriptors_.begin(); it != descriptors_.end();) {
+        if (within(it->first, dir)) {
+            ::inotify_rm_watch(fd_, it->second);
+            paths_.erase(it->second);
+            it = descriptors_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+bool Watcher::drain(std::vector<Change>& changes, std::unordered_map<std::string, std::size_t>& seen) {
+    alignas(inotify_event) char buffer[64 * 1024];
+    bool ok = true;
+    for (;;) {
+        ssize_t length = ::read(fd_, buffer, sizeof(buffer));
+        if (length <= 0) break;
+        auto now = Clock::now();
+        for (char* p = buffer; p < buffer + length;) {
+            auto event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                ok = false;
+                continue;
+            }
+            auto dir = paths_.find(event->wd);
+            if (dir == paths_.end()) continue;
+            if (event->mask & IN_IGNORED) {
+                descriptors_.erase(dir->second.native());
+                paths_.erase(dir);
+                continue;
+            }
+
+            auto path = event->len ? dir->second / event->name : dir->second;
+            if (seen.emplace(path.native(), changes.size()).second) {
+                changes.push_back({ path, now });
+            }
+            // New directories need watches of their own, moved away ones lose theirs
+            if ((event->mask & IN_ISDIR) && recursive_) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    addTree(path);
+                }
+                else if (event->mask & IN_MOVED_FROM) {
+                    removeTree(path);
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+bool Watcher::poll(std::chrono::milliseconds timeout, std::chrono::milliseconds settle, std::vector<Change>& changes,
+                   std::chrono::milliseconds maxBatch) {
+    changes.clear();
+    if (fd_ < 0) return true;
+
+    std::unordered_map<std::string, std::size_t> seen;
+    bool ok = true;
+    pollfd pfd{ fd_, POLLIN, 0 };
+    auto wait = timeout;
+    auto deadline = Clock::time_point::max();
+    while (::poll(&pfd, 1, static_cast<int>(wait.count())) > 0) {
+        ok = drain(changes, seen) && ok;
+        auto now = Clock::now();
+        if (deadline == Clock::time_point::max()) {
+            deadline = now + maxBatch;
+        }
+        if (now >= deadline) break;
+        wait = std::min(settle, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now));
+    }
+    return ok;
+}
+
+#else
+
+Watcher::Watcher(bool recursive)
+    : recursive_(recursive) {}
+Watcher::~Watcher() {}
+bool Watcher::add(const std::filesystem::path&) { return false; }
+void Watcher::forgetUnwatched(const std::filesystem::path&) {}
+void Watcher::addTree(const std::filesystem::path&) {}
+void Watcher::removeTree(const std::filesystem::path&) {}
+bool Watcher::drain(std::vector<Change>&, std::unordered_map<std::string, std::size_t>&) { return true; }
+
+bool Watcher::poll(std::chrono::milliseconds, std::chrono::milliseconds, std::vector<Change>& changes,
+                   std::chrono::milliseconds) {
+    changes.clear();
+    return true;
+}
+
+#endif
+
+void LatencyStats::add(std::chrono::steady_clock::duration latency) {
+    double ms = std::chrono::duration<double, std::milli>(latency).count();
+    ++count_;
+    totalMs_ += ms;
+    maxMs_ = std::max(maxMs_, ms);
+    if (recent_.size() == SAMPLES) {
+        recent_.erase(recent_.begin());
+    }
+    recent_.push_back(ms);
+}
+
+double LatencyStats::meanMs() const {
+    return count_ ? totalMs_ / static_cast<double>(count_) : 0.0;
+}
+
+double LatencyStats::percentileMs(double p) const {
+    if (recent_.empty()) return 0.0;
+    auto sorted = recent_;
+    std::sort(sorted.begin(), sorted.end());
+    auto index = static_cast<std::size_t>(p / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+} // namespace dedupe
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace dedupe {
+
+// Watches a directory tree with inotify and reports the paths that changed.
+// Every directory needs its own watch; once the per-user limit
+// (fs.inotify.max_user_watches) runs out the rest go unwatched and exhausted()
+// says so, leaving the caller to rescan for them. Linux only, elsewhere
+// supported() is false and poll never reports anything.
+class Watcher {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Change {
+        std::filesystem::path path;
+        Clock::time_point seen;     // When the first event for path was read
+    };
+
+    // Without recursive only the directories passed to addTree are watched
+    explicit Watcher(bool recursive = true);
+    ~Watcher();
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    bool supported() const { return fd_ >= 0; }
+
+    // Watch dir and every directory below it, including those created later.
+    // Directories below dir left unwatched before are counted afresh.
+    void addTree(const std::filesystem::path& dir);
+    // Forget the watches on dir and below, e.g. when it's moved away
+    void removeTree(const std::filesystem::path& dir);
+
+    // Wait up to timeout for an event, then keep collecting until quiet for settle,
+    // so a burst of writes comes back as one batch. Each path appears once. Under a
+    // steady stream of events the batch is cut off maxBatch after the first, and
+    // what is still queued comes with the next poll.
+    // Returns false on queue overflow, when changes were lost and a rescan is needed.
+    bool poll(std::chrono::milliseconds timeout, std::chrono::milliseconds settle, std::vector<Change>& changes,
+              std::chrono::milliseconds maxBatch = MAX_BATCH);
+
+    static constexpr std::chrono::milliseconds MAX_BATCH{ 2000 };
+
+    std::size_t watched() const { return paths_.size(); }
+    // Directories left unwatched since the limit ran out
+    std::size_t unwatched() const { return unwatched_.size(); }
+    bool exhausted() const { return !unwatched_.empty(); }
+
+private:
+    bool add(const std::filesystem::path& dir);
+    // Drop dir and the directories below it from the unwatched
+    void forgetUnwatched(const std::filesystem::path& dir);
+    // Read whatever is queued, false on overflow
+    bool drain(std::vector<Change>& changes, std::unordered_map<std::string, std::size_t>& seen);
+
+    int fd_ = -1;
+    bool recursive_;
+    std::unordered_map<int, std::filesystem::path> paths_;
+    std::unordered_map<std::string, int> descriptors_;
+    std::unordered_set<std::string> unwatched_;
+};
+
+// Time from an event being read to the duplicate index reflecting it
+class LatencyStats {
+public:
+    void add(std::chrono::steady_clock::duration latency);
+
+    std::size_t count() const { return count_; }
+    double meanMs() const;
+    double maxMs() const { return maxMs_; }
+    // Over the most recent SAMPLES events
+    double percentileMs(double p) const;
+
+private:
+    static constexpr std::size_t SAMPLES = 4096;
+
+    std::size_t count_ = 0;
+    double totalMs_ = 0;
+    double maxMs_ = 0;
+    std::vector<double> recent_;
+};
+
+} // namespace dedupe
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+#include "../core/arena_tree.hpp"
+#include "../core/nested_tree.hpp"
+#include "../core/name_pool.hpp"
+#include <string>
+#include <vector>
+
+namespace dedupe {
+namespace test {
+
+namespace {
+
+struct Item {
+    int value;
+    Item(int v) : value(v) {}
+};
+
+std::vector<int> values(const ArenaNode<Item>::ChildRange& children) {
+    std::vector<int> result;
+    for (auto child : children) {
+        result.push_back(child->data().value);
+    }
+    return result;
+}
+
+} // namespace
+
+class ArenaTreeTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // TreeTest's tree, children added both ways: 1 over 2, 3 and 4, 5 below 2
+        // and 6 below 3
+        auto root = tree_.createNode(Item(1));
+        root->addChildren(std::vector<Item>{ Item(2), Item(3) });
+        root->addChild(tree_.createNode(Item(4)));
+        root->children()[0]->addChild(tree_.createNode(Item(5)));
+        root->children()[1]->addChildren(std::vector<Item>{ Item(6) });
+        tree_.setRoot(root);
+    }
+
+    ArenaTree<Item> tree_;
+};
+
+TEST_F(ArenaTreeTest, BasicTreeOperations) {
+    auto root = tree_.root();
+    ASSERT_TRUE(root != nullptr);
+    EXPECT_TRUE(root->isRoot());
+    EXPECT_EQ(root->childCount(), 3u);
+    EXPECT_EQ(values(root->children()), std::vector<int>({ 2, 3, 4 }));
+    for (auto child : root->children()) {
+        EXPECT_EQ(child->parent(), root);
+    }
+    EXPECT_TRUE(root->children()[2]->isLeaf());
+}
+
+TEST_F(ArenaTreeTest, TraversalsMatchNestedTree) {
+    auto nestedRoot = std::make_shared<NestedNode<Item>>(Item(1));
+    std::vector<std::shared_ptr<NestedNode<Item>>> nodes;
+    for (int v = 2; v <= 6; ++v) {
+        nodes.push_back(std::make_shared<NestedNode<Item>>(Item(v)));
+    }
+    nodes[0]->addChild(nodes[3]);
+    nodes[1]->addChild(nodes[4]);
+    for (int i = 0; i < 3; ++i) {
+        nestedRoot->addChild(nodes[i]);
+    }
+    NestedTree<Item> nested;
+    nested.setRoot(nestedRoot);
+
+    auto order = [](const auto& tree, auto traverse) {
+        std::vector<std::pair<int, std::pair<int, int>>> visited;
+        (tree.*traverse)([&](const auto& node) {
+            visited.push_back({ node->data().value, { node->left(), node->right() } });
+        });
+        return visited;
+    };
+    EXPECT_EQ(order(tree_, &ArenaTree<Item>::breadthFirstTraverse),
+              order(nested, &NestedTree<Item>::breadthFirstTraverse));
+    EXPECT_EQ(order(tree_, &ArenaTree<Item>::depthFirstTraverse),
+              order(nested, &NestedTree<Item>::depthFirstTraverse));
+    EXPECT_EQ(order(tree_, &ArenaTree<Item>::levelOrderTraverse),
+              order(nested, &NestedTree<Item>::levelOrderTraverse));
+
+    auto node = tree_.findNode([](const auto& n) { return n->data().value == 3; });
+    ASSERT_TRUE(node != nullptr);
+    EXPECT_TRUE(tree_.root()->isAncestorOf(*node));
+    EXPECT_TRUE(node->contains(*node->children()[0]));
+    EXPECT_EQ(tree_.findAllNodes([](const auto& n) { return n->data().value > 3; }).size(), 3u);
+}
+
+TEST_F(ArenaTreeTest, RemoveAndReplace) {
+    auto root = tree_.root();
+    root->removeChild(root->children()[0]);
+    EXPECT_EQ(values(root->children()), std::vector<int>({ 3, 4 }));
+
+    auto fresh = tree_.createNode(Item(7));
+    fresh->addChildren(std::vector<Item>{ Item(8), Item(9) });
+    root->replaceChild(root->children()[0], fresh);
+    EXPECT_EQ(values(root->children()), std::vector<int>({ 7, 4 }));
+    EXPECT_EQ(fresh->parent(), root);
+    EXPECT_EQ(values(fresh->children()), std::vector<int>({ 8, 9 }));
+
+    tree_.updateNestedSets();
+    std::vector<int> visited;
+    tree_.depthFirstTraverse([&](const auto& node) { visited.push_back(node->data().value); });
+    EXPECT_EQ(visited, std::vector<int>({ 8, 9, 7, 4, 1 }));
+    EXPECT_EQ(root->right(), 10);
+}
+
+TEST(ArenaTreeStorage, FreedNodesReleaseTheirData) {
+    ArenaTree<Name> tree;
+    auto root = tree.createNode(Name("arena_tree_test_root"));
+    root->addChildren(std::vector<Name>{ Name("arena_tree_test_a"), Name("arena_tree_test_b") });
+    tree.setRoot(root);
+    EXPECT_NE(Name::find("arena_tree_test_a"), nullptr);
+
+    root->removeChild(root->children()[0]);
+    EXPECT_EQ(Name::find("arena_tree_test_a"), nullptr);
+
+    // A node built but never added is freed as well
+    auto detached = tree.createNode(Name("arena_tree_test_c"));
+    detached->addChildren(std::vector<Name>{ Name("arena_tree_test_d") });
+    tree.destroyNode(detached);
+    EXPECT_EQ(Name::find("arena_tree_test_c"), nullptr);
+    EXPECT_EQ(Name::find("arena_tree_test_d"), nullptr);
+
+    // Slots are reused rather than the arena growing
+    auto usage = tree.memoryUsage();
+    for (int i = 0; i < 100000; ++i) {
+        root->addChild(tree.createNode(Name("arena_tree_test_e")));
+        root->removeChild(root->children()[1]);
+    }
+    EXPECT_EQ(tree.memoryUsage(), usage);
+    EXPECT_EQ(root->childCount(), 1u);
+}
+
+TEST(ArenaTreeStorage, ManyDirectoriesGrowingInTurn) {
+    // Adding to directories in turn moves their link ranges over and over,
+    // which compaction has to keep in place
+    ArenaTree<Item> tree;
+    auto root = tree.createNode(Item(-1));
+    const int directories = 50;
+    const int files = 500;
+    std::vector<Item> dirs;
+    for (int d = 0; d < directories; ++d) {
+        dirs.emplace_back(d);
+    }
+    root->addChildren(std::move(dirs));
+    tree.setRoot(root);
+    for (int f = 0; f < files; ++f) {
+        for (int d = 0; d < directories; ++d) {
+            root->children()[d]->addChild(tree.createNode(Item(f)));
+        }
+    }
+
+    for (int d = 0; d < directories; ++d) {
+        auto dir = root->children()[d];
+        ASSERT_EQ(dir->data().value, d);
+        ASSERT_EQ(dir->childCount(), static_cast<size_t>(files));
+        for (int f = 0; f < files; ++f) {
+            ASSERT_EQ(dir->children()[f]->data().value, f);
+            ASSERT_EQ(dir->children()[f]->parent(), dir);
+        }
+    }
+}
+
+TEST(ArenaTreeStorage, Transform) {
+    ArenaTree<Item> tree;
+    auto root = tree.createNode(Item(1));
+    root->addChildren(std::vector<Item>{ Item(2), Item(3) });
+    root->children()[0]->addChildren(std::vector<Item>{ Item(4) });
+    tree.setRoot(root);
+
+    auto transformed = tree.transform<std::string>([](const Item& item) { return std::to_string(item.value); });
+    std::vector<std::string> visited;
+    transformed.breadthFirstTraverse([&](const auto& node) { visited.push_back(node->data()); });
+    EXPECT_EQ(visited, std::vector<std::string>({ "1", "2", "3", "4" }));
+}
+
+} // namespace test
+} // namespace dedupe
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include "../core/bloom_filter.hpp"
+#include "../core/duplicate_finder.hpp"
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+
+namespace dedupe {
+namespace test {
+
+namespace {
+
+std::uint64_t mixed(std::uint64_t i) {
+    return MinHash::mix(i + 0x9e3779b97f4a7c15ULL);
+}
+
+} // namespace
+
+TEST(BloomFilterTest, NoFalseNegativesFewFalsePositives) {
+    BloomFilter filter(100000);
+    for (std::uint64_t i = 0; i < 100000; ++i) {
+        filter.insert(mixed(i));
+    }
+    for (std::uint64_t i = 0; i < 100000; ++i) {
+        ASSERT_TRUE(filter.mayContain(mixed(i)));
+    }
+    std::size_t positives = 0;
+    for (std::uint64_t i = 100000; i < 1100000; ++i) {
+        positives += filter.mayContain(mixed(i));
+    }
+    EXPECT_LT(positives, 1000000u / 200);
+    EXPECT_LE(filter.bytes(), 100000u * 16 / 8 + 64);
+}
+
+TEST(BloomFilterTest, PartnerFilterFindsEveryRepeat) {
+    // One key in ten comes twice
+    PartnerFilter filter(110000);
+    for (std::uint64_t i = 0; i < 100000; ++i) {
+        filter.add(mixed(i));
+        if (i % 10 == 0) {
+            filter.add(mixed(i));
+        }
+    }
+    std::size_t flagged = 0;
+    for (std::uint64_t i = 0; i < 100000; ++i) {
+        if (i % 10 == 0) {
+            ASSERT_TRUE(filter.mayRepeat(mixed(i)));
+        }
+        else {
+            flagged += filter.mayRepeat(mixed(i));
+        }
+    }
+    EXPECT_LT(flagged, 90000u / 100);
+}
+
+class PrefilterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        testDir_ = std::filesystem::temp_directory_path() / "prefilter_test";
+        std::filesystem::create_directories(testDir_);
+        // Many files of one size, few sharing content; a pair differing only in the tail
+        for (int i = 0; i < 60; ++i) {
+            auto content = std::to_string(i);
+            write("u" + content, content + std::string(1000 - content.size(), '-'));
+        }
+        write("d1", std::string(1000, 'x'));
+        write("d2", std::string(1000, 'x'));
+        write("d3", std::string(1000, 'x'));
+        auto tail = std::string(1000, 'y');
+        write("t1", tail);
+        tail.back() = 'z';
+        write("t2", tail);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(testDir_);
+    }
+
+    void write(const std::string& name, const std::string& content) {
+        std::ofstream(testDir_ / name, std::ios::binary) << content;
+    }
+
+    std::map<std::filesystem::path, std::pair<Digest, bool>> find(std::size_t prefilterMinFiles, StageStats& stats,
+                                                                  HashStage stage = HashStage::Head) {
+        Progress progress;
+        FileSystemTree tree = FileSystemTree::buildFromPath(testDir_, progress);
+        FinderOptions options;
+        options.prefilterMinFiles = prefilterMinFiles;
+        // Heads shorter than the files, so the tail pair shares one
+        options.headSize = options.tailSize = options.sampleSize = 100;
+        DuplicateFinder finder(tree, options);
+        EXPECT_TRUE(finder.findDuplicates(progress));
+        stats = finder.stageStats(stage);
+        std::map<std::filesystem::path, std::pair<Digest, bool>> result;
+        tree.depthFirstTraverse([&](const auto& node) {
+            if (!node->data().isDirectory) {
+                result[FileSystemTree::pathOf(node)] = { node->data().hash, node->data().isIdentical };
+            }
+        });
+        return result;
+    }
+
+    std::filesystem::path testDir_;
+};
+
+TEST_F(PrefilterTest, SameResultsWithFewerFilesGrouped) {
+    StageStats exact, filtered;
+    auto expected = find(0, exact);
+    auto actual = find(1, filtered);
+    EXPECT_EQ(actual, expected);
+    EXPECT_EQ(exact.prefiltered, 0u);
+    // Only the copies and the pair sharing a head can have partners
+    EXPECT_GE(filtered.prefiltered, 58u);
+    EXPECT_LE(filtered.prefiltered, 60u);
+    EXPECT_TRUE(actual[testDir_ / "d1"].second);
+    EXPECT_FALSE(actual[testDir_ / "t1"].second);
+}
+
+TEST_F(PrefilterTest, FilteredFilesKeepPartitionsApart) {
+    // Heads X,X,Y,Y and tails 1,2,1,3: no file has a partner, though tails repeat
+    std::filesystem::remove_all(testDir_);
+    std::filesystem::create_directories(testDir_);
+    auto body = std::string(998, '-');
+    write("a1", "X" + body + "1");
+    write("a2", "X" + body + "2");
+    write("b1", "Y" + body + "1");
+    write("b2", "Y" + body + "3");
+
+    StageStats tail;
+    auto result = find(1, tail, HashStage::Tail);
+    EXPECT_EQ(tail.prefiltered, 4u);
+    std::set<Digest> hashes;
+    for (const auto& [path, entry] : result) {
+        EXPECT_FALSE(entry.second) << path;
+        hashes.insert(entry.first);
+    }
+    EXPECT_EQ(hashes.size(), 4u);
+}
+
+} // namespace test
+} // namespace dedupe
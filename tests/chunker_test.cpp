@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+#include "../core/chunk_index.hpp"
+#include "../core/chunker.hpp"
+#include "../core/hasher.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace dedupe {
+namespace test {
+
+class ChunkerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        testDir_ = std::filesystem::temp_directory_path() / "chunker_test";
+        std::filesystem::create_directories(testDir_);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(testDir_);
+    }
+
+    static std::string random(std::size_t size, std::uint64_t seed) {
+        std::mt19937_64 generator(seed);
+        std::string data(size, '\0');
+        for (auto& c : data) {
+            c = static_cast<char>(generator());
+        }
+        return data;
+    }
+
+    static std::vector<Chunk> chunk(const std::string& data, const ChunkParams& params) {
+        std::istringstream stream(data);
+        Progress progress;
+        return Hasher::chunk_stream(stream, progress, params, HashAlgorithm::Xxh3_128);
+    }
+
+    std::filesystem::path write(const std::string& name, const std::string& content) {
+        auto path = testDir_ / name;
+        std::ofstream(path, std::ios::binary) << content;
+        return path;
+    }
+
+    std::filesystem::path testDir_;
+};
+
+TEST_F(ChunkerTest, ChunksCoverStreamWithinBounds) {
+    auto params = ChunkParams::around(8192);
+    auto data = random(3 * 1024 * 1024, 1);
+    auto chunks = chunk(data, params);
+    ASSERT_FALSE(chunks.empty());
+
+    std::uintmax_t offset = 0;
+    Progress progress;
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        EXPECT_EQ(chunks[i].offset, offset);
+        EXPECT_LE(chunks[i].length, params.maxSize);
+        if (i + 1 < chunks.size()) {
+            EXPECT_GE(chunks[i].length, params.minSize);
+        }
+        auto bytes = data.substr(offset, chunks[i].length);
+        EXPECT_EQ(chunks[i].digest, Hasher::hash_string(bytes, progress, HashAlgorithm::Xxh3_128));
+        offset += chunks[i].length;
+    }
+    EXPECT_EQ(offset, data.size());
+    // Normalized chunking keeps the mean near the average
+    auto mean = data.size() / chunks.size();
+    EXPECT_GT(mean, params.averageSize / 2);
+    EXPECT_LT(mean, params.averageSize * 2);
+}
+
+TEST_F(ChunkerTest, InsertionOnlyMovesNearbyBoundaries) {
+    auto params = ChunkParams::around(8192);
+    auto original = random(2 * 1024 * 1024, 2);
+    auto edited = original;
+    edited.insert(1024 * 1024, random(100, 3));
+    edited.erase(1500 * 1024, 10);
+
+    std::set<Digest> before;
+    for (const auto& c : chunk(original, params)) {
+        before.insert(c.digest);
+    }
+    auto after = chunk(edited, params);
+    std::size_t changed = 0;
+    for (const auto& c : after) {
+        changed += before.count(c.digest) == 0;
+    }
+    // Each edit touches the chunk it lands in, perhaps one more
+    EXPECT_LE(changed, 4u);
+    EXPECT_GT(after.size(), 100u);
+}
+
+TEST_F(ChunkerTest, MatchesByteAtATimeGear) {
+    // FastCDC as written in the paper, one byte a step
+    auto reference = [](const std::string& data, std::size_t start, const ChunkParams& params, unsigned bits) {
+        auto mask = [](unsigned count) { return (~std::uint64_t(0) << (64 - count)) >> 1; };
+        const auto& gear = Chunker::table();
+        std::size_t length = data.size() - start;
+        if (length <= params.minSize) return length;
+        std::size_t end = std::min(length, params.maxSize);
+        std::size_t normal = std::min(end, params.averageSize);
+        std::uint64_t hash = 0;
+        for (std::size_t i = params.minSize; i < end; ++i) {
+            hash = (hash << 1) + gear[static_cast<std::uint8_t>(data[start + i])];
+            if ((hash & mask(i < normal ? bits + 2 : bits - 2)) == 0) return i + 1;
+        }
+        return end;
+    };
+
+    auto data = random(1024 * 1024, 7);
+    for (unsigned bits : { 8u, 11u, 13u }) {
+        auto params = ChunkParams::around(std::size_t(1) << bits);
+        // Odd minimums start the pairs on odd bytes
+        for (auto min : { params.minSize, params.minSize + 1 }) {
+            params.minSize = min;
+            Chunker chunker(params);
+            for (std::size_t offset = 0; offset < data.size();) {
+                auto expected = reference(data, offset, params, bits);
+                ASSERT_EQ(chunker.cut(reinterpret_cast<const std::uint8_t*>(data.data()) + offset, data.size() - offset),
+                          expected) << "at " << offset;
+                offset += expected;
+            }
+        }
+    }
+}
+
+TEST_F(ChunkerTest, ShortStreams) {
+    EXPECT_TRUE(chunk("", ChunkParams()).empty());
+    auto chunks = chunk("short", ChunkParams());
+    ASSERT_EQ(chunks.size(), 1u);
+    EXPECT_EQ(chunks[0].length, 5u);
+    // Without any cut point, chunks stop at the max size
+    auto flat = chunk(std::string(100000, '\0'), ChunkParams::around(8192));
+    ASSERT_EQ(flat.size(), 4u);
+    EXPECT_EQ(flat[0].length, 32768u);
+    EXPECT_EQ(flat[3].length, 100000u - 3 * 32768u);
+}
+
+TEST_F(ChunkerTest, RejectsBadSizes) {
+    EXPECT_THROW(Chunker(ChunkParams{ 1024, 5000, 20000 }), std::invalid_argument);
+    EXPECT_THROW(Chunker(ChunkParams{ 8192, 4096, 16384 }), std::invalid_argument);
+    EXPECT_NO_THROW(Chunker(ChunkParams::around(4096)));
+}
+
+TEST_F(ChunkerTest, IndexFindsSharedContent) {
+    auto base = random(1024 * 1024, 4);
+    auto edited = base;
+    edited.replace(500000, 1000, random(1000, 5));
+    auto a = write("a", base);
+    auto b = write("b", edited);
+    auto c = write("c", random(512 * 1024, 6));
+    auto d = write("d", base.substr(0, 300000));
+    auto missing = testDir_ / "missing";
+
+    ChunkOptions options;
+    options.params = ChunkParams::around(8192);
+    options.threads = 2;
+    ChunkIndex index(options);
+    Progress progress;
+    ASSERT_TRUE(index.build({ a, b, c, d, missing }, progress));
+    ASSERT_EQ(index.failed().size(), 1u);
+    EXPECT_EQ(index.failed()[0].first, missing);
+
+    auto files = index.files();
+    ASSERT_EQ(files.size(), 5u);
+    EXPECT_EQ(files[0].bytes, base.size());
+    EXPECT_GT(files[0].sharedBytes, base.size() - 3 * options.params.maxSize);
+    EXPECT_GT(files[1].sharedBytes, edited.size() - 3 * options.params.maxSize);
+    EXPECT_EQ(files[2].sharedBytes, 0u);
+    EXPECT_GT(files[3].sharedBytes, 300000u - options.params.maxSize);
+    EXPECT_EQ(index.totalBytes(), 2 * base.size() + 512 * 1024 + 300000u);
+    // The edited chunks of b and the last of d, cut short, are the only new content
+    EXPECT_LT(index.uniqueBytes(), base.size() + 512 * 1024 + 4 * options.params.maxSize);
+    EXPECT_LT(index.distinctChunks(), index.chunkCount());
+
+    auto pairs = index.topPairs(10);
+    ASSERT_EQ(pairs.size(), 3u);
+    EXPECT_EQ(pairs[0].first, 0u);
+    EXPECT_EQ(pairs[0].second, 1u);
+    EXPECT_GT(pairs[0].sharedBytes, base.size() - 3 * options.params.maxSize);
+    for (const auto& pair : pairs) {
+        EXPECT_NE(pair.first, 2u);
+        EXPECT_NE(pair.second, 2u);
+        if (pair.second == 3) {
+            EXPECT_LE(pair.sharedBytes, 300000u);
+        }
+    }
+    EXPECT_EQ(index.topPairs(1).size(), 1u);
+}
+
+} // namespace test
+} // namespace dedupe
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include "../core/comparator.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace dedupe {
+namespace test {
+
+class ComparatorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        tempDir_ = std::filesystem::temp_directory_path() / "comparator_test";
+        std::filesystem::create_directories(tempDir_);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(tempDir_);
+    }
+
+    // 3MB of filler with one byte changed, so files differ only past the first buffer
+    std::filesystem::path write(const std::string& name, size_t at, char value) {
+        std::string content(3 * 1024 * 1024, 'x');
+        content[at] = value;
+        auto path = tempDir_ / name;
+        std::ofstream(path, std::ios::binary) << content;
+        return path;
+    }
+
+    std::filesystem::path tempDir_;
+};
+
+TEST_F(ComparatorTest, SplitsIntoIdenticalSets) {
+    std::vector<std::filesystem::path> files = {
+        write("a.bin", 0, 'x'),
+        write("b.bin", 2 * 1024 * 1024 + 5, 'b'),
+        write("c.bin", 0, 'x'),
+        write("d.bin", 2 * 1024 * 1024 + 5, 'b'),
+        write("e.bin", 100, 'e'),
+    };
+
+    Progress progress;
+    auto result = Comparator::compare(files, progress);
+    EXPECT_TRUE(result.failed.empty());
+
+    std::vector<std::vector<size_t>> expected = { { 0, 2 }, { 1, 3 }, { 4 } };
+    auto sets = result.sets;
+    std::sort(sets.begin(), sets.end());
+    EXPECT_EQ(sets, expected);
+}
+
+TEST_F(ComparatorTest, StopsReadingUniqueFiles) {
+    std::vector<std::filesystem::path> files = {
+        write("a.bin", 0, 'a'),
+        write("b.bin", 0, 'b'),
+    };
+
+    Progress progress;
+    auto result = Comparator::compare(files, progress);
+    EXPECT_EQ(result.sets.size(), 2);
+    // Only the first buffer of each file was needed to tell them apart
+    EXPECT_EQ(result.bytesRead, 2 * 1024 * 1024);
+}
+
+TEST_F(ComparatorTest, ReportsUnreadableFiles) {
+    std::vector<std::filesystem::path> files = {
+        write("a.bin", 0, 'x'),
+        tempDir_ / "missing.bin",
+        write("c.bin", 0, 'x'),
+    };
+
+    Progress progress;
+    auto result = Comparator::compare(files, progress);
+    ASSERT_EQ(result.failed.size(), 1);
+    EXPECT_EQ(result.failed[0].first, 1);
+    ASSERT_EQ(result.sets.size(), 1);
+    EXPECT_EQ(result.sets[0], (std::vector<size_t>{ 0, 2 }));
+}
+
+} // namespace test
+} // namespace dedupe
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+#include "../core/device_scheduler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
+
+namespace dedupe {
+namespace test {
+
+TEST(DeviceSchedulerTest, LimitsConcurrencyPerDevice) {
+    ThreadPool pool(8);
+    DeviceScheduler::Limits limits;
+    limits.unknown = 2;     // Device 0 is never a real block device
+    DeviceScheduler scheduler(pool, limits);
+    EXPECT_EQ(scheduler.limit(0), 2u);
+
+    std::atomic<int> running{ 0 };
+    std::atomic<int> peak{ 0 };
+    std::atomic<int> count{ 0 };
+    for (int i = 0; i < 20; ++i) {
+        scheduler.submit(0, [&]() {
+            int now = ++running;
+            int seen = peak;
+            while (now > seen && !peak.compare_exchange_weak(seen, now)) {}
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            --running;
+            ++count;
+        });
+    }
+    pool.wait();
+
+    EXPECT_EQ(count, 20);
+    EXPECT_LE(peak, 2);
+}
+
+TEST(DeviceSchedulerTest, UnlimitedUsesPoolSize) {
+    ThreadPool pool(3);
+    DeviceScheduler scheduler(pool, DeviceScheduler::Limits());
+    EXPECT_EQ(scheduler.limit(0), 3u);
+
+    std::atomic<int> count{ 0 };
+    for (int i = 0; i < 100; ++i) {
+        scheduler.submit(0, [&]() { ++count; });
+    }
+    pool.wait();
+    EXPECT_EQ(count, 100);
+}
+
+TEST(DeviceSchedulerTest, DetectKind) {
+    EXPECT_EQ(DeviceScheduler::detectKind(0), DeviceKind::Unknown);
+#if defined(__unix__) || defined(__APPLE__)
+    // Whatever the temp directory lives on, looking it up mustn't fail
+    struct stat st;
+    ASSERT_EQ(::stat(std::filesystem::temp_directory_path().c_str(), &st), 0);
+    auto kind = DeviceScheduler::detectKind(static_cast<std::uint64_t>(st.st_dev));
+    EXPECT_TRUE(kind == DeviceKind::Unknown || kind == DeviceKind::Rotational || kind == DeviceKind::SolidState);
+#endif
+}
+
+} // namespace test
+} // namespace dedupe
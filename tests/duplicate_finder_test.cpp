@@ -2,12 +2,16 @@
 #include "../core/duplicate_finder.hpp"
 #include "../core/filesystem_tree.hpp"
 #include "../core/nested_tree.hpp"
+#include "../core/hash_cache.hpp"
+#include "../core/tree_snapshot.hpp"
 //#include "../core/progress.hpp"
 #include <string>
 #include <vector>
 #include <filesystem>
 #include <fstream>
 #include <unordered_map>
+#include <map>
+#include <set>
 
 namespace dedupe {
 namespace test {
@@ -52,8 +56,15 @@ TEST_F(DuplicateFinderTest, FindDuplicates) {
     //auto& paths = duplicateFinder.pathToDuplicate();
     auto &lookup = duplicateFinder.hashToDuplicate();
     EXPECT_EQ(lookup.size(), 5);
-    auto &dups = lookup.begin()->second;
-    EXPECT_EQ(dups.paths.size(), 3);
+    std::vector<const DuplicateFiles*> groups;
+    for (const auto& [hash, group] : lookup) {
+        if (group.nodes.size() > 1) {
+            groups.push_back(&group);
+        }
+    }
+    ASSERT_EQ(groups.size(), 1u);
+    auto &dups = *groups.front();
+    EXPECT_EQ(dups.nodes.size(), 3);
     
     //// Check that all duplicate files have the same signature
     //std::string firstHash;
@@ -85,7 +96,7 @@ TEST_F(DuplicateFinderTest, FindDuplicates) {
     };
     
     ///for (const auto& [path, signature] : duplicates) {
-    for (const auto& str : dups.paths) {
+    for (const auto& str : dups.paths()) {
         std::filesystem::path path{ str };
         auto filename = path.filename().string();
         if (path.parent_path().filename() == "subdir") {                // RJL ??? Strips subdir off and then reapplies it...
@@ -118,9 +129,9 @@ TEST_F(DuplicateFinderTest, NoDuplicates) {
     // We should have no duplicates
     EXPECT_EQ(lookup.size(), 3);
     auto it = lookup.begin();
-    EXPECT_EQ(it->second.paths.size(), 1);
+    EXPECT_EQ(it->second.nodes.size(), 1);
     ++it;
-    EXPECT_EQ(it->second.paths.size(), 1);
+    EXPECT_EQ(it->second.nodes.size(), 1);
 
     // Clean up
     std::filesystem::remove_all(noDupDir);
@@ -170,10 +181,15 @@ TEST_F(DuplicateFinderTest, MultipleDuplicateGroups) {
 
     // We should have 3 paths in the duplicate map, 2 duplicates and 2 unique
     EXPECT_EQ(lookup.size(), 3);
-    auto it = lookup.begin();
-    EXPECT_EQ(it->second.paths.size(), 2);
-    ++it;
-    EXPECT_EQ(it->second.paths.size(), 2);
+    size_t groups = 0;
+    for (const auto& [hash, group] : lookup) {
+        if (group.nodes.size() > 1) {
+            ++groups;
+            EXPECT_EQ(group.nodes.size(), 2);
+            EXPECT_FALSE(group.isDirectory);
+        }
+    }
+    EXPECT_EQ(groups, 2u);
     
     // Group the duplicates by their hash to verify we have two distinct groups
 //    std::unordered_map<std::string, std::vector<std::filesystem::path>> hashGroups;
@@ -342,5 +358,479 @@ TEST_F(DuplicateFinderTest, DeepIdenticalFolders) {
     // Clean up
     std::filesystem::remove_all(subDir);
 }
+TEST_F(DuplicateFinderTest, ParallelMatchesSerial) {
+    auto parallelDir = std::filesystem::temp_directory_path() / "dedupe_parallel_test";
+    std::filesystem::create_directories(parallelDir);
+
+    // Same-sized files sharing the first 8KB force the full hash path
+    std::string head(8192, 'h');
+    for (int d = 0; d < 4; ++d) {
+        auto dir = parallelDir / ("dir" + std::to_string(d));
+        std::filesystem::create_directories(dir);
+        for (int i = 0; i < 25; ++i) {
+            std::ofstream(dir / ("small" + std::to_string(i) + ".txt")) << "content " << (i % 7);
+            std::ofstream(dir / ("large" + std::to_string(i) + ".bin")) << head << "tail " << (i % 5);
+        }
+    }
+
+    auto run = [&](unsigned threads, bool layoutOrder = true) {
+        Progress progress;
+        FileSystemTree tree = FileSystemTree::buildFromPath(parallelDir, progress);
+        FinderOptions options;
+        options.threads = threads;
+        options.layoutOrder = layoutOrder;
+        DuplicateFinder finder(tree, options);
+        EXPECT_TRUE(finder.findDuplicates(progress));
+        std::map<Hash, std::vector<std::filesystem::path>> result;
+        for (const auto& [hash, dups] : finder.hashToDuplicate()) {
+            auto paths = dups.paths();
+            std::sort(paths.begin(), paths.end());
+            result[hash] = paths;
+        }
+        return result;
+    };
+
+    auto serial = run(1);
+    auto parallel = run(8);
+    EXPECT_EQ(serial, parallel);
+    // Read order never changes the answer
+    EXPECT_EQ(serial, run(8, false));
+
+    // Every directory holds the same set of contents
+    size_t identicalDirs = 0;
+    for (const auto& [hash, paths] : serial) {
+        if (paths.size() == 4 && std::filesystem::is_directory(paths[0])) {
+            ++identicalDirs;
+        }
+    }
+    EXPECT_EQ(identicalDirs, 1);
+
+    std::filesystem::remove_all(parallelDir);
+}
+
+TEST_F(DuplicateFinderTest, DirectoryDigestsAreMerkle) {
+    auto merkleDir = std::filesystem::temp_directory_path() / "dedupe_merkle_test";
+    // Same contents written in opposite orders, wide enough to span several batches
+    for (auto name : { "forward", "reverse" }) {
+        for (int j = 0; j < 5000; ++j) {
+            int i = name[0] == 'f' ? j : 4999 - j;
+            auto dir = merkleDir / name / ("sub" + std::to_string(i % 3));
+            std::filesystem::create_directories(dir);
+            std::ofstream(dir / ("f" + std::to_string(i))) << "content " << (i % 50);
+        }
+    }
+
+    auto run = [&](unsigned threads) {
+        Progress progress;
+        FileSystemTree tree = FileSystemTree::buildFromPath(merkleDir, progress);
+        FinderOptions options;
+        options.threads = threads;
+        DuplicateFinder finder(tree, options);
+        EXPECT_TRUE(finder.findDuplicates(progress));
+
+        // Each directory's digest folds its children's, sorted
+        tree.depthFirstTraverse([&](const auto& node) {
+            if (!node->data().isDirectory) return;
+            std::vector<Hash> hashes;
+            for (const auto& child : node->children()) {
+                hashes.push_back(child->data().hash);
+            }
+            std::sort(hashes.begin(), hashes.end());
+            EXPECT_EQ(node->data().hash, Hasher::hash_digests(hashes, options.algorithm));
+            EXPECT_EQ(node->data().size, node->childCount());
+        });
+        auto forward = tree.findByPath(merkleDir / "forward")->data().hash;
+        EXPECT_EQ(forward, tree.findByPath(merkleDir / "reverse")->data().hash);
+        return forward;
+    };
+
+    // Same digest run after run, whatever the threads
+    EXPECT_EQ(run(1), run(4));
+
+    std::filesystem::remove_all(merkleDir);
+}
+
+TEST_F(DuplicateFinderTest, SimilarDirectories) {
+    auto similarDir = std::filesystem::temp_directory_path() / "dedupe_similar_test";
+    auto original = similarDir / "photos";
+    auto backup = similarDir / "old" / "photos backup";
+    auto other = similarDir / "music";
+    for (auto dir : { original / "2019", backup / "2019", other }) {
+        std::filesystem::create_directories(dir);
+    }
+    // 50 files each, 48 the same, sizes varying so some are alone in their size
+    std::uintmax_t shared = 0;
+    for (int i = 0; i < 50; ++i) {
+        auto name = "img" + std::to_string(i) + ".jpg";
+        auto sub = i % 2 ? std::filesystem::path("2019") : std::filesystem::path();
+        std::string content = "picture " + std::to_string(i) + std::string(i % 5 * 100, '.');
+        std::ofstream(original / sub / name) << content;
+        std::ofstream(backup / sub / name) << (i == 7 ? "edited " + content : i == 8 ? "" : content);
+        std::ofstream(other / ("track" + std::to_string(i))) << "song " << i;
+        if (i != 7 && i != 8) shared += content.size();
+    }
+
+    Progress progress;
+    FileSystemTree tree = FileSystemTree::buildFromPath(similarDir, progress);
+    FinderOptions options;
+    DuplicateFinder plain(tree, options);
+    EXPECT_TRUE(plain.findDuplicates(progress));
+    EXPECT_TRUE(plain.similarDirectories().empty());
+
+    options.similarity = 0.8;
+    DuplicateFinder finder(tree, options);
+    EXPECT_TRUE(finder.findDuplicates(progress));
+
+    // Only the top pair: "old" shares no more than the backup it holds, and the
+    // 2019 subdirectories share less than their parents
+    const auto& similar = finder.similarDirectories();
+    ASSERT_EQ(similar.size(), 1u);
+    std::set<std::filesystem::path> pair{ FileSystemTree::pathOf(similar[0].first), FileSystemTree::pathOf(similar[0].second) };
+    EXPECT_EQ(pair, (std::set<std::filesystem::path>{ original, backup }));
+    EXPECT_EQ(similar[0].sharedFiles, 48u);
+    EXPECT_EQ(similar[0].sharedBytes, shared);
+    EXPECT_DOUBLE_EQ(similar[0].similarity, 48.0 / 52.0);
+
+    // Sketches estimate the same similarity
+    auto sketch = [&](const std::filesystem::path& dir) {
+        MinHash result;
+        tree.depthFirstTraverse([&](const auto& n) {
+            auto path = FileSystemTree::pathOf(n);
+            if (!n->data().isDirectory && path.native().rfind(dir.native() + "/", 0) == 0) {
+                result.merge(MinHash::of(n->data().hash));
+            }
+        });
+        return result;
+    };
+    EXPECT_NEAR(sketch(original).similarity(sketch(backup)), 48.0 / 52.0, 0.1);
+    EXPECT_LT(sketch(original).similarity(sketch(other)), 0.1);
+
+    std::filesystem::remove_all(similarDir);
+}
+
+TEST_F(DuplicateFinderTest, HardLinksReadOnce) {
+    auto linkDir = std::filesystem::temp_directory_path() / "dedupe_link_test";
+    std::filesystem::create_directories(linkDir / "snapshot");
+    std::ofstream(linkDir / "a.bin") << "shared content";
+    std::ofstream(linkDir / "copy.bin") << "shared content";
+    std::ofstream(linkDir / "lonely.bin") << "only linked, never copied";
+    std::filesystem::create_hard_link(linkDir / "a.bin", linkDir / "snapshot" / "a.bin");
+    std::filesystem::create_hard_link(linkDir / "lonely.bin", linkDir / "snapshot" / "lonely.bin");
+
+    Progress progress;
+    FileSystemTree tree = FileSystemTree::buildFromPath(linkDir, progress);
+    DuplicateFinder finder(tree);
+    EXPECT_TRUE(finder.findDuplicates(progress));
+
+    EXPECT_EQ(finder.hardLinks().size(), 2u);
+    EXPECT_EQ(finder.linkedFiles(), 2u);
+    // Of the three same-sized files only a.bin and copy.bin are read, lonely.bin not at all
+    EXPECT_EQ(finder.stageStats(HashStage::Head).files, 2u);
+
+    auto a = tree.findByPath(linkDir / "a.bin");
+    auto linkA = tree.findByPath(linkDir / "snapshot" / "a.bin");
+    EXPECT_EQ(a->data().links, 2u);
+    EXPECT_EQ(a->data().hash, linkA->data().hash);
+    const auto& shared = finder.hashToDuplicate().at(a->data().hash);
+    EXPECT_EQ(shared.nodes.size(), 3u);
+    EXPECT_EQ(shared.copies, 2u);
+    EXPECT_TRUE(shared.isIdentical());
+    EXPECT_EQ(shared.reclaimableBytes(), 14u);
+    EXPECT_TRUE(linkA->data().isDuplicate);
+
+    // Two links to one inode waste nothing
+    auto lonely = tree.findByPath(linkDir / "lonely.bin");
+    const auto& links = finder.hashToDuplicate().at(lonely->data().hash);
+    EXPECT_EQ(links.nodes.size(), 2u);
+    EXPECT_EQ(links.copies, 1u);
+    EXPECT_FALSE(links.isIdentical());
+    EXPECT_FALSE(lonely->data().isDuplicate);
+
+    std::filesystem::remove_all(linkDir);
+}
+
+TEST_F(DuplicateFinderTest, StagedRefinement) {
+    auto stagedDir = std::filesystem::temp_directory_path() / "dedupe_staged_test";
+    std::filesystem::create_directories(stagedDir);
+
+    // 64KB files: a and b differ only in the tail, c and d only in the middle,
+    // e and f are identical and the only pair that needs a full read
+    auto write = [&](const std::string& name, char middle, char tail) {
+        std::string content(64 * 1024, 'x');
+        content[32 * 1024] = middle;
+        content.back() = tail;
+        std::ofstream(stagedDir / name, std::ios::binary) << content;
+    };
+    write("a.bin", 'x', 'a');
+    write("b.bin", 'x', 'b');
+    write("c.bin", 'c', 'x');
+    write("d.bin", 'd', 'x');
+    write("e.bin", 'e', 'e');
+    write("f.bin", 'e', 'e');
+
+    Progress progress;
+    FileSystemTree tree = FileSystemTree::buildFromPath(stagedDir, progress);
+    FinderOptions options;
+    options.middleSamples = 1;
+    options.sampleSize = 64 * 1024;     // One sample spanning the whole middle
+    DuplicateFinder finder(tree, options);
+    EXPECT_TRUE(finder.findDuplicates(progress));
+
+    EXPECT_EQ(finder.stageStats(HashStage::Head).files, 6);
+    EXPECT_EQ(finder.stageStats(HashStage::Head).bytes, 6 * options.headSize);
+    EXPECT_EQ(finder.stageStats(HashStage::Tail).files, 6);
+    EXPECT_EQ(finder.stageStats(HashStage::Middle).files, 4);
+    EXPECT_EQ(finder.stageStats(HashStage::Full).files, 2);
+    EXPECT_EQ(finder.stageStats(HashStage::Full).bytes, 2 * 64 * 1024);
+
+    int groups = 0;
+    for (const auto& [hash, dups] : finder.hashToDuplicate()) {
+        if (dups.nodes.size() > 1) {
+            ++groups;
+            EXPECT_FALSE(dups.isDirectory);
+            EXPECT_EQ(dups.nodes.size(), 2);
+            auto path = dups.paths().front();
+            EXPECT_EQ(path.parent_path(), stagedDir);
+            EXPECT_TRUE(path.filename() == "e.bin" || path.filename() == "f.bin");
+        }
+    }
+    EXPECT_EQ(groups, 1);
+
+    // Without the cheap stages every candidate is read in full
+    options.stages = { HashStage::Full };
+    FileSystemTree fullTree = FileSystemTree::buildFromPath(stagedDir, progress);
+    DuplicateFinder fullFinder(fullTree, options);
+    EXPECT_TRUE(fullFinder.findDuplicates(progress));
+    EXPECT_EQ(fullFinder.stageStats(HashStage::Head).files, 0);
+    EXPECT_EQ(fullFinder.stageStats(HashStage::Full).files, 6);
+
+    // Small files too
+    FileSystemTree smallTree = FileSystemTree::buildFromPath(testDir, progress);
+    DuplicateFinder smallFinder(smallTree, options);
+    EXPECT_TRUE(smallFinder.findDuplicates(progress));
+    EXPECT_EQ(smallFinder.stageStats(HashStage::Full).files, 3);
+    for (const auto& [hash, dups] : smallFinder.hashToDuplicate()) {
+        if (!dups.isDirectory) {
+            EXPECT_TRUE(dups.nodes.size() == 1 || dups.nodes.size() == 3);
+        }
+    }
+
+    std::filesystem::remove_all(stagedDir);
+}
+
+TEST_F(DuplicateFinderTest, SettledFilesKeepPartitionsApart) {
+    auto settledDir = std::filesystem::temp_directory_path() / "dedupe_settled_test";
+    std::filesystem::create_directories(settledDir);
+
+    // Heads split a from b, tails then split each pair, but a1 and b1 share a tail
+    auto write = [&](const std::string& name, char head, char tail) {
+        std::string content(24 * 1024, 'x');
+        content.front() = head;
+        content.back() = tail;
+        std::ofstream(settledDir / name, std::ios::binary) << content;
+    };
+    write("a1", 'X', '1');
+    write("a2", 'X', '2');
+    write("b1", 'Y', '1');
+    write("b2", 'Y', '3');
+
+    for (auto algorithm : { HashAlgorithm::Xxh3_128, HashAlgorithm::Sha256 }) {
+        Progress progress;
+        FileSystemTree tree = FileSystemTree::buildFromPath(settledDir, progress);
+        FinderOptions options;
+        options.algorithm = algorithm;
+        DuplicateFinder finder(tree, options);
+        EXPECT_TRUE(finder.findDuplicates(progress));
+
+        EXPECT_EQ(finder.stageStats(HashStage::Full).files, 0);
+        std::set<Digest> hashes;
+        tree.depthFirstTraverse([&](const auto& node) {
+            if (!node->data().isDirectory) {
+                EXPECT_FALSE(node->data().isIdentical) << FileSystemTree::pathOf(node);
+                hashes.insert(node->data().hash);
+            }
+        });
+        EXPECT_EQ(hashes.size(), 4u) << algorithm_name(algorithm);
+        for (const auto& [hash, dups] : finder.hashToDuplicate()) {
+            EXPECT_EQ(dups.nodes.size(), 1u);
+        }
+    }
+
+    std::filesystem::remove_all(settledDir);
+}
+
+TEST_F(DuplicateFinderTest, ConfirmWithSha256) {
+    Progress progress;
+    FileSystemTree tree = FileSystemTree::buildFromPath(testDir, progress);
+
+    FinderOptions options;
+    options.algorithm = HashAlgorithm::Xxh3_128;
+    options.confirm = true;
+    DuplicateFinder finder(tree, options);
+    EXPECT_TRUE(finder.findDuplicates(progress));
+
+    int groups = 0;
+    for (const auto& [hash, dups] : finder.hashToDuplicate()) {
+        if (dups.nodes.size() > 1) {
+            ++groups;
+            EXPECT_EQ(dups.signature.algorithm, HashAlgorithm::Xxh3_128);
+            EXPECT_TRUE(dups.signature.confirmed);
+            EXPECT_EQ(dups.nodes.size(), 3);
+        }
+    }
+    EXPECT_EQ(groups, 1);
+}
+
+TEST_F(DuplicateFinderTest, CompareSmallPartitions) {
+    auto compareDir = std::filesystem::temp_directory_path() / "dedupe_compare_test";
+    std::filesystem::create_directories(compareDir);
+
+    std::string content(2 * 1024 * 1024, 'x');
+    std::ofstream(compareDir / "a.bin", std::ios::binary) << content;
+    std::ofstream(compareDir / "b.bin", std::ios::binary) << content;
+    content[1024 * 1024 + 1] = 'c';
+    std::ofstream(compareDir / "c.bin", std::ios::binary) << content;
+
+    Progress progress;
+    FinderOptions options;
+    options.stages = { HashStage::Full };
+    options.confirm = true;
+    FileSystemTree tree = FileSystemTree::buildFromPath(compareDir, progress);
+    DuplicateFinder finder(tree, options);
+    EXPECT_TRUE(finder.findDuplicates(progress));
+
+    EXPECT_EQ(finder.stageStats(HashStage::Full).files, 0);
+    EXPECT_EQ(finder.compareStats().files, 3);
+
+    int groups = 0;
+    for (const auto& [hash, dups] : finder.hashToDuplicate()) {
+        if (!dups.isDirectory && dups.nodes.size() > 1) {
+            ++groups;
+            EXPECT_TRUE(dups.signature.compared);
+            EXPECT_TRUE(dups.signature.confirmed);
+            EXPECT_EQ(dups.nodes.size(), 2);
+        }
+    }
+    EXPECT_EQ(groups, 1);
+
+    // Disabled, the same partition is hashed
+    options.compareMaxFiles = 0;
+    FileSystemTree hashedTree = FileSystemTree::buildFromPath(compareDir, progress);
+    DuplicateFinder hashedFinder(hashedTree, options);
+    EXPECT_TRUE(hashedFinder.findDuplicates(progress));
+    EXPECT_EQ(hashedFinder.stageStats(HashStage::Full).files, 3);
+    EXPECT_EQ(hashedFinder.compareStats().files, 0);
+
+    std::filesystem::remove_all(compareDir);
+}
+TEST_F(DuplicateFinderTest, CacheSkipsUnchangedFiles) {
+    auto cacheFile = std::filesystem::temp_directory_path() / "dedupe_finder_cache.bin";
+    std::filesystem::remove(cacheFile);
+
+    auto run = [&](StageStats& head) {
+        Progress progress;
+        FileSystemTree tree = FileSystemTree::buildFromPath(testDir, progress);
+        HashCache cache(cacheFile);
+        DuplicateFinder finder(tree);
+        finder.setCache(&cache);
+        EXPECT_TRUE(finder.findDuplicates(progress));
+        cache.save();
+        head = finder.stageStats(HashStage::Head);
+        std::map<Hash, size_t> groups;
+        for (const auto& [hash, dups] : finder.hashToDuplicate()) {
+            groups[hash] = dups.nodes.size();
+        }
+        return groups;
+    };
+
+    StageStats first, second, third;
+    auto before = run(first);
+    auto after = run(second);
+    EXPECT_EQ(before, after);
+    EXPECT_EQ(first.files, 3u);
+    EXPECT_EQ(second.files, 0u);
+
+    // A changed file is read again
+    std::ofstream(testDir / "file2.txt") << "duplicate contenT";
+    run(third);
+    EXPECT_EQ(third.files, 1u);
+
+    std::filesystem::remove(cacheFile);
+}
+TEST_F(DuplicateFinderTest, IncrementalMatchesFullRescan) {
+    auto result = [](const DuplicateFinder& finder) {
+        std::map<Hash, std::pair<std::set<std::filesystem::path>, bool>> groups;
+        for (const auto& [hash, dups] : finder.hashToDuplicate()) {
+            auto paths = dups.paths();
+            groups[hash] = { std::set<std::filesystem::path>(paths.begin(), paths.end()), dups.isIdentical() };
+        }
+        return groups;
+    };
+
+    Progress progress;
+    std::ofstream(testDir / "subdir" / "other.txt") << "other duplicate";
+    std::ofstream(testDir / "other.txt") << "other duplicate";
+    FileSystemTree first = FileSystemTree::buildFromPath(testDir, progress);
+    DuplicateFinder(first).findDuplicates(progress);
+
+    // Round trip through a snapshot, then change one group and leave the other alone
+    auto file = std::filesystem::temp_directory_path() / "dedupe_incremental_snapshot.bin";
+    TreeSnapshot::save(file, first, { testDir, true, 0 });
+    FileSystemTree previous;
+    TreeSnapshot::Header header;
+    ASSERT_TRUE(TreeSnapshot::load(file, previous, header));
+    std::ofstream(testDir / "file3.txt") << "duplicate content";
+    std::ofstream(testDir / "subdir" / "file5.txt") << "unique";
+
+    FileSystemTree incremental = FileSystemTree::rebuildFromPath(testDir, previous, progress);
+    DuplicateFinder incrementalFinder(incremental);
+    EXPECT_TRUE(incrementalFinder.findDuplicates(progress));
+    EXPECT_EQ(incrementalFinder.reusedFiles(), 2u);     // The two other.txt files
+    EXPECT_EQ(incrementalFinder.stageStats(HashStage::Head).files, 4u);  // The "duplicate content" group gained file3
+
+    FileSystemTree full = FileSystemTree::buildFromPath(testDir, progress);
+    DuplicateFinder fullFinder(full);
+    EXPECT_TRUE(fullFinder.findDuplicates(progress));
+    EXPECT_EQ(result(incrementalFinder), result(fullFinder));
+
+    std::filesystem::remove(file);
+}
+
+TEST_F(DuplicateFinderTest, RefreshedPathsMatchFullRescan) {
+    Progress progress;
+    std::ofstream(testDir / "other.txt") << "other duplicate";
+    FileSystemTree tree = FileSystemTree::buildFromPath(testDir, progress);
+    DuplicateFinder(tree).findDuplicates(progress);
+    tree.settle();
+
+    // As watch applies a batch of changes
+    std::ofstream(testDir / "subdir" / "other.txt") << "other duplicate";
+    std::filesystem::remove(testDir / "file2.txt");
+    tree.refreshPath(testDir / "subdir" / "other.txt", progress);
+    tree.refreshPath(testDir / "file2.txt", progress);
+    tree.updateNestedSets();
+
+    DuplicateFinder refreshed(tree);
+    EXPECT_TRUE(refreshed.findDuplicates(progress));
+    EXPECT_EQ(refreshed.stageStats(HashStage::Head).files, 4u);   // Only the two changed size groups
+    auto group = refreshed.hashToDuplicate().find(tree.findByPath(testDir / "other.txt")->data().hash);
+    ASSERT_NE(group, refreshed.hashToDuplicate().end());
+    EXPECT_EQ(group->second.nodes.size(), 2u);
+
+    FileSystemTree full = FileSystemTree::buildFromPath(testDir, progress);
+    DuplicateFinder fullFinder(full);
+    EXPECT_TRUE(fullFinder.findDuplicates(progress));
+    std::set<std::set<std::filesystem::path>> refreshedGroups, fullGroups;
+    for (const auto& [hash, dups] : refreshed.hashToDuplicate()) {
+        auto paths = dups.paths();
+        refreshedGroups.insert(std::set<std::filesystem::path>(paths.begin(), paths.end()));
+    }
+    for (const auto& [hash, dups] : fullFinder.hashToDuplicate()) {
+        auto paths = dups.paths();
+        fullGroups.insert(std::set<std::filesystem::path>(paths.begin(), paths.end()));
+    }
+    EXPECT_EQ(refreshedGroups, fullGroups);
+}
+
 } // namespace test
-} // namespace dedupe 
\ No newline at end of file
+} // namespace dedupe
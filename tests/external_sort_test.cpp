@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "../core/external_sort.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace dedupe {
+namespace test {
+
+class ExternalSorterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        tempDir_ = std::filesystem::temp_directory_path() / "external_sort_test";
+        std::filesystem::create_directories(tempDir_);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(tempDir_);
+    }
+
+    std::vector<std::uint64_t> shuffled(std::size_t count) {
+        std::vector<std::uint64_t> values;
+        for (std::size_t i = 0; i < count; ++i) {
+            values.push_back(i * 2654435761u % 1000003);
+        }
+        return values;
+    }
+
+    std::filesystem::path tempDir_;
+};
+
+TEST_F(ExternalSorterTest, SortsInMemoryWhenItFits) {
+    ExternalSorter<std::uint64_t> sorter(tempDir_, 1024 * 1024);
+    auto values = shuffled(10000);
+    for (auto v : values) {
+        sorter.push(v);
+    }
+    std::vector<std::uint64_t> merged;
+    sorter.merge([&](std::uint64_t v) { merged.push_back(v); });
+    std::sort(values.begin(), values.end());
+    EXPECT_EQ(merged, values);
+    EXPECT_EQ(sorter.runs(), 0u);
+    EXPECT_TRUE(std::filesystem::is_empty(tempDir_));
+}
+
+TEST_F(ExternalSorterTest, MergesRunsFromDisk) {
+    // 1024 records a run: 300 runs, more than are merged at once
+    ExternalSorter<std::uint64_t> sorter(tempDir_, 0);
+    auto values = shuffled(300 * 1024 + 17);
+    for (auto v : values) {
+        sorter.push(v);
+    }
+    EXPECT_EQ(sorter.size(), values.size());
+    EXPECT_GT(sorter.runs(), 256u);
+    std::vector<std::uint64_t> merged;
+    sorter.merge([&](std::uint64_t v) { merged.push_back(v); });
+    std::sort(values.begin(), values.end());
+    EXPECT_EQ(merged, values);
+    // Runs are gone once merged
+    EXPECT_TRUE(std::filesystem::is_empty(tempDir_));
+}
+
+} // namespace test
+} // namespace dedupe
@@ -1,10 +1,14 @@
 #include <gtest/gtest.h>
 #include "../core/filesystem_tree.hpp"
+#include "../core/hasher.hpp"
 #include "../core/progress.hpp"
+#include "../core/tree_snapshot.hpp"
 #include <string>
 #include <vector>
 #include <filesystem>
 #include <fstream>
+#include <set>
+#include <unordered_set>
 
 namespace dedupe {
 namespace test {
@@ -40,10 +44,10 @@ TEST_F(FileSystemTreeTest, BuildFromPath) {
     Progress progress;
     auto tree = FileSystemTree::buildFromPath(tempDir_, progress);
     EXPECT_TRUE(tree.root() != nullptr);
-    EXPECT_EQ(tree.root()->data().path, tempDir_);
+    EXPECT_EQ(FileSystemTree::pathOf(tree.root()), tempDir_);
     EXPECT_TRUE(tree.root()->data().isDirectory);
     for(auto child : tree.root()->children()) {
-        std::cout << child->data().path << std::endl;
+        std::cout << FileSystemTree::pathOf(child) << std::endl;
     }
     EXPECT_EQ(tree.root()->childCount(), 4);  // dir1, dir2, file1.txt, and file2.txt
 }
@@ -54,7 +58,24 @@ TEST_F(FileSystemTreeTest, FindByPath) {
     auto node = tree.findByPath(tempDir_ / "file1.txt");
     EXPECT_TRUE(node != nullptr);
     EXPECT_FALSE(node->data().isDirectory);
-    EXPECT_EQ(node->data().path, tempDir_ / "file1.txt");
+    EXPECT_EQ(FileSystemTree::pathOf(node), tempDir_ / "file1.txt");
+
+    EXPECT_EQ(FileSystemTree::pathOf(tree.findByPath(tempDir_ / "dir2" / "file4.txt")), tempDir_ / "dir2" / "file4.txt");
+    EXPECT_EQ(tree.findByPath(tempDir_ / "dir2" / "missing.txt"), nullptr);
+    EXPECT_EQ(tree.findByPath(tempDir_.parent_path()), nullptr);
+}
+
+TEST_F(FileSystemTreeTest, NamesAreInterned) {
+    std::ofstream(tempDir_ / "dir1" / "file1.txt") << "test content 1";
+    Progress progress;
+    auto tree = FileSystemTree::buildFromPath(tempDir_, progress);
+    auto top = tree.findByPath(tempDir_ / "file1.txt");
+    auto nested = tree.findByPath(tempDir_ / "dir1" / "file1.txt");
+    ASSERT_TRUE(top && nested);
+    EXPECT_EQ(top->data().name, nested->data().name);
+    EXPECT_EQ(&top->data().name.native(), &nested->data().name.native());
+    EXPECT_NE(top->data().name, tree.findByPath(tempDir_ / "file2.txt")->data().name);
+    EXPECT_EQ(nested->data().name.path(), "file1.txt");
 }
 
 TEST_F(FileSystemTreeTest, CalculateSubtreeSize) {
@@ -65,5 +86,186 @@ TEST_F(FileSystemTreeTest, CalculateSubtreeSize) {
     EXPECT_GT(totalSize, 0);
 }
 
+TEST_F(FileSystemTreeTest, RebuildTracksChanges) {
+    Progress progress;
+    auto before = FileSystemTree::buildFromPath(tempDir_, progress);
+
+    // Unchanged rescan reuses every file and changes no sizes
+    auto same = FileSystemTree::rebuildFromPath(tempDir_, before, progress);
+    EXPECT_TRUE(same.isIncremental());
+    EXPECT_TRUE(same.changedSizes().empty());
+    EXPECT_TRUE(same.findByPath(tempDir_ / "dir1" / "file3.txt")->data().reused);
+
+    std::filesystem::remove(tempDir_ / "dir2" / "file4.txt");
+    std::ofstream(tempDir_ / "dir1" / "file3.txt") << "longer test content 3";
+    std::ofstream(tempDir_ / "dir1" / "new.txt") << "1234567";
+
+    auto after = FileSystemTree::rebuildFromPath(tempDir_, before, progress);
+    EXPECT_EQ(after.changedSizes(), (std::unordered_set<uintmax_t>{ 14, 21, 7 }));
+    EXPECT_TRUE(after.findByPath(tempDir_ / "file1.txt")->data().reused);
+    EXPECT_FALSE(after.findByPath(tempDir_ / "dir1" / "file3.txt")->data().reused);
+    EXPECT_TRUE(after.findByPath(tempDir_ / "dir1" / "new.txt") != nullptr);
+    EXPECT_TRUE(after.findByPath(tempDir_ / "dir2" / "file4.txt") == nullptr);
+
+    // Same shape as a full scan
+    auto full = FileSystemTree::buildFromPath(tempDir_, progress);
+    std::set<std::filesystem::path> fullPaths, afterPaths;
+    full.depthFirstTraverse([&](const auto& n) { fullPaths.insert(FileSystemTree::pathOf(n)); });
+    after.depthFirstTraverse([&](const auto& n) { afterPaths.insert(FileSystemTree::pathOf(n)); });
+    EXPECT_EQ(fullPaths, afterPaths);
+}
+
+TEST_F(FileSystemTreeTest, ParallelBuildMatchesSerial) {
+    for (int d = 0; d < 6; ++d) {
+        auto dir = tempDir_ / ("wide" + std::to_string(d));
+        for (int e = 0; e < 4; ++e) {
+            std::filesystem::create_directories(dir / ("deep" + std::to_string(e)) / "deeper");
+            std::ofstream(dir / ("deep" + std::to_string(e)) / "deeper" / "leaf.txt") << d << e;
+            std::ofstream(dir / ("file" + std::to_string(e) + ".txt")) << "content " << d;
+        }
+    }
+
+    // Same nodes in the same order, whichever thread listed them
+    auto shape = [](const FileSystemTree& tree) {
+        std::vector<std::pair<std::filesystem::path, uintmax_t>> nodes;
+        tree.depthFirstTraverse([&](const auto& n) { nodes.emplace_back(FileSystemTree::pathOf(n), n->data().size); });
+        return nodes;
+    };
+
+    Progress progress;
+    auto serial = FileSystemTree::buildFromPath(tempDir_, progress);
+    int files = FileSystemTree::fileCount, directories = FileSystemTree::directoryCount;
+    auto parallel = FileSystemTree::buildFromPath(tempDir_, progress, true, 8);
+    EXPECT_EQ(shape(serial), shape(parallel));
+    EXPECT_EQ(FileSystemTree::fileCount, files);
+    EXPECT_EQ(FileSystemTree::directoryCount, directories);
+    EXPECT_EQ(FileSystemTree::errors, 0);
+
+    std::filesystem::remove_all(tempDir_ / "wide3");
+    std::ofstream(tempDir_ / "wide1" / "deep2" / "deeper" / "leaf.txt") << "changed";
+    auto serialRescan = FileSystemTree::rebuildFromPath(tempDir_, serial, progress);
+    auto parallelRescan = FileSystemTree::rebuildFromPath(tempDir_, serial, progress, true, true, 8);
+    EXPECT_EQ(shape(serialRescan), shape(parallelRescan));
+    EXPECT_EQ(serialRescan.changedSizes(), parallelRescan.changedSizes());
+}
+
+TEST_F(FileSystemTreeTest, RefreshPathAppliesChanges) {
+    Progress progress;
+    auto tree = FileSystemTree::buildFromPath(tempDir_, progress);
+    tree.settle();
+    EXPECT_TRUE(tree.isIncremental());
+    EXPECT_TRUE(tree.findByPath(tempDir_ / "file1.txt")->data().reused);
+
+    // Touching nothing changes nothing
+    auto same = tree.refreshPath(tempDir_ / "file1.txt", progress);
+    ASSERT_TRUE(same);
+    EXPECT_TRUE(same->data().reused);
+    EXPECT_TRUE(tree.changedSizes().empty());
+
+    std::ofstream(tempDir_ / "dir1" / "file3.txt") << "longer test content 3";
+    EXPECT_FALSE(tree.refreshPath(tempDir_ / "dir1" / "file3.txt", progress)->data().reused);
+    std::filesystem::remove(tempDir_ / "dir2" / "file4.txt");
+    EXPECT_FALSE(tree.refreshPath(tempDir_ / "dir2" / "file4.txt", progress));
+
+    // A file in a new directory brings in the directory
+    std::filesystem::create_directories(tempDir_ / "dir3" / "sub");
+    std::ofstream(tempDir_ / "dir3" / "sub" / "new.txt") << "1234567";
+    auto added = tree.refreshPath(tempDir_ / "dir3" / "sub" / "new.txt", progress);
+    ASSERT_TRUE(added);
+    EXPECT_EQ(FileSystemTree::pathOf(added), tempDir_ / "dir3");
+    tree.updateNestedSets();
+
+    EXPECT_EQ(tree.changedSizes(), (std::unordered_set<uintmax_t>{ 14, 21, 7 }));
+    EXPECT_FALSE(tree.refreshPath(std::filesystem::temp_directory_path() / "elsewhere.txt", progress));
+
+    auto full = FileSystemTree::buildFromPath(tempDir_, progress);
+    std::set<std::filesystem::path> fullPaths, treePaths;
+    full.depthFirstTraverse([&](const auto& n) { fullPaths.insert(FileSystemTree::pathOf(n)); });
+    tree.depthFirstTraverse([&](const auto& n) { treePaths.insert(FileSystemTree::pathOf(n)); });
+    EXPECT_EQ(fullPaths, treePaths);
+}
+
+TEST_F(FileSystemTreeTest, NamesGoWithTheirLastHolder) {
+    auto unique = std::filesystem::path("named only by this test").native();
+    {
+        Name name(unique);
+        Name copy = name;
+        Name moved = std::move(copy);
+        EXPECT_EQ(Name::find(unique), &name.native());
+        EXPECT_EQ(moved, name);
+    }
+    EXPECT_EQ(Name::find(unique), nullptr);
+
+    // A file's name stays pooled while a tree holds it
+    std::ofstream(tempDir_ / unique) << "x";
+    {
+        Progress progress;
+        auto tree = FileSystemTree::buildFromPath(tempDir_, progress);
+        EXPECT_NE(Name::find(unique), nullptr);
+        std::filesystem::remove(tempDir_ / unique);
+        tree = FileSystemTree::rebuildFromPath(tempDir_, tree, progress);
+        EXPECT_EQ(Name::find(unique), nullptr);
+    }
+}
+
+TEST_F(FileSystemTreeTest, IndexesFollowRefresh) {
+    Progress progress;
+    auto tree = FileSystemTree::buildFromPath(tempDir_, progress);
+    auto file1 = tree.findByPath(tempDir_ / "file1.txt");
+    file1->data().hash = Hasher::fake_size_hash(1);
+    tree.findByPath(tempDir_ / "dir1" / "file3.txt")->data().hash = Hasher::fake_size_hash(1);
+
+    tree.buildIndexes();
+    EXPECT_TRUE(tree.isIndexed());
+    EXPECT_GT(tree.indexMemoryUsage(), 0u);
+    tree.depthFirstTraverse([&](const auto& n) { EXPECT_EQ(tree.findByPath(FileSystemTree::pathOf(n)), n); });
+    EXPECT_EQ(tree.findByPath(tempDir_ / "dir1" / "never interned anywhere"), nullptr);
+    EXPECT_EQ(tree.findFilesByHash(Hasher::fake_size_hash(1)).size(), 2u);
+
+    std::filesystem::remove(tempDir_ / "file1.txt");
+    tree.refreshPath(tempDir_ / "file1.txt", progress);
+    std::ofstream(tempDir_ / "dir2" / "file5.txt") << "test content 5";
+    tree.refreshPath(tempDir_ / "dir2" / "file5.txt", progress);
+    EXPECT_EQ(tree.findByPath(tempDir_ / "file1.txt"), nullptr);
+    EXPECT_TRUE(tree.findByPath(tempDir_ / "dir2" / "file5.txt"));
+    EXPECT_EQ(tree.findFilesByHash(Hasher::fake_size_hash(1)).size(), 1u);
+
+    // Refreshing a directory swaps in new nodes for everything below it
+    auto refreshed = tree.refreshPath(tempDir_ / "dir1", progress);
+    EXPECT_EQ(tree.findByPath(tempDir_ / "dir1"), refreshed);
+    EXPECT_EQ(tree.findByPath(tempDir_ / "dir1" / "file3.txt")->parent(), refreshed);
+
+    tree.dropIndexes();
+    EXPECT_FALSE(tree.isIndexed());
+    EXPECT_TRUE(tree.findByPath(tempDir_ / "dir2" / "file5.txt"));
+}
+
+TEST_F(FileSystemTreeTest, SnapshotRoundTrip) {
+    Progress progress;
+    auto tree = FileSystemTree::buildFromPath(tempDir_, progress);
+    auto node = tree.findByPath(tempDir_ / "dir1" / "file3.txt");
+    node->data().hash.bytes.fill(7);
+    node->data().hashFlags = HashConfirmed;
+
+    auto file = std::filesystem::temp_directory_path() / "filesystem_tree_snapshot.bin";
+    TreeSnapshot::save(file, tree, { tempDir_, true, 42 });
+
+    FileSystemTree loaded;
+    TreeSnapshot::Header header;
+    ASSERT_TRUE(TreeSnapshot::load(file, loaded, header));
+    EXPECT_EQ(header.root, tempDir_);
+    EXPECT_EQ(header.fingerprint, 42u);
+    auto copy = loaded.findByPath(tempDir_ / "dir1" / "file3.txt");
+    ASSERT_TRUE(copy != nullptr);
+    EXPECT_EQ(copy->data().hash, node->data().hash);
+    EXPECT_EQ(copy->data().hashFlags, HashConfirmed);
+    EXPECT_EQ(copy->data().inode, node->data().inode);
+    EXPECT_EQ(copy->data().mtime, node->data().mtime);
+    EXPECT_EQ(loaded.root()->childCount(), 4);
+
+    std::filesystem::remove(file);
+    EXPECT_FALSE(TreeSnapshot::load(file, loaded, header));
+}
+
 } // namespace test
 } // namespace dedupe 
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include "../core/hash_cache.hpp"
+#include <filesystem>
+#include <fstream>
+
+namespace dedupe {
+namespace test {
+
+class HashCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        file_ = std::filesystem::temp_directory_path() / "hash_cache_test.bin";
+        std::filesystem::remove(file_);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove(file_);
+    }
+
+    static HashCache::Key key(std::uint64_t inode) {
+        HashCache::Key k;
+        k.device = 1;
+        k.inode = inode;
+        k.algorithm = HashAlgorithm::Xxh3_128;
+        k.stage = 3;
+        return k;
+    }
+
+    static Digest digest(std::uint8_t value) {
+        Digest d;
+        d.bytes.fill(value);
+        return d;
+    }
+
+    std::filesystem::path file_;
+};
+
+TEST_F(HashCacheTest, LookupMatchesVersion) {
+    HashCache cache(file_);
+    HashCache::Version v{ 100, 5, 6 };
+    cache.store(key(1), v, digest(1));
+
+    Digest d;
+    EXPECT_TRUE(cache.lookup(key(1), v, d));
+    EXPECT_EQ(d, digest(1));
+    EXPECT_FALSE(cache.lookup(key(1), HashCache::Version{ 100, 5, 7 }, d));   // ctime moved
+    EXPECT_FALSE(cache.lookup(key(2), v, d));
+    EXPECT_FALSE(cache.lookup(key(0), v, d));       // No inode, never cached
+    EXPECT_EQ(cache.stats().hits, 1u);
+    EXPECT_EQ(cache.stats().misses, 3u);
+}
+
+TEST_F(HashCacheTest, SaveAndReload) {
+    {
+        HashCache cache(file_);
+        cache.store(key(1), { 100, 5, 6 }, digest(1));
+        cache.store(key(2), { 200, 5, 6 }, digest(2));
+        cache.save();
+    }
+    HashCache cache(file_);
+    EXPECT_EQ(cache.size(), 2u);
+    Digest d;
+    EXPECT_TRUE(cache.lookup(key(2), { 200, 5, 6 }, d));
+    EXPECT_EQ(d, digest(2));
+}
+
+TEST_F(HashCacheTest, CapAndAge) {
+    {
+        HashCache cache(file_);
+        cache.store(key(1), { 1, 0, 0 }, digest(1));
+        cache.store(key(2), { 2, 0, 0 }, digest(2));
+        cache.save();
+    }
+    {
+        // Only key 2 is used this run, key 3 is new; the cap keeps the two most recent
+        HashCache cache(file_, 2);
+        Digest d;
+        EXPECT_TRUE(cache.lookup(key(2), { 2, 0, 0 }, d));
+        cache.store(key(3), { 3, 0, 0 }, digest(3));
+        cache.save();
+        EXPECT_EQ(cache.stats().dropped, 1u);
+        EXPECT_FALSE(cache.contains(key(1), { 1, 0, 0 }));
+    }
+    {
+        // Nothing used this run, everything is a save old
+        HashCache cache(file_, 0, 1);
+        EXPECT_EQ(cache.size(), 2u);
+        cache.save();
+        EXPECT_EQ(cache.size(), 0u);
+    }
+}
+
+TEST_F(HashCacheTest, RejectsOtherFiles) {
+    std::ofstream(file_) << "not a cache at all";
+    EXPECT_THROW(HashCache cache(file_), std::runtime_error);
+}
+
+} // namespace test
+} // namespace dedupe
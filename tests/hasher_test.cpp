@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include "../core/hasher.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace dedupe {
+namespace test {
+
+class HasherTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        tempDir_ = std::filesystem::temp_directory_path() / "hasher_test";
+        std::filesystem::create_directories(tempDir_);
+
+        std::string large;
+        for (int i = 0; i < 300000; ++i) {
+            large += static_cast<char>('a' + i % 26);
+        }
+        std::ofstream(tempDir_ / "large.bin", std::ios::binary) << large;
+        std::ofstream(tempDir_ / "small.txt") << "small content";
+        std::ofstream(tempDir_ / "empty.txt");
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(tempDir_);
+    }
+
+    std::filesystem::path tempDir_;
+};
+
+TEST_F(HasherTest, MappedMatchesStream) {
+    Progress progress;
+    for (auto name : { "large.bin", "small.txt", "empty.txt" }) {
+        auto streamed = Hasher::hash_file(tempDir_ / name, progress, false, ReadMode::Stream);
+        auto mapped = Hasher::hash_file(tempDir_ / name, progress, false, ReadMode::Mapped);
+        EXPECT_FALSE(streamed.empty());
+        EXPECT_EQ(streamed, mapped) << name;
+    }
+}
+
+TEST_F(HasherTest, QuickHashOnlyReadsFirstBlock) {
+    Progress progress;
+    std::string head(8192, 'x');
+    std::ofstream(tempDir_ / "a.bin", std::ios::binary) << head << "tail a";
+    std::ofstream(tempDir_ / "b.bin", std::ios::binary) << head << "tail b";
+
+    EXPECT_EQ(Hasher::hash_file(tempDir_ / "a.bin", progress, true),
+              Hasher::hash_file(tempDir_ / "b.bin", progress, true));
+    EXPECT_NE(Hasher::hash_file(tempDir_ / "a.bin", progress, false, ReadMode::Mapped),
+              Hasher::hash_file(tempDir_ / "b.bin", progress, false, ReadMode::Mapped));
+}
+
+TEST_F(HasherTest, Algorithms) {
+    Progress progress;
+    std::string abc = "abc";
+    EXPECT_EQ(Hasher::hash_string(abc, progress, HashAlgorithm::Sha256).toHex(digest_size(HashAlgorithm::Sha256)),
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(Hasher::hash_string(abc, progress, HashAlgorithm::Xxh3_128).toHex(digest_size(HashAlgorithm::Xxh3_128)),
+              "06b05ab6733a618578af5f94892f3950");
+
+    for (auto mode : { ReadMode::Stream, ReadMode::Mapped }) {
+        auto digest = Hasher::hash_file(tempDir_ / "large.bin", progress, false, mode, HashAlgorithm::Xxh3_128);
+        EXPECT_EQ(digest, Hasher::hash_file(tempDir_ / "large.bin", progress, false, ReadMode::Stream, HashAlgorithm::Xxh3_128));
+        // The unused tail of the digest stays zero
+        EXPECT_EQ(digest.toHex().substr(32), std::string(32, '0'));
+    }
+
+    HashAlgorithm parsed = HashAlgorithm::Sha256;
+    EXPECT_TRUE(parse_algorithm(algorithm_name(HashAlgorithm::Xxh3_128), parsed));
+    EXPECT_EQ(parsed, HashAlgorithm::Xxh3_128);
+    EXPECT_FALSE(parse_algorithm("md5", parsed));
+}
+
+TEST_F(HasherTest, FakeSizeHash) {
+    EXPECT_FALSE(Hasher::fake_size_hash(0).empty());
+    EXPECT_NE(Hasher::fake_size_hash(1), Hasher::fake_size_hash(256));
+    EXPECT_EQ(std::hash<Digest>()(Hasher::fake_size_hash(7)), std::hash<Digest>()(Hasher::fake_size_hash(7)));
+}
+
+TEST_F(HasherTest, MissingFileThrows) {
+    Progress progress;
+    EXPECT_THROW(Hasher::hash_file(tempDir_ / "missing", progress), std::runtime_error);
+}
+
+TEST_F(HasherTest, BatchMatchesSingleFiles) {
+    Progress progress;
+    std::vector<std::filesystem::path> files = {
+        tempDir_ / "large.bin", tempDir_ / "missing", tempDir_ / "small.txt", tempDir_ / "empty.txt"
+    };
+    // Depth 1 and 2 force the large file through several reads on a slot or two
+    for (auto mode : { ReadMode::Stream, ReadMode::Uring }) {
+        for (unsigned depth : { 1u, 2u, 32u }) {
+            auto results = Hasher::hash_files(files, progress, mode, HashAlgorithm::Xxh3_128, depth);
+            ASSERT_EQ(results.size(), files.size());
+            EXPECT_FALSE(results[1].error.empty());
+            for (size_t i : { 0, 2, 3 }) {
+                EXPECT_TRUE(results[i].error.empty()) << results[i].error;
+                EXPECT_EQ(results[i].digest, Hasher::hash_file(files[i], progress, false, ReadMode::Stream,
+                                                               HashAlgorithm::Xxh3_128)) << files[i];
+            }
+        }
+    }
+}
+
+} // namespace test
+} // namespace dedupe
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include "../core/layout.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace dedupe {
+namespace test {
+
+TEST(LayoutTest, KeyOrder) {
+    LayoutKey a{ 1, false, 500 };
+    LayoutKey b{ 1, false, 9000 };
+    LayoutKey c{ 1, true, 3 };
+    LayoutKey d{ 2, false, 0 };
+    EXPECT_TRUE(a < b);
+    EXPECT_TRUE(b < c);     // Known offsets come before inode estimates
+    EXPECT_TRUE(c < d);     // Devices never interleave
+    EXPECT_FALSE(b < a);
+}
+
+TEST(LayoutTest, FallsBackToInode) {
+    auto file = std::filesystem::temp_directory_path() / "layout_test.bin";
+    std::ofstream(file, std::ios::binary) << std::string(64 * 1024, 'x');
+
+    auto key = layout_key(file, 7, 1234, false);
+    EXPECT_EQ(key.device, 7u);
+    EXPECT_TRUE(key.estimated);
+    EXPECT_EQ(key.position, 1234u);
+
+    // With extents the answer depends on the filesystem, an estimate must still be the inode
+    key = layout_key(file, 7, 1234, true);
+    if (key.estimated) {
+        EXPECT_EQ(key.position, 1234u);
+    }
+
+    std::uint64_t offset;
+    EXPECT_FALSE(physical_offset(file.parent_path() / "layout_test_missing.bin", offset));
+
+    // A file just written shares no extents with anything
+    EXPECT_EQ(shared_extents_key(file), 0u);
+    EXPECT_EQ(shared_extents_key(file.parent_path() / "layout_test_missing.bin"), 0u);
+    std::filesystem::remove(file);
+}
+
+} // namespace test
+} // namespace dedupe
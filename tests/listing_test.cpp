@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include "../core/listing.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
+
+namespace dedupe {
+namespace test {
+
+class ListingTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / "listing_test";
+        std::filesystem::remove_all(dir_);
+        std::filesystem::create_directories(dir_ / "sub");
+        std::ofstream(dir_ / "file.txt") << "twelve bytes";
+        std::filesystem::create_directory_symlink(dir_ / "sub", dir_ / "link");
+        std::filesystem::create_symlink(dir_ / "missing", dir_ / "dangling");
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(dir_);
+    }
+
+    static const DirectoryEntry* find(const std::vector<DirectoryEntry>& entries, const std::string& name) {
+        auto it = std::find_if(entries.begin(), entries.end(), [&](const auto& e) { return e.name == name; });
+        return it == entries.end() ? nullptr : &*it;
+    }
+
+    std::filesystem::path dir_;
+};
+
+TEST_F(ListingTest, MatchesFilesystem) {
+    std::vector<DirectoryEntry> entries;
+    list_directory(dir_, entries);
+    ASSERT_EQ(entries.size(), 4u);
+
+    auto file = find(entries, "file.txt");
+    ASSERT_TRUE(file);
+    EXPECT_FALSE(file->isDirectory);
+    EXPECT_EQ(file->size, 12u);
+    EXPECT_EQ(file->error, 0);
+    EXPECT_NE(file->mtime, 0);
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat st;
+    ASSERT_EQ(::stat((dir_ / "file.txt").c_str(), &st), 0);
+    EXPECT_EQ(file->inode, static_cast<std::uint64_t>(st.st_ino));
+    EXPECT_EQ(file->device, static_cast<std::uint64_t>(st.st_dev));
+    EXPECT_EQ(file->links, static_cast<std::uint32_t>(st.st_nlink));
+#endif
+
+    // Symlinks are followed, dangling ones fail like std::filesystem::file_size would
+    ASSERT_TRUE(find(entries, "link"));
+    EXPECT_TRUE(find(entries, "link")->isDirectory);
+    EXPECT_EQ(find(entries, "link")->inode, find(entries, "sub")->inode);
+    ASSERT_TRUE(find(entries, "dangling"));
+    EXPECT_NE(find(entries, "dangling")->error, 0);
+}
+
+TEST_F(ListingTest, NamesAndDirectories) {
+    std::vector<DirectoryEntry> entries;
+    std::vector<std::string> names{ "sub", "file.txt", "gone.txt" };
+    list_directory(dir_, entries, &names);
+    ASSERT_EQ(entries.size(), 3u);
+    EXPECT_EQ(entries[0].name, "sub");
+    EXPECT_TRUE(entries[0].isDirectory);
+    EXPECT_EQ(entries[1].size, 12u);
+    EXPECT_NE(entries[2].error, 0);
+
+    // Without directories, symlinks to them are still stat'ed and left out
+    list_directory(dir_, entries, nullptr, false);
+    for (const auto& entry : entries) {
+        EXPECT_FALSE(entry.isDirectory) << entry.name;
+    }
+    EXPECT_TRUE(find(entries, "file.txt"));
+
+    EXPECT_THROW(list_directory(dir_ / "missing", entries), std::filesystem::filesystem_error);
+}
+
+} // namespace test
+} // namespace dedupe
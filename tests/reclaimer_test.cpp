@@ -0,0 +1,305 @@
+#include <gtest/gtest.h>
+#include "../core/reclaimer.hpp"
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace dedupe {
+namespace test {
+
+// Files as strings, handles as indices. Ranges compare like FIDEDUPERANGE, and
+// each call is recorded.
+class MockBackend : public ReclaimBackend {
+public:
+    struct Call {
+        std::uint64_t offset;
+        std::uint64_t length;
+        std::size_t targets;
+    };
+
+    std::map<std::filesystem::path, std::string> files;
+    std::vector<Call> calls;
+    std::vector<std::pair<std::filesystem::path, std::filesystem::path>> links;
+    std::uint64_t maxBytes = ~std::uint64_t(0);    // Most a call dedupes per target
+    int openError = 0;                              // Returned for targets when set
+
+    int open(const std::filesystem::path& path, bool target) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (target && openError) return -openError;
+        handles_.push_back(path);
+        ++open_;
+        return static_cast<int>(handles_.size() - 1);
+    }
+
+    void close(int) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --open_;
+    }
+
+    void dedupe(int source, std::uint64_t offset, std::uint64_t length,
+                const std::vector<int>& targets, std::vector<RangeResult>& results) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        calls.push_back({ offset, length, targets.size() });
+        results.assign(targets.size(), RangeResult());
+        auto range = files[handles_[source]].substr(offset, length);
+        for (std::size_t i = 0; i < targets.size(); ++i) {
+            if (files[handles_[targets[i]]].substr(offset, length) != range) {
+                results[i].status = DIFFERS;
+            }
+            else {
+                results[i].bytes = std::min(length, maxBytes);
+            }
+        }
+    }
+
+    void link(const std::filesystem::path& source, const std::filesystem::path& target) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        links.emplace_back(source, target);
+    }
+
+    int stillOpen() const { return open_; }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::filesystem::path> handles_;
+    int open_ = 0;
+};
+
+class ReclaimerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        testDir_ = std::filesystem::temp_directory_path() / "reclaimer_test";
+        std::filesystem::create_directories(testDir_);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(testDir_);
+    }
+
+    std::filesystem::path write(const std::string& name, const std::string& content) {
+        auto path = testDir_ / name;
+        std::ofstream(path, std::ios::binary) << content;
+        mock_.files[path] = content;
+        return path;
+    }
+
+    // Scan and find, leaving the groups to reclaim in groups_
+    void find(FinderOptions options = FinderOptions()) {
+        Progress progress;
+        tree_ = FileSystemTree::buildFromPath(testDir_, progress);
+        finder_ = std::make_unique<DuplicateFinder>(tree_, options);
+        ASSERT_TRUE(finder_->findDuplicates(progress));
+        groups_ = Reclaimer::identicalFiles(*finder_);
+    }
+
+    std::filesystem::path testDir_;
+    MockBackend mock_;
+    FileSystemTree tree_;
+    std::unique_ptr<DuplicateFinder> finder_;
+    std::vector<const DuplicateFiles*> groups_;
+};
+
+TEST_F(ReclaimerTest, DryRunTouchesNothing) {
+    std::string content(10000, 'a');
+    for (auto name : { "a", "b", "c" }) {
+        write(name, content);
+    }
+    write("other", std::string(10000, 'b'));
+    find();
+    ASSERT_EQ(groups_.size(), 1u);
+
+    ReclaimOptions options;
+    options.dryRun = true;
+    Progress progress;
+    auto stats = Reclaimer(options, mock_).reclaim(groups_, progress);
+    EXPECT_EQ(stats.groups, 1u);
+    EXPECT_EQ(stats.files, 2u);
+    EXPECT_EQ(stats.bytes, 20000u);
+    EXPECT_TRUE(mock_.calls.empty());
+    EXPECT_TRUE(mock_.links.empty());
+}
+
+TEST_F(ReclaimerTest, DedupeBatchesAndChunks) {
+    std::string content(10000, 'a');
+    for (int i = 0; i < 5; ++i) {
+        write("copy" + std::to_string(i), content);
+    }
+    find();
+    ASSERT_EQ(groups_.size(), 1u);
+
+    // Four targets in batches of three, 4000 bytes a call
+    ReclaimOptions options;
+    options.batchSize = 3;
+    options.chunkSize = 4000;
+    options.threads = 2;
+    Progress progress;
+    auto stats = Reclaimer(options, mock_).reclaim(groups_, progress);
+    EXPECT_EQ(stats.files, 4u);
+    EXPECT_EQ(stats.bytes, 40000u);
+    EXPECT_TRUE(stats.failed.empty());
+    EXPECT_EQ(mock_.stillOpen(), 0);
+
+    ASSERT_EQ(mock_.calls.size(), 6u);
+    std::size_t targets = 0;
+    for (const auto& call : mock_.calls) {
+        EXPECT_LE(call.length, 4000u);
+        EXPECT_LE(call.targets, 3u);
+        targets += call.targets;
+    }
+    EXPECT_EQ(targets, 12u);
+}
+
+TEST_F(ReclaimerTest, ShortCallsCarryOn) {
+    std::string content(10000, 'a');
+    write("a", content);
+    write("b", content);
+    find();
+
+    // A kernel deduping less than asked: the next call starts where it stopped
+    mock_.maxBytes = 3000;
+    ReclaimOptions options;
+    options.chunkSize = 4000;
+    Progress progress;
+    auto stats = Reclaimer(options, mock_).reclaim(groups_, progress);
+    EXPECT_EQ(stats.files, 1u);
+    EXPECT_EQ(stats.bytes, 10000u);
+    ASSERT_EQ(mock_.calls.size(), 4u);
+    EXPECT_EQ(mock_.calls[1].offset, 3000u);
+    EXPECT_EQ(mock_.calls[3].length, 1000u);
+}
+
+TEST_F(ReclaimerTest, ChangedCopiesDiffer) {
+    std::string content(10000, 'a');
+    write("a", content);
+    write("b", content);
+    write("c", content);
+    find();
+    ASSERT_EQ(groups_.size(), 1u);
+
+    // The last copy changed after it was hashed; the kernel compares and refuses it
+    mock_.files[FileSystemTree::pathOf(groups_[0]->nodes.back())][7000] = 'b';
+    ReclaimOptions options;
+    options.chunkSize = 4000;
+    options.threads = 1;
+    Progress progress;
+    auto stats = Reclaimer(options, mock_).reclaim(groups_, progress);
+    EXPECT_EQ(stats.files, 1u);
+    EXPECT_EQ(stats.differed, 1u);
+    EXPECT_EQ(stats.bytes, 4000u + 10000u);
+    EXPECT_EQ(mock_.calls.size(), 3u);
+    EXPECT_EQ(mock_.calls.back().targets, 1u);
+    EXPECT_EQ(mock_.stillOpen(), 0);
+}
+
+TEST_F(ReclaimerTest, OpenFailuresAreReported) {
+    write("a", "same content");
+    write("b", "same content");
+    find();
+
+    mock_.openError = EACCES;
+    Progress progress;
+    auto stats = Reclaimer(ReclaimOptions(), mock_).reclaim(groups_, progress);
+    EXPECT_EQ(stats.files, 0u);
+    ASSERT_EQ(stats.failed.size(), 1u);
+    EXPECT_NE(stats.failed[0].second.find("Cannot open"), std::string::npos);
+    EXPECT_TRUE(mock_.calls.empty());
+    EXPECT_EQ(mock_.stillOpen(), 0);
+}
+
+TEST_F(ReclaimerTest, HardLinksNeedConfirmedGroups) {
+    write("a", "same content");
+    write("b", "same content");
+    find();
+
+    ReclaimOptions options;
+    options.mode = ReclaimMode::HardLink;
+    Progress progress;
+    auto stats = Reclaimer(options, mock_).reclaim(groups_, progress);
+    EXPECT_EQ(stats.skipped, 1u);
+    EXPECT_TRUE(mock_.links.empty());
+
+    FinderOptions confirmed;
+    confirmed.confirm = true;
+    find(confirmed);
+    stats = Reclaimer(options, mock_).reclaim(groups_, progress);
+    EXPECT_EQ(stats.skipped, 0u);
+    EXPECT_EQ(stats.files, 1u);
+    EXPECT_EQ(mock_.links.size(), 1u);
+
+    // A SHA-256 signature alone isn't enough, the finder has to confirm the group
+    DuplicateFiles sha = *groups_[0];
+    sha.signature.algorithm = HashAlgorithm::Sha256;
+    sha.signature.confirmed = sha.signature.compared = false;
+    stats = Reclaimer(options, mock_).reclaim({ &sha }, progress);
+    EXPECT_EQ(stats.skipped, 1u);
+
+    FinderOptions hashed;
+    hashed.algorithm = HashAlgorithm::Sha256;
+    find(hashed);
+    ASSERT_EQ(groups_.size(), 1u);
+    EXPECT_TRUE(groups_[0]->signature.confirmed);
+    stats = Reclaimer(options, mock_).reclaim(groups_, progress);
+    EXPECT_EQ(stats.skipped, 0u);
+}
+
+TEST_F(ReclaimerTest, SystemBackendLinks) {
+    std::string content(5000, 'x');
+    auto a = write("a", content);
+    auto b = write("b", content);
+    auto c = write("c", content);
+    std::filesystem::create_hard_link(a, testDir_ / "a-link");
+    FinderOptions confirmed;
+    confirmed.confirm = true;
+    find(confirmed);
+
+    ReclaimOptions options;
+    options.mode = ReclaimMode::HardLink;
+    Progress progress;
+    auto stats = Reclaimer(options).reclaim(groups_, progress);
+    EXPECT_TRUE(stats.failed.empty());
+    EXPECT_EQ(stats.files, 2u);
+    EXPECT_EQ(stats.bytes, 10000u);
+
+    struct stat sa, sb, sc;
+    ASSERT_EQ(::stat(a.c_str(), &sa), 0);
+    ASSERT_EQ(::stat(b.c_str(), &sb), 0);
+    ASSERT_EQ(::stat(c.c_str(), &sc), 0);
+    EXPECT_EQ(sa.st_ino, sb.st_ino);
+    EXPECT_EQ(sa.st_ino, sc.st_ino);
+    EXPECT_EQ(sa.st_nlink, 4u);
+    // Nothing left behind under the temporary names
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(testDir_), std::filesystem::directory_iterator()), 4);
+}
+
+TEST_F(ReclaimerTest, SystemBackendDedupes) {
+    std::string content(100000, 'x');
+    write("a", content);
+    write("b", content);
+    find();
+    ASSERT_EQ(groups_.size(), 1u);
+    auto b = FileSystemTree::pathOf(groups_[0]->nodes.back());
+
+    // Only btrfs and XFS share extents; elsewhere the kernel refuses and nothing changes
+    Progress progress;
+    auto stats = Reclaimer().reclaim(groups_, progress);
+    if (stats.failed.empty()) {
+        EXPECT_EQ(stats.files, 1u);
+        EXPECT_EQ(stats.bytes, 100000u);
+    }
+    else {
+        ASSERT_EQ(stats.failed.size(), 1u);
+        EXPECT_EQ(stats.failed[0].first, b);
+        EXPECT_EQ(stats.files, 0u);
+    }
+    std::ifstream in(b, std::ios::binary);
+    std::string read((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(read, content);
+}
+
+} // namespace test
+} // namespace dedupe
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include "../core/sharded_scan.hpp"
+#include "../core/duplicate_finder.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dedupe {
+namespace test {
+
+class ShardedScanTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        testDir_ = std::filesystem::temp_directory_path() / "sharded_scan_test";
+        std::string content(20000, 'a');
+        auto tail = content;
+        tail.back() = 't';
+        // Copies spread over subtrees, so groups span shards
+        write("a1", content);
+        write("one/a2", content);
+        write("two/deep/a3", content);
+        write("two/tail1", tail);
+        write("three/tail2", tail);
+        write("three/small", "small");
+        write("big/x/small", "small");
+        write("big/y/empty", "");
+        write("empty", "");
+        std::filesystem::create_hard_link(testDir_ / "a1", testDir_ / "one/a1-link");
+        // One subtree far heavier than the rest, opened up between shards
+        for (int d = 0; d < 4; ++d) {
+            for (int i = 0; i < 50; ++i) {
+                write("big/" + std::to_string(d) + "/u" + std::to_string(i), std::string(100 + d * 50 + i, 'u'));
+            }
+        }
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(testDir_);
+    }
+
+    void write(const std::string& name, const std::string& content) {
+        auto path = testDir_ / name;
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream(path, std::ios::binary) << content;
+    }
+
+    using Groups = std::set<std::pair<std::vector<std::filesystem::path>, std::size_t>>;
+
+    Groups scan(const ShardOptions& options, ShardStats& stats) {
+        ShardedScan sharded(options);
+        Progress progress;
+        Groups groups;
+        EXPECT_TRUE(sharded.find(testDir_, progress, [&](const StreamGroup& group) {
+            auto paths = group.paths;
+            std::sort(paths.begin(), paths.end());
+            groups.emplace(paths, group.copies);
+        }));
+        stats = sharded.stats();
+        return groups;
+    }
+
+    Groups expected() {
+        Progress progress;
+        FileSystemTree tree = FileSystemTree::buildFromPath(testDir_, progress);
+        DuplicateFinder finder(tree);
+        EXPECT_TRUE(finder.findDuplicates(progress));
+        Groups groups;
+        for (const auto& [hash, group] : finder.hashToDuplicate()) {
+            if (group.isDirectory || !group.isIdentical()) continue;
+            auto paths = group.paths();
+            std::sort(paths.begin(), paths.end());
+            groups.emplace(paths, group.copies);
+        }
+        return groups;
+    }
+
+    std::filesystem::path testDir_;
+};
+
+TEST_F(ShardedScanTest, MatchesSingleProcessScan) {
+    auto single = expected();
+    ASSERT_EQ(single.size(), 4u);
+
+    for (bool processes : { true, false }) {
+        ShardOptions options;
+        options.shards = 3;
+        options.threads = 2;
+        options.processes = processes;
+        ShardStats stats;
+        EXPECT_EQ(scan(options, stats), single) << (processes ? "processes" : "in process");
+        EXPECT_EQ(stats.files, 210u);
+        EXPECT_EQ(stats.directories, 11u);
+        EXPECT_EQ(stats.groups, 4u);
+        EXPECT_EQ(stats.reclaimableBytes, 2 * 20000u + 20000u + 5u);
+        EXPECT_EQ(stats.errors, 0u);
+        // Unique sizes are never read, a1 and its link are read as one inode
+        EXPECT_EQ(stats.candidates, 10u);
+        EXPECT_EQ(stats.hashed, 9u + 5u);
+        ASSERT_EQ(stats.shardFiles.size(), 3u);
+        // The big subtree was split, no shard walked it all
+        for (auto files : stats.shardFiles) {
+            EXPECT_LT(files, 200u);
+        }
+    }
+}
+
+TEST_F(ShardedScanTest, BalancesHeaviestFirst) {
+    auto dealt = ShardedScan::balance({ 5, 9, 1, 4, 4, 3 }, 2);
+    ASSERT_EQ(dealt.size(), 2u);
+    std::vector<std::uint64_t> weights = { 5, 9, 1, 4, 4, 3 };
+    auto load = [&](const std::vector<std::size_t>& indices) {
+        std::uint64_t total = 0;
+        for (auto i : indices) total += weights[i];
+        return total;
+    };
+    EXPECT_EQ(load(dealt[0]), 13u);
+    EXPECT_EQ(load(dealt[1]), 13u);
+    EXPECT_EQ(dealt[0].size() + dealt[1].size(), weights.size());
+}
+
+TEST_F(ShardedScanTest, Cancels) {
+    Progress cancelled(nullptr, []() { return true; });
+    ShardedScan sharded;
+    bool called = false;
+    EXPECT_FALSE(sharded.find(testDir_, cancelled, [&](const StreamGroup&) { called = true; }));
+    EXPECT_FALSE(called);
+}
+
+} // namespace test
+} // namespace dedupe
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include "../core/streaming_finder.hpp"
+#include "../core/duplicate_finder.hpp"
+#include "../core/temp_directory.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dedupe {
+namespace test {
+
+class StreamingFinderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        testDir_ = std::filesystem::temp_directory_path() / "streaming_finder_test";
+        std::filesystem::create_directories(testDir_ / "sub");
+
+        std::string content(20000, 'a');
+        write("a1", content);
+        write("sub/a2", content);
+        write("a3", content);
+        std::filesystem::create_hard_link(testDir_ / "a1", testDir_ / "sub/a1-link");
+        // Same size, differs in the head or only in the tail
+        auto head = content;
+        head[0] = 'h';
+        write("head", head);
+        auto tail = content;
+        tail.back() = 't';
+        write("tail1", tail);
+        write("sub/tail2", tail);
+        write("small1", "small");
+        write("small2", "small");
+        write("empty1", "");
+        write("sub/empty2", "");
+        // Unique sizes, enough records that the sorts spill
+        for (int i = 0; i < 1500; ++i) {
+            write("sub/unique" + std::to_string(i), std::string(100 + i, 'u'));
+        }
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(testDir_);
+    }
+
+    void write(const std::string& name, const std::string& content) {
+        std::ofstream(testDir_ / name, std::ios::binary) << content;
+    }
+
+    using Groups = std::set<std::pair<std::vector<std::filesystem::path>, std::size_t>>;
+
+    std::filesystem::path testDir_;
+};
+
+TEST_F(StreamingFinderTest, MatchesTreeFinder) {
+    StreamOptions options;
+    options.memoryBudget = 0;       // Smallest sorts, so every pass goes through runs on disk
+    options.batchSize = 2;
+    options.tempDirectory = testDir_.parent_path();
+    StreamingFinder streaming(options);
+    Progress progress;
+    Groups streamed;
+    ASSERT_TRUE(streaming.find(testDir_, progress, [&](const StreamGroup& group) {
+        auto paths = group.paths;
+        std::sort(paths.begin(), paths.end());
+        streamed.emplace(paths, group.copies);
+    }));
+
+    FileSystemTree tree = FileSystemTree::buildFromPath(testDir_, progress);
+    DuplicateFinder finder(tree);
+    ASSERT_TRUE(finder.findDuplicates(progress));
+    Groups expected;
+    for (const auto& [hash, group] : finder.hashToDuplicate()) {
+        if (group.isDirectory || !group.isIdentical()) continue;
+        auto paths = group.paths();
+        std::sort(paths.begin(), paths.end());
+        expected.emplace(paths, group.copies);
+    }
+
+    EXPECT_EQ(streamed, expected);
+    EXPECT_EQ(streamed.size(), 4u);
+    EXPECT_TRUE(streamed.count({ { testDir_ / "a1", testDir_ / "a3", testDir_ / "sub/a1-link", testDir_ / "sub/a2" }, 3 }));
+
+    const auto& stats = streaming.stats();
+    EXPECT_EQ(stats.files, 1511u);
+    EXPECT_EQ(stats.directories, 1u);
+    EXPECT_EQ(stats.groups, 4u);
+    EXPECT_EQ(stats.reclaimableBytes, 2 * 20000u + 20000u + 5u);
+    EXPECT_GT(stats.runs, 0u);
+    EXPECT_EQ(stats.errors, 0u);
+    // Unique sizes are never read; of the 20000 byte files, head only reaches the full pass
+    // with the other same-head files, a1 and its link once
+    EXPECT_EQ(stats.headHashed, 10u);
+    EXPECT_EQ(stats.fullHashed, 5u);
+    // The working directory is cleaned up
+    for (const auto& entry : std::filesystem::directory_iterator(testDir_.parent_path())) {
+        EXPECT_EQ(entry.path().filename().string().rfind("dedupe-stream-", 0), std::string::npos);
+    }
+}
+
+TEST_F(StreamingFinderTest, Cancels) {
+    Progress cancelled(nullptr, []() { return true; });
+    StreamingFinder streaming;
+    bool called = false;
+    EXPECT_FALSE(streaming.find(testDir_, cancelled, [&](const StreamGroup&) { called = true; }));
+    EXPECT_FALSE(called);
+}
+
+TEST_F(StreamingFinderTest, TempDirectoriesAreDistinct) {
+    std::filesystem::path first;
+    {
+        TempDirectory a(testDir_, "dedupe-stream");
+        TempDirectory b(testDir_, "dedupe-stream");
+        EXPECT_NE(a.path, b.path);
+        EXPECT_TRUE(std::filesystem::is_directory(a.path));
+        EXPECT_TRUE(std::filesystem::is_directory(b.path));
+        first = a.path;
+    }
+    EXPECT_FALSE(std::filesystem::exists(first));
+}
+
+} // namespace test
+} // namespace dedupe
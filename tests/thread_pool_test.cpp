@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "../core/thread_pool.hpp"
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+namespace dedupe {
+namespace test {
+
+TEST(ThreadPoolTest, RunsAllTasks) {
+    ThreadPool pool(4);
+    EXPECT_EQ(pool.size(), 4u);
+
+    std::vector<int> results(1000, 0);
+    for (size_t i = 0; i < results.size(); ++i) {
+        pool.submit([&results, i]() { results[i] = static_cast<int>(i) * 2; });
+    }
+    pool.wait();
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i], static_cast<int>(i) * 2);
+    }
+}
+
+TEST(ThreadPoolTest, NestedSubmitAndReuse) {
+    ThreadPool pool(3);
+    std::atomic<int> count{ 0 };
+
+    // Tasks spawning tasks land on the worker's own deque and get stolen from there
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 10; ++i) {
+            pool.submit([&]() {
+                for (int j = 0; j < 10; ++j) {
+                    pool.submit([&]() { ++count; });
+                }
+            });
+        }
+        pool.wait();
+    }
+    EXPECT_EQ(count, 200);
+}
+
+TEST(ThreadPoolTest, SingleThreadRunsOnCaller) {
+    ThreadPool pool(1);
+    auto caller = std::this_thread::get_id();
+    bool sameThread = false;
+    pool.submit([&]() { sameThread = std::this_thread::get_id() == caller; });
+    pool.wait();
+    EXPECT_TRUE(sameThread);
+}
+
+TEST(ThreadPoolTest, RethrowsTaskException) {
+    ThreadPool pool(2);
+    pool.submit([]() { throw std::runtime_error("boom"); });
+    EXPECT_THROW(pool.wait(), std::runtime_error);
+}
+
+} // namespace test
+} // namespace dedupe
@@ -7,9 +7,9 @@
 
 namespace dedupe {
 
-int dedupe::FileSystemTree::errors = 0;
-int dedupe::FileSystemTree::directoryCount = 0;
-int dedupe::FileSystemTree::fileCount = 0;
+std::atomic<int> dedupe::FileSystemTree::errors{ 0 };
+std::atomic<int> dedupe::FileSystemTree::directoryCount{ 0 };
+std::atomic<int> dedupe::FileSystemTree::fileCount{ 0 };
    
 namespace test {
 
@@ -157,7 +157,7 @@ protected:
 TEST_F(FileSystemTreeTest, BuildFromPath) {
     auto tree = FileSystemTree::buildFromPath(tempDir_);
     EXPECT_TRUE(tree.root() != nullptr);
-    EXPECT_EQ(tree.root()->data().path, tempDir_);
+    EXPECT_EQ(FileSystemTree::pathOf(tree.root()), tempDir_);
     EXPECT_TRUE(tree.root()->data().isDirectory);
     EXPECT_EQ(tree.root()->childCount(), 4);  // dir1, dir2, file1.txt, and file2.txt
 }
@@ -167,7 +167,7 @@ TEST_F(FileSystemTreeTest, FindByPath) {
     auto node = tree.findByPath(tempDir_ / "file1.txt");
     EXPECT_TRUE(node != nullptr);
     EXPECT_FALSE(node->data().isDirectory);
-    EXPECT_EQ(node->data().path, tempDir_ / "file1.txt");
+    EXPECT_EQ(FileSystemTree::pathOf(node), tempDir_ / "file1.txt");
 }
 
 TEST_F(FileSystemTreeTest, CalculateSubtreeSize) {
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include "../core/watcher.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dedupe {
+namespace test {
+
+namespace {
+
+bool contains(const std::vector<Watcher::Change>& changes, const std::filesystem::path& path) {
+    return std::any_of(changes.begin(), changes.end(), [&](const auto& c) { return c.path == path; });
+}
+
+} // namespace
+
+TEST(WatcherTest, ReportsChangesOnce) {
+    Watcher watcher;
+    if (!watcher.supported()) {
+        GTEST_SKIP() << "inotify not available";
+    }
+    auto dir = std::filesystem::temp_directory_path() / "watcher_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "a");
+    watcher.addTree(dir);
+    EXPECT_EQ(watcher.watched(), 2u);
+    EXPECT_FALSE(watcher.exhausted());
+
+    using std::chrono::milliseconds;
+    std::vector<Watcher::Change> changes;
+    std::ofstream(dir / "a" / "one.txt") << "one";
+    std::ofstream(dir / "a" / "one.txt") << "one again";
+    std::filesystem::create_directories(dir / "b");
+    ASSERT_TRUE(watcher.poll(milliseconds(2000), milliseconds(50), changes));
+    EXPECT_TRUE(contains(changes, dir / "a" / "one.txt"));
+    EXPECT_TRUE(contains(changes, dir / "b"));
+    EXPECT_EQ(std::count_if(changes.begin(), changes.end(), [&](const auto& c) { return c.path == dir / "a" / "one.txt"; }), 1);
+
+    // New directories are watched as they appear
+    std::ofstream(dir / "b" / "two.txt") << "two";
+    std::filesystem::rename(dir / "a" / "one.txt", dir / "one.txt");
+    ASSERT_TRUE(watcher.poll(milliseconds(2000), milliseconds(50), changes));
+    EXPECT_TRUE(contains(changes, dir / "b" / "two.txt"));
+    EXPECT_TRUE(contains(changes, dir / "a" / "one.txt"));
+    EXPECT_TRUE(contains(changes, dir / "one.txt"));
+
+    ASSERT_TRUE(watcher.poll(milliseconds(10), milliseconds(10), changes));
+    EXPECT_TRUE(changes.empty());
+    std::filesystem::remove_all(dir);
+}
+
+TEST(WatcherTest, SteadyEventsStillEndTheBatch) {
+    Watcher watcher;
+    if (!watcher.supported()) {
+        GTEST_SKIP() << "inotify not available";
+    }
+    auto dir = std::filesystem::temp_directory_path() / "watcher_steady_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    watcher.addTree(dir);
+
+    // A write every few milliseconds never leaves the settle time quiet
+    using std::chrono::milliseconds;
+    std::atomic<bool> stop{ false };
+    std::thread writer([&]() {
+        for (int i = 0; !stop; ++i) {
+            std::ofstream(dir / (std::to_string(i % 100) + ".txt")) << i;
+            std::this_thread::sleep_for(milliseconds(5));
+        }
+    });
+    std::vector<Watcher::Change> changes;
+    auto start = Watcher::Clock::now();
+    bool complete = watcher.poll(milliseconds(2000), milliseconds(50), changes, milliseconds(300));
+    auto elapsed = Watcher::Clock::now() - start;
+    stop = true;
+    writer.join();
+
+    EXPECT_TRUE(complete);
+    EXPECT_FALSE(changes.empty());
+    EXPECT_LT(elapsed, milliseconds(1500));
+    std::filesystem::remove_all(dir);
+}
+
+TEST(WatcherTest, LatencyStats) {
+    LatencyStats stats;
+    EXPECT_EQ(stats.percentileMs(99), 0.0);
+    for (int ms = 1; ms <= 100; ++ms) {
+        stats.add(std::chrono::milliseconds(ms));
+    }
+    EXPECT_EQ(stats.count(), 100u);
+    EXPECT_DOUBLE_EQ(stats.meanMs(), 50.5);
+    EXPECT_DOUBLE_EQ(stats.maxMs(), 100.0);
+    EXPECT_DOUBLE_EQ(stats.percentileMs(50), 51.0);
+    EXPECT_DOUBLE_EQ(stats.percentileMs(100), 100.0);
+}
+
+} // namespace test
+} // namespace dedupe
@@ -9,7 +9,7 @@
 namespace dedupe {
 
 const QStringList FileSystemModel::columnHeaders_ = {
-    "Name", "Size", "Hash", "Duplicate", "Identical"
+    "Name", "Size", "Hash", "Duplicate", "Identical", "Similar"
 };
 
 FileSystemModel::FileSystemModel(QObject* parent)
@@ -30,40 +30,40 @@ QModelIndex FileSystemModel::index(int row, int column, const QModelIndex& paren
 {
     if (!tree_->root()) return QModelIndex();
 
-    const NestedNode<FileSystemNode>* parentNode = nullptr;
+    const ArenaNode<FileSystemNode>* parentNode = nullptr;
     if (parent.isValid()) {
-        parentNode = static_cast<const NestedNode<FileSystemNode>*>(parent.internalPointer());
+        parentNode = static_cast<const ArenaNode<FileSystemNode>*>(parent.internalPointer());
     } else {
-        parentNode = tree_->root().get();
+        parentNode = tree_->root();
     }
 
     if (row < 0 || row >= static_cast<int>(parentNode->children().size())) {
         return QModelIndex();
     }
 
-    return createIndex(row, column, parentNode->children()[row].get());
+    return createIndex(row, column, parentNode->children()[row]);
 }
 
 QModelIndex FileSystemModel::parent(const QModelIndex& child) const
 {
     if (!child.isValid()) return QModelIndex();
 
-    const NestedNode<FileSystemNode>* childNode = static_cast<const NestedNode<FileSystemNode>*>(child.internalPointer());
-    const auto& parent = childNode->parent();
+    const ArenaNode<FileSystemNode>* childNode = static_cast<const ArenaNode<FileSystemNode>*>(child.internalPointer());
+    const auto* parent = childNode->parent();
     
     if (!parent) return QModelIndex();
 
     // Find the row of the parent in its parent's children
-    const auto& grandParent = parent->parent();
+    const auto* grandParent = parent->parent();
     if (!grandParent) {
         // Parent is root
-        return createIndex(0, 0, parent.get());
+        return createIndex(0, 0, parent);
     }
 
     const auto& siblings = grandParent->children();
     for (size_t i = 0; i < siblings.size(); ++i) {
-        if (siblings[i].get() == parent.get()) {
-            return createIndex(static_cast<int>(i), 0, parent.get());
+        if (siblings[i] == parent) {
+            return createIndex(static_cast<int>(i), 0, parent);
         }
     }
 
@@ -79,7 +79,7 @@ int FileSystemModel::rowCount(const QModelIndex& parent) const
         return static_cast<int>(tree_->root()->children().size());
     }
 
-    const NestedNode<FileSystemNode>* node = static_cast<const NestedNode<FileSystemNode>*>(parent.internalPointer());
+    const ArenaNode<FileSystemNode>* node = static_cast<const ArenaNode<FileSystemNode>*>(parent.internalPointer());
     return static_cast<int>(node->children().size());
 }
 
@@ -92,13 +92,13 @@ QVariant FileSystemModel::data(const QModelIndex& index, int role) const
 {
     if (!index.isValid() || !tree_->root()) return QVariant();
 
-    const NestedNode<FileSystemNode>* node = static_cast<const NestedNode<FileSystemNode>*>(index.internalPointer());
+    const ArenaNode<FileSystemNode>* node = static_cast<const ArenaNode<FileSystemNode>*>(index.internalPointer());
     const auto& data = node->data();
 
     if (role == Qt::DisplayRole) {
         switch (static_cast<Column>(index.column())) {
             case Column::Name:
-                return QString::fromStdString(data.path.filename().string());
+                return QString::fromStdString(data.name.path().filename().string());
             case Column::Size:
                 return data.isDirectory ? QString() : formatSize(data.size);
             case Column::Hash:
@@ -107,6 +107,10 @@ QVariant FileSystemModel::data(const QModelIndex& index, int role) const
                 return formatBoolean(data.isDuplicate);
             case Column::Identical:
                 return formatBoolean(data.isIdentical);
+            case Column::Similar: {
+                auto it = similar_.find(node);
+                return it == similar_.end() ? QString() : QString("%1%").arg(static_cast<int>(it->second.second * 100));
+            }
             default:
                 return QVariant();
         }
@@ -137,7 +141,7 @@ QVariant FileSystemModel::data(const QModelIndex& index, int role) const
     return QVariant();
 }
 
-QString FileSystemModel::getTooltipForNode(const NestedNode<FileSystemNode>* node) const
+QString FileSystemModel::getTooltipForNode(const ArenaNode<FileSystemNode>* node) const
 {
     if (!node) return QString();
 
@@ -153,20 +157,26 @@ QString FileSystemModel::getTooltipForNode(const NestedNode<FileSystemNode>* nod
         else {
             tooltip += "File";
         }
-        tooltip += ":\n" + QString::fromStdString(data.path.string());
+        tooltip += ":\n" + QString::fromStdString(FileSystemTree::pathOf(node).string());
+        auto similar = similar_.find(node);
+        if (similar != similar_.end()) {
+            tooltip += QString("\n%1% similar to:\n").arg(static_cast<int>(similar->second.second * 100))
+                + QString::fromStdString(FileSystemTree::pathOf(similar->second.first).string());
+        }
         return tooltip;
     }
 
     tooltip += data.isDirectory ? "Identical directory:" : "Duplicate file:";
-    tooltip += "\n" + QString::fromStdString(data.path.string());
+    auto path = FileSystemTree::pathOf(node);
+    tooltip += "\n" + QString::fromStdString(path.string());
 
     std::vector<std::string> duplicateFilenames{ };
     if (hashToDuplicate_ != nullptr) {
         auto it = hashToDuplicate_->find(data.hash);
         if (it != hashToDuplicate_->end()) {
             duplicateFilenames.clear();
-            for (auto p : it->second.paths) {
-                if (p != data.path)
+            for (auto p : it->second.paths()) {
+                if (p != path)
                     duplicateFilenames.push_back(p.string());
             }
         }
@@ -248,9 +258,25 @@ void FileSystemModel::setDuplicates(const HashToDuplicate& duplicates)
     hashToDuplicate_ = std::make_unique<HashToDuplicate>(duplicates);
 }
 
+void FileSystemModel::setSimilar(const std::vector<SimilarDirectories>& similar)
+{
+    beginResetModel();
+    similar_.clear();
+    for (const auto& pair : similar) {
+        for (auto [node, other] : { std::make_pair(pair.first, pair.second), std::make_pair(pair.second, pair.first) }) {
+            auto it = similar_.find(node);
+            if (it == similar_.end() || it->second.second < pair.similarity) {
+                similar_[node] = { other, pair.similarity };
+            }
+        }
+    }
+    endResetModel();
+}
+
 void FileSystemModel::clear()
 {
     beginResetModel();
+    similar_.clear();
     tree_.reset();
     endResetModel();
 }
@@ -259,7 +285,7 @@ FileSystemModel::NodeIndex FileSystemModel::getNodeIndex(const QModelIndex& inde
 {
     if (!index.isValid()) return NodeIndex();
     
-    const NestedNode<FileSystemNode>* node = static_cast<const NestedNode<FileSystemNode>*>(index.internalPointer());
+    const ArenaNode<FileSystemNode>* node = static_cast<const ArenaNode<FileSystemNode>*>(index.internalPointer());
     return NodeIndex(node, index.row());
 }
 
@@ -277,16 +303,12 @@ QString FileSystemModel::formatSize(uintmax_t bytes) const
     return QString("%1 %2").arg(size, 0, 'f', 1).arg(units[unitIndex]);
 }
 
-QString FileSystemModel::formatHash(const std::string& hash) const
+QString FileSystemModel::formatHash(const Digest& hash) const
 {
     if (hash.empty()) return QString();
     
-    // Format hash as a shortened version for display
-    if (hash.length() > 8) {
-        return QString::fromStdString(hash.substr(0, 8) + "...");
-    }
-    
-    return QString::fromStdString(hash);
+    // Format hash as a shortened version for display, only the leading bytes are hexed
+    return QString::fromStdString(hash.toHex(4) + "...");
 }
 
 QString FileSystemModel::formatBoolean(bool value) const
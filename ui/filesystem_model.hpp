@@ -5,6 +5,9 @@
 #include "../core/filesystem_tree.hpp"
 #include "../core/duplicate_finder.hpp"
 #include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace dedupe {
 
@@ -18,6 +21,7 @@ public:
         Hash,
         Duplicate,
         Identical,
+        Similar,
         ColumnCount
     };
 
@@ -34,28 +38,31 @@ public:
     // Custom methods
     void setTree(const FileSystemTree& tree);
     void setDuplicates(const HashToDuplicate &duplicates);
+    void setSimilar(const std::vector<SimilarDirectories>& similar);
     void clear();
 
 private:
     struct NodeIndex {
-        const NestedNode<FileSystemNode>* node;
+        const ArenaNode<FileSystemNode>* node;
         int row;
-        NodeIndex(const NestedNode<FileSystemNode>* n = nullptr, int r = 0) 
+        NodeIndex(const ArenaNode<FileSystemNode>* n = nullptr, int r = 0) 
             : node(n), row(r) {}
     };
 
     NodeIndex getNodeIndex(const QModelIndex& index) const;
     QString formatSize(uintmax_t bytes) const;
-    QString formatHash(const std::string& hash) const;
+    QString formatHash(const Digest& hash) const;
     QString formatBoolean(bool value) const;
     QIcon createCompositeIcon(const QIcon& baseIcon, const QIcon& suffixIcon) const;
     QIcon createSuffixIcon(const QString& text) const;
     
     // Tooltip methods
-    QString getTooltipForNode(const NestedNode<FileSystemNode>* node) const;
+    QString getTooltipForNode(const ArenaNode<FileSystemNode>* node) const;
     
     std::unique_ptr<FileSystemTree> tree_;
     std::unique_ptr<HashToDuplicate> hashToDuplicate_;
+    // Each directory's most similar other directory
+    std::unordered_map<const ArenaNode<FileSystemNode>*, std::pair<const ArenaNode<FileSystemNode>*, double>> similar_;
     static const QStringList columnHeaders_;
     
     // Icon members
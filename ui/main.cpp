@@ -11,6 +11,6 @@ int main(int argc, char *argv[]) {
     return app.exec();
 } 
 
-int dedupe::FileSystemTree::errors = 0;
-int dedupe::FileSystemTree::directoryCount = 0;
-int dedupe::FileSystemTree::fileCount = 0;
+std::atomic<int> dedupe::FileSystemTree::errors{ 0 };
+std::atomic<int> dedupe::FileSystemTree::directoryCount{ 0 };
+std::atomic<int> dedupe::FileSystemTree::fileCount{ 0 };
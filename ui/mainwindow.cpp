@@ -100,15 +100,18 @@ void MainWindow::onScanClicked()
         updateStatusMessage(QString::fromStdString("Scanning directory:" + currentPath_.toStdString()));
 
         auto tree = FileSystemTree::buildFromPath(currentPath_.toStdString(), progress);
-        duplicateFinder_ = new DuplicateFinder(tree);
+        FinderOptions options;
+        options.similarity = 0.8;
+        duplicateFinder_ = new DuplicateFinder(tree, options);
         duplicateFinder_->findDuplicates(progress);
         model_->setTree(tree);
         model_->setDuplicates(duplicateFinder_->hashToDuplicate());
+        model_->setSimilar(duplicateFinder_->similarDirectories());
         
         int duplicates = 0;
         for (auto& [hash, dup] : duplicateFinder_->hashToDuplicate())
-            if(dup.paths.size() > 1)
-                duplicates += dup.paths.size();
+            if(dup.isIdentical())
+                duplicates += dup.copies;
 
         // Update status bar with completion message
         std::stringstream ss;